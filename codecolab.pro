@@ -24,7 +24,28 @@ SOURCES += \
     src/CollaborationManager.cpp \
     src/CollaborationServer.cpp \
     src/EditOperation.cpp \
-    src/UserStorage.cpp
+    src/UserStorage.cpp \
+    src/BlobStore.cpp \
+    src/DocumentCatalog.cpp \
+    src/TextFileLoader.cpp \
+    src/LineIndex.cpp \
+    src/TextRope.cpp \
+    src/DocumentAcl.cpp \
+    src/AuthorshipMap.cpp \
+    src/AnchorIndex.cpp \
+    src/TextDiff.cpp \
+    src/OperationLog.cpp \
+    src/HistoryPlaybackDialog.cpp \
+    src/UndoManager.cpp \
+    src/IntervalIndex.cpp \
+    src/MinimapWidget.cpp \
+    src/TextSearch.cpp \
+    src/FindReplaceBar.cpp \
+    src/BracketIndex.cpp \
+    src/OutlineIndex.cpp \
+    src/OutlinePanel.cpp \
+    src/CompletionTrie.cpp \
+    src/CompletionIndex.cpp
 
 HEADERS += \
     include/MainWindow.h \
@@ -37,7 +58,28 @@ HEADERS += \
     include/CollaborationManager.h \
     include/CollaborationServer.h \
     include/EditOperation.h \
-    include/UserStorage.h
+    include/UserStorage.h \
+    include/BlobStore.h \
+    include/DocumentCatalog.h \
+    include/TextFileLoader.h \
+    include/LineIndex.h \
+    include/TextRope.h \
+    include/DocumentAcl.h \
+    include/AuthorshipMap.h \
+    include/AnchorIndex.h \
+    include/TextDiff.h \
+    include/OperationLog.h \
+    include/HistoryPlaybackDialog.h \
+    include/UndoManager.h \
+    include/IntervalIndex.h \
+    include/MinimapWidget.h \
+    include/TextSearch.h \
+    include/FindReplaceBar.h \
+    include/BracketIndex.h \
+    include/OutlineIndex.h \
+    include/OutlinePanel.h \
+    include/CompletionTrie.h \
+    include/CompletionIndex.h
 
 FORMS += \
     forms/MainWindow.ui \
@@ -48,6 +90,10 @@ INCLUDEPATH += include
 RESOURCES += \
     resources/CodeColab.qrc
 
+# Unit tests are their own project; `make check` builds and runs them
+check.commands = $(MKDIR) tests && cd tests && $(QMAKE) $$PWD/tests/tests.pro && $(MAKE) check
+QMAKE_EXTRA_TARGETS += check
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
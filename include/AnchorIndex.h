@@ -0,0 +1,62 @@
+// AnchorIndex.h
+#ifndef ANCHORINDEX_H
+#define ANCHORINDEX_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Text positions that follow edits. Anchors are kept in a treap ordered by
+// position with lazy "add" and "assign" tags, so an edit shifts every anchor
+// behind it in O(log n) instead of touching each one. Parent links let a
+// single anchor be read, moved or removed by its handle.
+//
+// Positions follow QTextCursor semantics: an anchor at the edit position or
+// inside the removed range ends up after the inserted text.
+class AnchorIndex {
+public:
+    AnchorIndex();
+
+    int create(int position); // Returns a handle
+    void remove(int anchor);
+    bool isValid(int anchor) const;
+
+    int position(int anchor);
+    void setPosition(int anchor, int position);
+
+    void applyEdit(int position, int removedLength, int insertedLength);
+
+    int count() const { return liveCount; }
+    void clear();
+
+private:
+    struct Node {
+        int left;
+        int right;
+        int parent;
+        quint32 priority;
+        int position;
+        int add;         // Pending shift for the subtree below
+        int assignValue; // Pending assignment, valid when hasAssign
+        bool hasAssign;
+        bool alive;
+    };
+
+    void applyAdd(int node, int delta);
+    void applyAssign(int node, int value);
+    void push(int node);
+    void pushPath(int node);
+    void setLeft(int node, int child);
+    void setRight(int node, int child);
+    void splitLess(int node, int key, int* left, int* right);
+    int merge(int left, int right);
+    void detach(int node);
+    void insert(int node);
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root;
+    int liveCount;
+    quint32 seed;
+};
+
+#endif // ANCHORINDEX_H
@@ -0,0 +1,72 @@
+// AuthorshipMap.h
+#ifndef AUTHORSHIPMAP_H
+#define AUTHORSHIPMAP_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <QJsonObject>
+#include <vector>
+
+// Who wrote each character of a document, stored as runs of consecutive
+// characters with the same author. The runs are kept in an implicit treap
+// with subtree sums, like LineIndex, so memory grows with the number of runs
+// and an edit or lookup costs O(log runs). An empty author means unknown
+// (e.g. content that predates authorship tracking).
+class AuthorshipMap {
+public:
+    AuthorshipMap();
+
+    void reset(int length, const QString& author = QString());
+    bool applyEdit(int position, int removedLength, int insertedLength, const QString& author);
+
+    int length() const { return sum(root); }
+    int runCount() const { return count(root); }
+
+    QString authorAt(int offset) const;
+    // For ascending, non-overlapping (position, length) ranges, the author
+    // of most characters in each range, found in one pass over the runs
+    QStringList dominantAuthors(const QVector<QPair<int, int>>& ranges) const;
+
+    QJsonObject toJson() const;
+    bool fromJson(const QJsonObject& json, int expectedLength);
+
+private:
+    struct Run {
+        int length;
+        int author; // Index into authors
+    };
+
+    struct Node {
+        int left;
+        int right;
+        quint32 priority;
+        int length;
+        int author;
+        int count; // Runs in this subtree
+        int sum;   // Characters in this subtree
+    };
+
+    int authorIndex(const QString& author);
+    int createNode(const Run& run);
+    void releaseTree(int node);
+    void update(int node);
+    void split(int node, int offset, int* left, int* right);
+    int merge(int left, int right);
+    int buildFromRuns(const std::vector<Run>& runs);
+    void appendRuns(int node, std::vector<Run>* out) const;
+    int findRun(int offset, int* runStart) const;
+    int count(int node) const { return node < 0 ? 0 : nodes[node].count; }
+    int sum(int node) const { return node < 0 ? 0 : nodes[node].sum; }
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root;
+    quint32 seed;
+    QStringList authors;
+    QHash<QString, int> authorIds;
+};
+
+#endif // AUTHORSHIPMAP_H
@@ -0,0 +1,45 @@
+// BlobStore.h
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QSet>
+#include <QMutex>
+
+// Content-addressed chunk store shared by every document and version.
+// Text is split into content-defined chunks, each chunk is named by the
+// SHA-256 of its bytes and stored compressed under documents/blobs/, so
+// identical regions of forked documents or successive versions are kept once.
+class BlobStore {
+public:
+    static BlobStore& getInstance() {
+        static BlobStore instance;
+        return instance;
+    }
+
+    // Stores the content and returns the ordered list of chunk references
+    QStringList storeContent(const QString& content, bool* ok = nullptr);
+
+    // Rebuilds the content from its chunk references, reading only those chunks
+    QString loadContent(const QStringList& chunkRefs, bool* ok = nullptr);
+
+    bool hasChunk(const QString& chunkRef);
+
+private:
+    BlobStore();
+    ~BlobStore() {}
+    BlobStore(const BlobStore&) = delete;
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    QString chunkPath(const QString& chunkRef) const;
+    bool writeChunk(const QString& chunkRef, const QByteArray& data);
+    QByteArray readChunk(const QString& chunkRef, bool* ok);
+
+    QString rootPath;
+    QSet<QString> knownChunks; // Chunks already confirmed on disk
+    QMutex mutex;
+};
+
+#endif // BLOBSTORE_H
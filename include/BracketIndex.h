@@ -0,0 +1,68 @@
+// BracketIndex.h
+#ifndef BRACKETINDEX_H
+#define BRACKETINDEX_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Nesting depth index over the lines of a document. Each line is reduced
+// to its net depth change and the lowest depth it reaches relative to its
+// start; an implicit treap keeps subtree sums and minimum prefixes of those,
+// so replacing k lines costs O(log n + k) and finding where the depth next
+// (or last) falls to a given level costs O(log n). That is the line holding
+// a bracket's partner; the caller scans that one line for the column.
+// Bracket kinds are not told apart: ( [ { open and ) ] } close.
+class BracketIndex {
+public:
+    struct LineSummary {
+        int delta = 0;    // Depth at the end of the line minus at its start
+        int minDepth = 0; // Lowest depth within the line, relative to its start (<= 0)
+    };
+
+    BracketIndex();
+
+    void reset(const std::vector<LineSummary>& lines);
+    // Lines [firstLine, firstLine + removedCount) become lines
+    void replaceLines(int firstLine, int removedCount, const std::vector<LineSummary>& lines);
+    void setLine(int line, const LineSummary& summary);
+
+    int lineCount() const;
+    LineSummary line(int line) const;
+    // Depth at the start of line
+    int depthBefore(int line) const;
+
+    // First line at or after fromLine that reaches depth or lower, or -1
+    int findForward(int fromLine, int depth) const;
+    // Last line at or before toLine that reaches depth or lower, or -1
+    int findBackward(int toLine, int depth) const;
+
+private:
+    struct Node {
+        int left;
+        int right;
+        quint32 priority;
+        LineSummary summary;
+        int count;     // Lines in this subtree
+        int delta;     // Net depth change over this subtree
+        int minPrefix; // Lowest depth reached in this subtree, relative to its start
+    };
+
+    int createNode(const LineSummary& summary);
+    void releaseTree(int node);
+    void update(int node);
+    void split(int node, int lines, int* left, int* right);
+    int merge(int left, int right);
+    int buildFromSummaries(const std::vector<LineSummary>& lines);
+    int findFirst(int node, int base, int offset, int fromLine, int depth) const;
+    int findLast(int node, int base, int offset, int toLine, int depth) const;
+    int count(int node) const { return node < 0 ? 0 : nodes[node].count; }
+    int delta(int node) const { return node < 0 ? 0 : nodes[node].delta; }
+    int minPrefix(int node) const { return node < 0 ? 0 : nodes[node].minPrefix; }
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root;
+    quint32 seed;
+};
+
+#endif // BRACKETINDEX_H
@@ -4,22 +4,43 @@
 
 #include <QPlainTextEdit>
 #include <QMap>
+#include <QList>
 #include <QColor>
 #include <memory>
 #include "Document.h"
 #include "CollaborationManager.h"
 #include "EditOperation.h"
+#include "AnchorIndex.h"
+#include "UndoManager.h"
+#include "IntervalIndex.h"
+#include "TextSearch.h"
+#include "BracketIndex.h"
 
 class QSyntaxHighlighter;
 class QPaintEvent;
 class QResizeEvent;
 class QSize;
+class QHelpEvent;
+class QPainter;
+class QTimer;
+class QInputMethodEvent;
+class QMimeData;
+class QCompleter;
+class QStringListModel;
+class CompletionIndex;
 
 struct RemoteCursor {
     QString userId;
     QString username;
-    int position;
+    int anchor; // Handle in the editor's AnchorIndex, shifted by every edit
+    int selectionAnchor = -1; // Handle of the selection's other end, or -1
     QColor color;
+
+    // Viewport geometry, reused across paints until the layout changes
+    bool geometryValid = false;
+    bool onScreen = false;
+    QRect caretRect;
+    QRect labelRect;
 };
 
 class CodeEditorWidget : public QPlainTextEdit
@@ -30,28 +51,110 @@ public:
     explicit CodeEditorWidget(QWidget *parent = nullptr);
     ~CodeEditorWidget();
 
+    // Recently shown documents keep their text, highlighting, folds, caret,
+    // scroll position and undo history, within the "editor" settings
+    // group's memory budget, so switching back to one needs no reload
     void setDocument(std::shared_ptr<Document> doc);
+    std::shared_ptr<Document> documentModel() const { return currentDocument; }
     void setCollaborationManager(std::shared_ptr<CollaborationManager> manager);
     void setLanguage(const QString& language);
     void highlightSyntax();
-    void updateRemoteCursor(const QString& userId, const QString& username, int position);
+    // selectionAnchor is the other end of the peer's selection, or -1 for none
+    void updateRemoteCursor(const QString& userId, const QString& username, int position,
+                            int selectionAnchor = -1);
+    // Remote edits are queued and applied together once per frame
     void applyRemoteEdit(const EditOperation& operation);
+    void flushRemoteEdits();
+    // Applies a local operation of any kind and publishes it
+    bool applyLocalOperation(const EditOperation& operation);
+    // Set when every peer in the document understands rich operation kinds
+    void setRichOperationsEnabled(bool enabled) { richOperationsEnabled = enabled; }
+    // Publishes the plain steps of a rich operation the server rejected;
+    // false if they are no longer kept
+    bool resendAsSteps(int sequence);
+    // Applies whole new content as a diff; publish sends it to peers as local edits
+    void replaceContent(const QString& content, bool publish = false);
+    void setLocalUserId(const QString& userId) { localUserId = userId; }
 
     void removeRemoteCursor(const QString& userId);
+    // Current position and color of every remote cursor
+    QVector<QPair<int, QColor>> remoteCursorPositions();
+
+    // Positions that stay attached to the text through local and remote edits
+    int createAnchor(int position) { return anchors.create(position); }
+    int anchorPosition(int anchor) { return anchors.position(anchor); }
+    void releaseAnchor(int anchor) { anchors.remove(anchor); }
+
+    // True when the last cursor move only followed an edit; peers shift
+    // their copy of this cursor through the edit, so it needn't be sent
+    bool cursorMovedByEdit() const { return cursorMoveFromEdit; }
+
+    // Colored strip in the gutter showing the main author of each line
+    void setAuthorshipVisible(bool visible);
+    bool isAuthorshipVisible() const { return authorshipVisible; }
+
+    static QColor colorForUser(const QString& userId);
+
+    // Find and replace. Matches are highlighted in the viewport and kept
+    // current through local and remote edits.
+    bool setSearchQuery(const TextSearch::Query& query);
+    void clearSearch();
+    const TextSearch& search() const { return textSearch; }
+    // Selects the next match after the cursor, or the previous one before it
+    bool findNext(bool backward = false);
+    // Replaces the selected match and moves on to the next one
+    bool replaceCurrent(const QString& replacement);
+    // Replaces every match as one operation; returns the number replaced
+    int replaceAll(const QString& replacement);
+
+    // Set for documents above the size or line limits in the "editor"
+    // settings group; expensive features then cover only the viewport
+    bool isLargeFileMode() const { return largeFileMode; }
+
+    // Position of the bracket paired with the one at position, or -1.
+    // Brackets in strings and comments are skipped.
+    int matchingBracket(int position) const;
+    // Code folding hides the lines inside a bracket pair opened on line
+    bool isFoldable(int line) const;
+    bool isFolded(int line) const;
+    void toggleFold(int line);
+    void unfoldAll();
+
+    // Identifier completion while typing and on Ctrl+Space; documents shown
+    // in this editor are added to the index
+    void setCompletionIndex(CompletionIndex* index);
+
+public slots:
+    // Undo and redo cover only this user's edits, never a peer's
+    void undoLocalEdit();
+    void redoLocalEdit();
 
 signals:
+    void localEditApplied(const EditOperation& operation);
+    // Compatibility signal carrying the full content; only built when connected
     void editorContentChanged(const QString& content);
     void cursorPositionChanged(int position);
+    void remoteCursorsChanged();
+    // Emitted for each remote edit, with the range of its inserted text
+    void remoteEditApplied(const QString& userId, int position, int length);
+    void searchMatchesChanged(int count);
+    // Emitted after setDocument() has loaded the new model, or none
+    void documentModelChanged();
+    // contentsChange of the text on show, after the model has taken the
+    // edit; document() itself is replaced whenever the document changes
+    void contentsChange(int position, int charsRemoved, int charsAdded);
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
+    void inputMethodEvent(QInputMethodEvent *event) override;
+    void insertFromMimeData(const QMimeData *source) override;
     void resizeEvent(QResizeEvent *event) override;
 
 private slots:
-    void onTextChanged();
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
     void onCursorPositionChanged();
     void updateLineNumberAreaWidth(int newBlockCount);
     void highlightCurrentLine();
@@ -72,24 +175,150 @@ private:
             codeEditor->lineNumberAreaPaintEvent(event);
         }
 
+        bool event(QEvent *event) override;
+
+        void mousePressEvent(QMouseEvent *event) override {
+            codeEditor->lineNumberAreaMousePress(event);
+        }
+
     private:
         CodeEditorWidget *codeEditor;
     };
 
     int lineNumberAreaWidth() const;
+    QString textRange(int position, int length) const;
+    void resynchronizeDocument();
+    void publishLocalEdit(const DocumentChange& change);
+    void publishOperation(const EditOperation& op);
+    void applyOperationSteps(const QVector<EditOperation>& steps);
+    bool applyRemoteStep(QTextCursor& cursor, const EditOperation& step, const QString& userId);
+    void indentSelectedLines(bool indent);
+    void moveSelectedLines(int direction);
     void lineNumberAreaPaintEvent(QPaintEvent *event);
+    void lineNumberAreaMousePress(QMouseEvent *event);
+    void showAuthorshipToolTip(QHelpEvent *event);
+    void updateRemoteCursorGeometry(RemoteCursor& cursor);
+    void invalidateRemoteCursorGeometry();
+    void scrollRemoteCursorGeometry(int dx, int dy);
+    static QRect remoteCursorBounds(const RemoteCursor& cursor);
+    int visibleLineCount() const;
+    int lastVisibleBlockNumber() const;
+    QRect visibleRangeRect(int start, int end);
+    void updateRemoteSelectionArea(const RemoteCursor& cursor);
+    void releaseRemoteSelection(RemoteCursor& cursor);
+    void rebuildSelectionIndex();
+    void collectVisibleBlocks(const QRect& area, QVector<QTextBlock>* blocks, QVector<QRectF>* rects);
+    void fillTextRange(QPainter& painter, const QVector<QTextBlock>& blocks, const QVector<QRectF>& rects,
+                       int start, int end, const QColor& color);
+    void paintRemoteSelections(QPainter& painter, const QVector<QTextBlock>& blocks, const QVector<QRectF>& rects);
+    void paintSearchMatches(QPainter& painter, const QVector<QTextBlock>& blocks, const QVector<QRectF>& rects);
+    void updateSearchAfterEdit(int position, int charsRemoved, int charsAdded);
+    QString displayNameForUser(const QString& userId) const;
+    void applyUndoEdit(const UndoManager::Edit& edit);
+    bool exceedsLargeFileLimits() const;
+    void highlightViewport();
+    void updateBracketIndex(int position, int charsRemoved, int charsAdded);
+    void refreshBracketLines(int firstLine, int lastLine);
+    void rebuildBracketIndex();
+    int foldEnd(int line) const;
+    void setLinesVisible(int firstLine, int lastLine, bool visible);
+    QString wordBeforeCursor() const;
+    // Shows completions for the word before the cursor, or hides the list
+    void updateCompletion(bool forced);
+    void insertCompletion(const QString& word);
+
+    // A document's text and editor state, kept while another one is shown
+    struct CachedDocument {
+        std::weak_ptr<Document> model;
+        quint64 revision = 0; // Model revision the text matches
+        QTextDocument* text = nullptr;
+        QSyntaxHighlighter* highlighter = nullptr;
+        UndoManager undoManager;
+        BracketIndex bracketIndex;
+        bool largeFileMode = false;
+        bool bracketsEnabled = false;
+        bool foldsPresent = false;
+        int highlightedFirstBlock = -1;
+        int highlightedLastBlock = -1;
+        int highlightedRevision = -1;
+        int cursorAnchor = 0;
+        int cursorPosition = 0;
+        int horizontalScroll = 0;
+        int verticalScroll = 0;
+    };
+
+    void connectTextDocument(QTextDocument* text);
+    // Shows a new text for currentDocument
+    void loadDocument();
+    bool cacheCurrentDocument();
+    bool takeCachedDocument(const std::shared_ptr<Document>& doc, CachedDocument* entry);
+    void restoreCachedDocument(CachedDocument& entry);
+    static void releaseCachedDocument(const CachedDocument& entry);
+    // Drops the least recently shown texts beyond the memory budget
+    void trimDocumentCache();
 
     LineNumberArea *lineNumberArea;
     std::shared_ptr<Document> currentDocument;
     std::shared_ptr<CollaborationManager> collaborationManager;
     QSyntaxHighlighter* syntaxHighlighter;
     QString currentLanguage;
+    QString localUserId;
 
     // Remote cursors for visualization
     QMap<QString, RemoteCursor> remoteCursors;
+    AnchorIndex anchors;
+    int lastHorizontalScroll;
+
+    // Peer selections, indexed by range so painting finds the visible ones
+    struct RemoteSelection {
+        int start;
+        int end;
+        QColor color;
+    };
+    QVector<RemoteSelection> remoteSelections;
+    IntervalIndex selectionIndex;
+    bool selectionIndexDirty;
+
+    // Remote edits waiting for the next frame
+    QVector<EditOperation> pendingRemoteEdits;
+    QTimer* remoteEditTimer;
+
+    TextSearch textSearch;
+
+    int expectedCursorAfterEdit;
+    bool cursorMoveFromEdit;
+
+    // QTextDocument's own undo stack is off; it would also undo remote edits
+    UndoManager undoManager;
+    bool applyingUndo;
+    bool richOperationsEnabled;
+    int lastRichSequence;
+    QMap<int, QVector<EditOperation>> sentRichSteps; // Latest rich operations sent, by sequence
 
     // Track local changes to avoid loops
     bool ignoreChanges;
+    bool authorshipVisible;
+
+    // Large-file mode highlights the visible blocks only; the last
+    // highlighted window is kept so unchanged repaints skip the work
+    bool largeFileMode;
+    int highlightedFirstBlock;
+    int highlightedLastBlock;
+    int highlightedRevision;
+
+    // Nesting depth per line, updated from each edit; off in large-file mode
+    BracketIndex bracketIndex;
+    bool bracketsEnabled;
+    // Set once a block is hidden; visible lines then no longer follow
+    // from block numbers
+    bool foldsPresent;
+
+    CompletionIndex* completionIndex;
+    QCompleter* completer;
+    QStringListModel* completionModel;
+
+    // Most recently shown first
+    QList<CachedDocument> documentCache;
 };
 
 #endif // CODEEDITORWIDGET_H
\ No newline at end of file
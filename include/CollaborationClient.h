@@ -6,6 +6,7 @@
 #include <QWebSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QString>
 #include <QMap>
 #include <QRandomGenerator> // Add for Qt 6
@@ -36,9 +37,16 @@ public slots:
     void leaveDocument();
     
     void sendEdit(const EditOperation& operation);
-    void sendCursorPosition(int position);
+    void sendCursorPosition(int position, int anchor = -1); // anchor: other end of the selection
     void sendChatMessage(const QString& message);
     void requestLatestContent(const QString& documentId);
+    // Answers contentSyncRequested with this client's copy of the text
+    void sendContentSync(const QString& documentId, const QString& content);
+    // requestId comes back with the reply, so stale pages can be told apart
+    void requestCatalog(const QString& ownerId, const QString& sharedWithUserId,
+                        const QString& titleFilter, int offset, int limit, int requestId = 0);
+    // level is a Document::AccessLevel; None revokes
+    void sendAclUpdate(const QString& targetUserId, int level);
 
 signals:
     void connected();
@@ -49,12 +57,21 @@ signals:
     void documentLeft();
     
     void editReceived(const EditOperation& operation);
-    void cursorPositionReceived(const QString& userId, const QString& username, int position);
+    // The server could not take the rich operation numbered sequence
+    void editRejected(const QString& documentId, int sequence, const QString& reason);
+    // The server's copy of the document diverged and needs this client's text
+    void contentSyncRequested(const QString& documentId);
+    void cursorPositionReceived(const QString& userId, const QString& username, int position, int anchor);
     void chatMessageReceived(const QString& userId, const QString& username, const QString& message);
     
     void userConnected(const QString& userId, const QString& username);
     void userDisconnected(const QString& userId);
     void contentReceived(const QString& content);
+    void catalogReceived(const QJsonArray& entries, int total, int offset, int requestId);
+    void permissionsChanged(const QString& documentId, quint32 permissions);
+    // Whether every client in the document accepts rich operation kinds
+    void documentCapabilitiesChanged(const QString& documentId, bool richOperations);
+    void accessChanged(const QString& userId, int level);
 
 private slots:
     void onConnected();
@@ -64,6 +81,7 @@ private slots:
 
 private:
     void sendMessage(const QString& type, const QJsonObject& payload);
+    void sendHello();
     void handleMessage(const QJsonObject& message);
     
     QWebSocket webSocket;
@@ -6,8 +6,11 @@
 #include <QWebSocket>
 #include <QMap>
 #include <QSet>
+#include <QHash>
 #include <memory>
 #include "Document.h"
+#include "EditOperation.h"
+#include "TextRope.h"
 #include "User.h"
 
 class CollaborationServer : public QObject
@@ -27,18 +30,51 @@ private slots:
     void onTextMessageReceived(const QString &message);
 
 private:
+    void handleHelloMessage(QWebSocket *client, const QJsonObject &payload);
     void handleJoinMessage(QWebSocket *client, const QJsonObject &payload);
     void handleLeaveMessage(QWebSocket *client, const QJsonObject &payload);
     void handleEditMessage(QWebSocket *client, const QJsonObject &payload);
     void handleCursorMessage(QWebSocket *client, const QJsonObject &payload);
     void handleChatMessage(QWebSocket *client, const QJsonObject &payload);
     void handleContentRequest(QWebSocket *client, const QJsonObject &payload);
+    void handleContentSync(QWebSocket *client, const QJsonObject &payload);
+    void handleCatalogQuery(QWebSocket *client, const QJsonObject &payload);
+    void handleAclUpdate(QWebSocket *client, const QJsonObject &payload);
     void broadcastToDocument(const QString &documentId, const QString &message, QWebSocket *exclude = nullptr);
 
+    // Per-connection state. Permission bits are evaluated from the document's
+    // ACL when the client joins and refreshed whenever that ACL changes.
+    struct ClientSession {
+        QString userId;
+        QString documentId;
+        quint32 permissions = 0; // DocumentAcl::Permission bits
+        bool richOperations = false; // Announced at join; otherwise only plain edits
+    };
+
+    // State of a document with connected clients. The text follows every
+    // relayed edit, so rich operations can be expanded for clients that
+    // only take plain ones. Once an edit misses it the text is untrusted:
+    // rich operations are refused until a client sends its copy back.
+    struct LiveDocument {
+        DocumentAcl acl;
+        TextRope text;
+        bool trusted = true;
+        QWebSocket *syncSource = nullptr; // Asked for its copy while untrusted
+        bool editedSinceSyncRequest = false; // By a peer other than syncSource
+    };
+
+    LiveDocument *liveDocument(const QString &documentId);
+    bool applyToLiveText(LiveDocument &live, const EditOperation &operation, QVector<EditOperation> *steps);
+    void requestContentSync(const QString &documentId, LiveDocument &live, QWebSocket *preferred);
+    void detachFromDocument(QWebSocket *client);
+    void refreshPermissions(const QString &documentId);
+    void sendPermissions(QWebSocket *client, const ClientSession &session);
+    void broadcastCapabilities(const QString &documentId);
+
     QWebSocketServer *server;
-    QMap<QWebSocket*, QString> clientUserIds;  // Maps WebSocket clients to user IDs
+    QMap<QWebSocket*, ClientSession> sessions;  // Maps WebSocket clients to their session
     QMap<QString, QSet<QWebSocket*>> documentClients;  // Maps document IDs to connected clients
-    QMap<QString, QString> userSessions;  // Maps user IDs to their current document ID
+    QHash<QString, LiveDocument> liveDocuments;  // Documents with connected clients
 };
 
 #endif // COLLABORATIONSERVER_H 
\ No newline at end of file
@@ -0,0 +1,57 @@
+// CompletionIndex.h
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include "CompletionTrie.h"
+
+class Document;
+
+// Identifier completion across open documents. Each registered document
+// gets a CompletionTrie of its words, built once on the global thread pool
+// and then kept current from every edit: only the words around the edited
+// range are removed and re-added, so an edit costs O(edit size) and lookups
+// never scan the text. Language keywords come from SyntaxHighlighter.
+class CompletionIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CompletionIndex(QObject* parent = nullptr);
+
+    // Starts indexing document; it leaves the index when destroyed
+    void addDocument(const std::shared_ptr<Document>& document);
+
+    // Words starting with prefix, excluding prefix itself: the document's
+    // own words by frequency, then keywords of its language, then words
+    // from the other documents
+    QStringList complete(const QString& prefix, Document* document, int limit) const;
+
+    // Identifiers are letters, digits and '_', not starting with a digit
+    static bool isWordCharacter(QChar c) { return c.isLetterOrNumber() || c == u'_'; }
+
+private:
+    struct Entry {
+        CompletionTrie words;
+        quint64 ticket = 0; // Guards against a document address being reused
+        bool building = true;
+        // Count changes from edits made while the first build runs
+        QHash<QString, int> pendingCounts;
+    };
+
+    void onTextReplaced(Document* document, int position, const QString& removedText,
+                        const QString& insertedText);
+    void onBuilt(Document* document, quint64 ticket, std::shared_ptr<CompletionTrie> words);
+    const CompletionTrie& keywordTrie(const QString& language) const;
+
+    QHash<Document*, std::shared_ptr<Entry>> entries;
+    quint64 nextTicket;
+    mutable QHash<QString, std::shared_ptr<CompletionTrie>> keywords;
+};
+
+#endif // COMPLETIONINDEX_H
@@ -0,0 +1,49 @@
+// CompletionTrie.h
+#ifndef COMPLETIONTRIE_H
+#define COMPLETIONTRIE_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <vector>
+#include <utility>
+
+// Prefix tree of words with occurrence counts. Every node also keeps the
+// largest count below it, so the most frequent completions of a prefix are
+// found best-first: the cost depends on how many are asked for, not on how
+// many words share the prefix. Adding or removing a word is O(length).
+class CompletionTrie {
+public:
+    struct Completion {
+        QString word;
+        int count;
+    };
+
+    CompletionTrie();
+
+    void add(QStringView word, int count = 1);
+    // Counts never drop below zero; words at zero are pruned
+    void remove(QStringView word, int count = 1);
+    void clear();
+    bool isEmpty() const { return nodes[0].best == 0; }
+
+    int count(QStringView word) const;
+    // Up to limit words starting with prefix, most frequent first
+    QVector<Completion> complete(QStringView prefix, int limit) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<char16_t, int>> children; // Sorted by character
+        int count = 0; // Occurrences of the word ending here
+        int best = 0;  // Largest count in this subtree
+    };
+
+    int findChild(int node, char16_t c) const;
+    int createNode();
+    int findNode(QStringView word) const;
+
+    std::vector<Node> nodes; // nodes[0] is the root
+    std::vector<int> freeNodes;
+};
+
+#endif // COMPLETIONTRIE_H
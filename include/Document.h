@@ -2,22 +2,39 @@
 #define DOCUMENT_H
 
 #include <QString>
+#include <QStringList>
 #include <QMap>
 #include <QVector>
 #include <QDateTime>
 #include <memory>
 #include "User.h"
+#include "LineIndex.h"
+#include "TextRope.h"
+#include "DocumentAcl.h"
+#include "AuthorshipMap.h"
+#include "OperationLog.h"
 
 class User;
+struct DocumentSnapshot;
 
 // Version history tracking
 struct DocumentVersion {
-    QString content;
+    TextRope content;         // Shares chunks with the document; loaded on demand once contentChunks is set
+    QStringList contentChunks; // BlobStore references once persisted
     QString userId;
     QDateTime timestamp;
     QString description;
 };
 
+// A single range replacement applied to a document's content
+struct DocumentChange {
+    int position = 0;
+    int removedLength = 0;
+    QString insertedText;
+    quint64 revision = 0; // Document revision after the change
+    QString userId;       // Author of the change, empty if unknown
+};
+
 class Document : public QObject
 {
     Q_OBJECT
@@ -34,15 +51,34 @@ public:
 
     QString getId() const { return documentId; }
     QString getTitle() const { return title; }
-    QString getContent() const { return content; }
+    QString getContent() const { return content.toString(); }
+    int length() const { return content.length(); }
+    QString textAt(int position, int length) const { return content.mid(position, length); }
+    // O(1) copy of the text that other threads can read while editing goes on
+    TextRope textSnapshot() const { return content; }
+    DocumentSnapshot snapshot() const;
+    quint64 getRevision() const { return revision; }
+
+    // Line/column lookups backed by the incremental line index (0-based)
+    int lineCount() const { return lineIndex.lineCount(); }
+    int lineStart(int line) const { return lineIndex.lineStart(line); }
+    void lineColumnAt(int offset, int* line, int* column) const { lineIndex.lineColumnAt(offset, line, column); }
+    int offsetAt(int line, int column) const { return lineIndex.offsetAt(line, column); }
+
     QString getLanguage() const { return language; }
     std::shared_ptr<User> getOwner() const { return owner; }
     QDateTime getLastModified() const { return lastModified; }
-    QMap<QString, AccessLevel> getSharedWith() const { return sharedUsers; }
-    bool isPubliclyAccessible() const { return isPublic; }
+    QMap<QString, AccessLevel> getSharedWith() const;
+    bool isPubliclyAccessible() const { return acl.isPublic(); }
     
     void setTitle(const QString& newTitle);
     void setContent(const QString& newContent);
+
+    // Replaces [position, position + removedLength) with insertedText
+    bool applyEdit(int position, int removedLength, const QString& insertedText,
+                   const QString& userId = QString());
+    // Replaces the whole content as a minimal list of edits, applied in order
+    QVector<DocumentChange> replaceContent(const QString& newContent, const QString& userId = QString());
     void setLanguage(const QString& newLanguage);
     void setPublicAccess(bool isPublic);
     
@@ -57,16 +93,43 @@ public:
     
     bool saveVersion(const QString& description, std::shared_ptr<User> user);
     QVector<DocumentVersion> getVersionHistory() const;
+    // ok is false when the version's chunks cannot be read back
+    QString getVersionContent(int versionIndex, bool* ok = nullptr) const;
     bool restoreVersion(int versionIndex);
 
+    // Per-character authors as runs, updated by every edit
+    const AuthorshipMap& getAuthorship() const { return authorship; }
+    bool restoreAuthorship(const AuthorshipMap& map);
+
+    // Every edit to the document, for seeking and playback
+    const OperationLog& getOperationLog() const { return operationLog; }
+    // Takes over a stored log; it has to end in the current content, and
+    // its last revision becomes the document's
+    bool restoreOperationLog(const OperationLog& log);
+    void setCheckpointChunks(quint64 checkpointRevision, const QStringList& chunkRefs);
+
+    // Used by DocumentStorage to persist and reload history as chunk references
+    void setVersionChunks(int versionIndex, const QStringList& chunkRefs);
+    void restoreVersionHistory(const QVector<DocumentVersion>& history);
+
     // Access control methods
+    const DocumentAcl& getAcl() const { return acl; }
+    void setAcl(const DocumentAcl& newAcl);
+    quint32 permissions(const QString& userId) const { return acl.permissions(userId); }
     AccessLevel getAccessLevel(const QString& userId) const;
     bool shareWith(const QString& userId, AccessLevel level);
     bool revokeAccess(const QString& userId);
     bool canEdit(const QString& userId) const;
     bool canRead(const QString& userId) const;
 
+    static AccessLevel accessLevelForPermissions(quint32 permissions);
+    static DocumentAcl::Role roleForAccessLevel(AccessLevel level);
+
 signals:
+    void contentEdited(const DocumentChange& change);
+    // The same edit with the text it removed; only built when connected
+    void textReplaced(int position, const QString& removedText, const QString& insertedText);
+    // Compatibility signal carrying the full content; only built when connected
     void contentChanged(const QString& newContent);
     void titleChanged(const QString& newTitle);
     void languageChanged(const QString& newLanguage);
@@ -78,17 +141,40 @@ signals:
 private:
     QString documentId;
     QString title;
-    QString content;
+    TextRope content;
     QString language;
     std::shared_ptr<User> owner;
     QDateTime lastModified;
-    QMap<QString, AccessLevel> sharedUsers; // userId -> AccessLevel
-    bool isPublic; // Flag for public read-only access
-    
-    QMap<QString, bool> collaborators; // userId -> canEdit
+    DocumentAcl acl; // Owner, public flag, user and group roles
     QVector<DocumentVersion> versionHistory;
     
+    quint64 revision;
+    LineIndex lineIndex;
+    AuthorshipMap authorship;
+    OperationLog operationLog;
+
     void addToVersionHistory(std::shared_ptr<User> user, const QString& description);
+    void emitContentChanged();
+};
+
+// Immutable view of a document at one revision. The text shares its chunks
+// with the live document, so taking a snapshot is cheap and the copy can be
+// handed to another thread while editing continues.
+struct DocumentSnapshot {
+    QString id;
+    QString title;
+    QString language;
+    QString ownerId;
+    QString ownerName;
+    QDateTime lastModified;
+    DocumentAcl acl;
+    QVector<DocumentVersion> versions;
+    TextRope text;
+    AuthorshipMap authorship;
+    OperationLog operationLog;
+    quint64 revision = 0;
+
+    bool isValid() const { return !id.isEmpty(); }
 };
 
 #endif // DOCUMENT_H
\ No newline at end of file
@@ -0,0 +1,73 @@
+// DocumentAcl.h
+#ifndef DOCUMENTACL_H
+#define DOCUMENTACL_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+
+// Access control for one document: an owner, a public-read flag, per-user
+// roles and group roles. User and group names are interned to ints in a
+// process-wide table, so a permission check is a couple of hash lookups and
+// the result is a set of permission bits that callers can cache.
+class DocumentAcl {
+public:
+    enum Permission : quint32 {
+        NoPermissions = 0,
+        Read = 1u << 0,
+        Edit = 1u << 1,
+        Share = 1u << 2,
+        AllPermissions = Read | Edit | Share
+    };
+
+    enum class Role : quint8 {
+        None = 0,
+        Viewer = 1,
+        Editor = 2,
+        Owner = 3
+    };
+
+    static quint32 permissionsForRole(Role role);
+
+    void setOwner(const QString& userId);
+    QString ownerId() const;
+    bool isOwner(const QString& userId) const;
+
+    void setPublic(bool publicRead) { publicReadable = publicRead; }
+    bool isPublic() const { return publicReadable; }
+
+    // Role::None removes the user's explicit role. The owner can't be changed here.
+    bool setUserRole(const QString& userId, Role role);
+    Role userRole(const QString& userId) const;
+    QMap<QString, Role> userRoles() const; // Explicit roles, owner excluded
+
+    void setGroupRole(const QString& group, Role role);
+    Role groupRole(const QString& group) const;
+    void addGroupMember(const QString& group, const QString& userId);
+    void removeGroupMember(const QString& group, const QString& userId);
+    QStringList groups() const;
+    QStringList groupMembers(const QString& group) const;
+
+    quint32 permissions(const QString& userId) const;
+
+private:
+    struct Group {
+        Role role = Role::None;
+        QSet<int> members;
+    };
+
+    static int intern(const QString& name);
+    static int find(const QString& name); // -1 if never interned
+    static QString nameOf(int id);
+
+    int owner = -1;
+    bool publicReadable = false;
+    QHash<int, Role> users;             // user -> explicit role
+    QHash<int, Group> groupsById;       // group -> role and members
+    QHash<int, QVector<int>> memberOf;  // user -> groups
+};
+
+#endif // DOCUMENTACL_H
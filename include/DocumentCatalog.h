@@ -0,0 +1,81 @@
+// DocumentCatalog.h
+#ifndef DOCUMENTCATALOG_H
+#define DOCUMENTCATALOG_H
+
+#include <QString>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QDateTime>
+#include <QJsonObject>
+#include <QMutex>
+
+// Catalog metadata for one stored document
+struct CatalogEntry {
+    QString id;
+    QString title;
+    QString ownerId;
+    QString ownerName;
+    QString language;
+    bool isPublic = false;
+    QMap<QString, int> sharedWith; // userId -> Document::AccessLevel
+    qint64 size = 0;
+    QDateTime lastModified;
+
+    QJsonObject toJson() const;
+    static CatalogEntry fromJson(const QJsonObject& json);
+};
+
+struct CatalogQuery {
+    QString accessibleTo;     // Owned by, shared with, or public for this user
+    QString ownerId;          // Only documents owned by this user
+    QString sharedWithUserId; // Only documents explicitly shared with this user
+    QString titleFilter;      // Case-insensitive substring of the title
+    int offset = 0;
+    int limit = 50;
+};
+
+// Persistent index of every document in the store. Kept in memory as a hash
+// with owner/shared-user/public secondary indexes, persisted as a snapshot
+// plus an append-only journal that is folded back into the snapshot once
+// it grows large.
+class DocumentCatalog {
+public:
+    explicit DocumentCatalog(const QString& directory);
+
+    // False when neither a snapshot nor a journal exists yet
+    bool load();
+
+    void upsert(const CatalogEntry& entry);
+    void remove(const QString& documentId);
+    void replaceAll(const QVector<CatalogEntry>& newEntries);
+    void compact();
+
+    bool contains(const QString& documentId) const;
+    bool lookup(const QString& documentId, CatalogEntry* entry) const;
+    int size() const;
+
+    // Matching entries, most recently modified first
+    QVector<CatalogEntry> query(const CatalogQuery& query, int* totalMatches = nullptr) const;
+
+private:
+    void indexEntry(const CatalogEntry& entry);
+    void unindexEntry(const QString& documentId);
+    void appendToJournal(const QJsonObject& record);
+    void writeSnapshot();
+    void applyJournalRecord(const QJsonObject& record);
+
+    QString snapshotPath() const { return directory + "/catalog.json"; }
+    QString journalPath() const { return directory + "/catalog.journal"; }
+
+    QString directory;
+    QHash<QString, CatalogEntry> entries;
+    QHash<QString, QSet<QString>> byOwner;      // ownerId -> documentIds
+    QHash<QString, QSet<QString>> bySharedUser; // userId -> documentIds
+    QSet<QString> publicDocuments;
+    int journalRecords;
+    mutable QMutex mutex;
+};
+
+#endif // DOCUMENTCATALOG_H
@@ -5,10 +5,22 @@
 #include <QMap>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QJsonArray>
 #include <QFile>
+#include <QSaveFile>
 #include <QDir>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QDebug>
+#include <functional>
 #include <memory>
 #include "Document.h"
+#include "BlobStore.h"
+#include "DocumentCatalog.h"
 
 class DocumentStorage {
 public:
@@ -18,44 +30,177 @@ public:
     }
 
     bool saveDocument(const std::shared_ptr<Document>& document) {
+        DocumentSnapshot snapshot = document->snapshot();
+        QVector<QStringList> versionChunks;
+        QVector<OperationLog::Checkpoint> checkpoints;
+        if (!saveSnapshot(snapshot, nextSaveTicket(), &versionChunks, &checkpoints)) {
+            return false;
+        }
+        adoptVersionChunks(document, snapshot, versionChunks);
+        adoptCheckpointChunks(document, checkpoints);
+        return true;
+    }
+
+    // Takes a snapshot on the calling thread and writes it on the global
+    // thread pool, so editing continues while the blobs and JSON are written.
+    // onFinished runs on context's thread afterwards.
+    void saveDocumentAsync(const std::shared_ptr<Document>& document, QObject* context,
+                           const std::function<void(bool)>& onFinished = nullptr) {
+        DocumentSnapshot snapshot = document->snapshot();
+        quint64 ticket = nextSaveTicket();
+        std::weak_ptr<Document> weakDocument = document;
+
+        QThreadPool::globalInstance()->start([this, snapshot, ticket, weakDocument, context, onFinished]() {
+            auto versionChunks = std::make_shared<QVector<QStringList>>();
+            auto checkpoints = std::make_shared<QVector<OperationLog::Checkpoint>>();
+            bool saved = saveSnapshot(snapshot, ticket, versionChunks.get(), checkpoints.get());
+
+            QMetaObject::invokeMethod(context, [snapshot, weakDocument, versionChunks, checkpoints, saved, onFinished]() {
+                if (std::shared_ptr<Document> document = weakDocument.lock()) {
+                    adoptVersionChunks(document, snapshot, *versionChunks);
+                    adoptCheckpointChunks(document, *checkpoints);
+                }
+                if (onFinished) {
+                    onFinished(saved);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    // Writes a snapshot to disk. Safe to call from any thread; when saves of
+    // the same document overlap, the one with the newest ticket wins.
+    // checkpoints receives the operation log's checkpoints newly stored as blobs.
+    bool saveSnapshot(const DocumentSnapshot& snapshot, quint64 ticket, QVector<QStringList>* versionChunks,
+                      QVector<OperationLog::Checkpoint>* checkpoints) {
         QJsonObject docObj;
-        docObj["id"] = document->getId();
-        docObj["title"] = document->getTitle();
-        docObj["content"] = document->getContent();
-        docObj["language"] = document->getLanguage();
-        docObj["ownerId"] = document->getOwner()->getUserId();
-        docObj["ownerName"] = document->getOwner()->getUsername();
-        docObj["isPublic"] = document->isPubliclyAccessible();
+        docObj["id"] = snapshot.id;
+        docObj["title"] = snapshot.title;
+        docObj["language"] = snapshot.language;
+        docObj["ownerId"] = snapshot.ownerId;
+        docObj["ownerName"] = snapshot.ownerName;
+        docObj["isPublic"] = snapshot.acl.isPublic();
+        docObj["size"] = snapshot.text.length();
+        docObj["revision"] = qint64(snapshot.revision);
+        docObj["lastModified"] = snapshot.lastModified.toMSecsSinceEpoch();
         
-        // Save access control information
+        // Save access control information; user roles keep the AccessLevel encoding
         QJsonObject accessObj;
-        QMap<QString, Document::AccessLevel> sharedUsers = document->getSharedWith();
-        for (auto it = sharedUsers.begin(); it != sharedUsers.end(); ++it) {
-            accessObj[it.key()] = static_cast<int>(it.value());
+        if (!snapshot.ownerId.isEmpty()) {
+            accessObj[snapshot.ownerId] = static_cast<int>(Document::AccessLevel::Edit);
+        }
+        const QMap<QString, DocumentAcl::Role> roles = snapshot.acl.userRoles();
+        for (auto it = roles.begin(); it != roles.end(); ++it) {
+            accessObj[it.key()] = static_cast<int>(
+                Document::accessLevelForPermissions(DocumentAcl::permissionsForRole(it.value())));
         }
         docObj["access"] = accessObj;
 
-        // Create documents directory if it doesn't exist
-        QDir dir("documents");
-        if (!dir.exists()) {
-            dir.mkpath(".");
+        QJsonObject groupsObj;
+        for (const QString& group : snapshot.acl.groups()) {
+            QJsonObject groupObj;
+            groupObj["role"] = static_cast<int>(snapshot.acl.groupRole(group));
+            groupObj["members"] = QJsonArray::fromStringList(snapshot.acl.groupMembers(group));
+            groupsObj[group] = groupObj;
+        }
+        if (!groupsObj.isEmpty()) {
+            docObj["groups"] = groupsObj;
         }
 
-        // Save to file
-        QFile file("documents/" + document->getId() + ".json");
-        if (file.open(QIODevice::WriteOnly)) {
-            QJsonDocument doc(docObj);
-            file.write(doc.toJson());
-            file.close();
-            return true;
+        // Content and versions are stored as deduplicated chunks in the blob store
+        BlobStore& blobs = BlobStore::getInstance();
+        bool stored = false;
+        QStringList contentChunks = blobs.storeContent(snapshot.text.toString(), &stored);
+        if (!stored) {
+            return false;
+        }
+        docObj["contentChunks"] = QJsonArray::fromStringList(contentChunks);
+        docObj["authorship"] = snapshot.authorship.toJson();
+
+        QJsonArray versionsArray;
+        const QVector<DocumentVersion>& versions = snapshot.versions;
+        versionChunks->resize(versions.size());
+        for (int i = 0; i < versions.size(); ++i) {
+            QStringList chunks = versions[i].contentChunks;
+            if (chunks.isEmpty() && !versions[i].content.isEmpty()) {
+                chunks = blobs.storeContent(versions[i].content.toString(), &stored);
+                if (!stored) {
+                    return false;
+                }
+            }
+            (*versionChunks)[i] = chunks;
+
+            QJsonObject versionObj;
+            versionObj["chunks"] = QJsonArray::fromStringList(chunks);
+            versionObj["userId"] = versions[i].userId;
+            versionObj["timestamp"] = versions[i].timestamp.toString(Qt::ISODateWithMs);
+            versionObj["description"] = versions[i].description;
+            versionsArray.append(versionObj);
+        }
+        docObj["versions"] = versionsArray;
+
+        // The log's checkpoints are blobs too, each written once; its entries
+        // go to the journal below
+        QJsonArray checkpointsArray;
+        for (const OperationLog::Checkpoint& checkpoint : snapshot.operationLog.checkpointList()) {
+            QStringList chunks = checkpoint.chunks;
+            if (chunks.isEmpty() && !checkpoint.text.isEmpty()) {
+                chunks = blobs.storeContent(checkpoint.text.toString(), &stored);
+                if (!stored) {
+                    return false;
+                }
+                checkpoints->append(OperationLog::Checkpoint{checkpoint.revision, TextRope(), chunks});
+            }
+
+            QJsonObject checkpointObj;
+            checkpointObj["revision"] = qint64(checkpoint.revision);
+            checkpointObj["chunks"] = QJsonArray::fromStringList(chunks);
+            checkpointsArray.append(checkpointObj);
+        }
+        QJsonObject logObj;
+        logObj["checkpoints"] = checkpointsArray;
+        docObj["operationLog"] = logObj;
+        QByteArray json = QJsonDocument(docObj).toJson();
+
+        QMutexLocker locker(&saveMutex);
+        if (ticket < writtenTickets.value(snapshot.id)) {
+            return true; // A newer snapshot is already on disk
+        }
+
+        // Create the shard directory if it doesn't exist
+        QString path = documentPath(snapshot.id);
+        QDir().mkpath(QFileInfo(path).path());
+
+        // The journal goes first: entries past the revision in the file are ignored
+        if (!writeJournal(snapshot.id, snapshot.operationLog)) {
+            return false;
         }
-        return false;
+
+        // QSaveFile renames into place, so a failed write leaves the old file intact
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        if (file.write(json) != json.size() || !file.commit()) {
+            qDebug() << "Failed to write document" << snapshot.id << ":" << file.errorString();
+            return false;
+        }
+        writtenTickets[snapshot.id] = ticket;
+
+        // A flat copy left over from the old layout is now stale
+        QFile::remove(legacyDocumentPath(snapshot.id));
+
+        catalog.upsert(catalogEntryFromJson(docObj));
+        return true;
     }
 
     std::shared_ptr<Document> loadDocument(const QString& documentId) {
-        QFile file("documents/" + documentId + ".json");
+        QFile file(documentPath(documentId));
         if (!file.exists()) {
-            return nullptr;
+            // Not migrated yet from the flat layout
+            file.setFileName(legacyDocumentPath(documentId));
+            if (!file.exists()) {
+                return nullptr;
+            }
         }
 
         if (file.open(QIODevice::ReadOnly)) {
@@ -79,10 +224,50 @@ public:
                     owner
                 );
 
-                // Set content and language
-                document->setContent(obj["content"].toString());
+                // Set content and language (older files keep the raw content inline)
+                if (obj.contains("contentChunks")) {
+                    bool loaded = false;
+                    QString content = BlobStore::getInstance().loadContent(
+                        toStringList(obj["contentChunks"].toArray()), &loaded);
+                    if (!loaded) {
+                        return nullptr;
+                    }
+                    document->setContent(content);
+                } else {
+                    document->setContent(obj["content"].toString());
+                }
                 document->setLanguage(obj["language"].toString());
 
+                // Authorship is dropped if it no longer matches the content
+                AuthorshipMap authorship;
+                if (authorship.fromJson(obj["authorship"].toObject(), document->length())) {
+                    document->restoreAuthorship(authorship);
+                }
+
+                // The edit history carries on from the stored log. Without one
+                // it starts at the loaded text, still at the stored revision.
+                OperationLog log;
+                const quint64 revision = quint64(obj["revision"].toInteger());
+                if (revision == 0 || !loadOperationLog(documentId, obj["operationLog"].toObject(), revision, &log)
+                        || !document->restoreOperationLog(log)) {
+                    log.reset(document->textSnapshot(), qMax<quint64>(revision, document->getRevision()));
+                    document->restoreOperationLog(log);
+                }
+
+                // Version contents stay in the blob store until a version is opened
+                QVector<DocumentVersion> history;
+                QJsonArray versionsArray = obj["versions"].toArray();
+                for (const QJsonValue& value : versionsArray) {
+                    QJsonObject versionObj = value.toObject();
+                    DocumentVersion version;
+                    version.contentChunks = toStringList(versionObj["chunks"].toArray());
+                    version.userId = versionObj["userId"].toString();
+                    version.timestamp = QDateTime::fromString(versionObj["timestamp"].toString(), Qt::ISODateWithMs);
+                    version.description = versionObj["description"].toString();
+                    history.append(version);
+                }
+                document->restoreVersionHistory(history);
+
                 // Set public access flag
                 if (obj.contains("isPublic")) {
                     document->setPublicAccess(obj["isPublic"].toBool());
@@ -95,6 +280,19 @@ public:
                         static_cast<Document::AccessLevel>(it.value().toInt()));
                 }
 
+                QJsonObject groupsObj = obj["groups"].toObject();
+                if (!groupsObj.isEmpty()) {
+                    DocumentAcl acl = document->getAcl();
+                    for (auto it = groupsObj.begin(); it != groupsObj.end(); ++it) {
+                        QJsonObject groupObj = it.value().toObject();
+                        acl.setGroupRole(it.key(), static_cast<DocumentAcl::Role>(groupObj["role"].toInt()));
+                        for (const QJsonValue& member : groupObj["members"].toArray()) {
+                            acl.addGroupMember(it.key(), member.toString());
+                        }
+                    }
+                    document->setAcl(acl);
+                }
+
                 return document;
             }
         }
@@ -102,14 +300,303 @@ public:
     }
 
     bool documentExists(const QString& documentId) {
-        return QFile::exists("documents/" + documentId + ".json");
+        return catalog.contains(documentId) || QFile::exists(documentPath(documentId));
+    }
+
+    // Documents live in documents/<aa>/<bb>/<id>.json where aabb are the first
+    // bytes of the MD5 of the id, so no directory grows past a few entries
+    static QString documentPath(const QString& documentId) {
+        QString hash = QString::fromLatin1(
+            QCryptographicHash::hash(documentId.toUtf8(), QCryptographicHash::Md5).toHex());
+        return "documents/" + hash.left(2) + "/" + hash.mid(2, 2) + "/" + documentId + ".json";
+    }
+
+    static QString legacyDocumentPath(const QString& documentId) {
+        return "documents/" + documentId + ".json";
+    }
+
+    // Moves documents from the old flat documents/*.json layout into shards.
+    // Returns the number of documents moved, or -1 if any move failed.
+    int migrateFlatLayout() {
+        QDir dir("documents");
+        const QStringList files = dir.entryList(QStringList() << "*.json", QDir::Files);
+
+        int migrated = 0;
+        bool failed = false;
+        for (const QString& fileName : files) {
+            QString documentId = fileName.chopped(5);
+            QString target = documentPath(documentId);
+            QDir().mkpath(QFileInfo(target).path());
+
+            if (QFile::exists(target)) {
+                // Already saved in the new layout, the flat copy is stale
+                QFile::remove(dir.filePath(fileName));
+                continue;
+            }
+            if (QFile::rename(dir.filePath(fileName), target)) {
+                ++migrated;
+            } else {
+                qDebug() << "Failed to migrate document" << documentId;
+                failed = true;
+            }
+        }
+
+        qDebug() << "Migrated" << migrated << "documents to the sharded layout";
+        return failed ? -1 : migrated;
+    }
+
+    bool findCatalogEntry(const QString& documentId, CatalogEntry* entry) {
+        return catalog.lookup(documentId, entry);
+    }
+
+    QVector<CatalogEntry> queryCatalog(const CatalogQuery& query, int* totalMatches = nullptr) {
+        return catalog.query(query, totalMatches);
     }
 
 private:
-    DocumentStorage() {} // Private constructor for singleton
+    quint64 nextSaveTicket() {
+        QMutexLocker locker(&saveMutex);
+        return ++saveTicketCounter;
+    }
+
+    // Entries of the operation log, one JSON object per line, next to the document
+    static QString journalPath(const QString& documentId) {
+        return documentPath(documentId).chopped(5) + ".oplog";
+    }
+
+    // What this process last wrote to or read from a journal
+    struct JournalState {
+        quint64 firstRevision = 0; // State before the first entry
+        quint64 lastRevision = 0;
+        qint64 size = -1;          // Another writer shows as a different size
+    };
+
+    static QByteArray journalLine(quint64 revision, const OperationLog::Entry& entry) {
+        QJsonObject line;
+        line["revision"] = qint64(revision);
+        line["position"] = entry.position;
+        line["removedLength"] = entry.removedLength;
+        line["insertedText"] = entry.insertedText;
+        line["userId"] = entry.userId;
+        line["timestamp"] = entry.timestamp.toMSecsSinceEpoch();
+        return QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+    // Appends the entries past the journal's end. The file is written anew
+    // when the log no longer continues it, or once compaction has left it
+    // holding more than twice what the log keeps. Called under saveMutex.
+    bool writeJournal(const QString& documentId, const OperationLog& log) {
+        const QString path = journalPath(documentId);
+        const JournalState state = journals.value(documentId);
+        const bool continues = state.size >= 0 && QFileInfo(path).size() == state.size
+            && state.firstRevision <= log.firstRevision() && log.firstRevision() <= state.lastRevision
+            && state.lastRevision <= log.lastRevision()
+            && log.firstRevision() - state.firstRevision <= quint64(log.entryCount());
+
+        QByteArray lines;
+        for (quint64 r = (continues ? state.lastRevision : log.firstRevision()) + 1; r <= log.lastRevision(); ++r) {
+            lines += journalLine(r, log.entryFor(r));
+        }
+
+        JournalState written;
+        written.lastRevision = log.lastRevision();
+        if (continues) {
+            if (lines.isEmpty()) {
+                return true;
+            }
+            QFile file(path);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || file.write(lines) != lines.size()) {
+                qDebug() << "Failed to append to the journal of document" << documentId << ":" << file.errorString();
+                journals.remove(documentId); // Rewritten by the next save
+                return false;
+            }
+            written.firstRevision = state.firstRevision;
+            written.size = state.size + lines.size();
+        } else {
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly) || file.write(lines) != lines.size() || !file.commit()) {
+                qDebug() << "Failed to write the journal of document" << documentId << ":" << file.errorString();
+                return false;
+            }
+            written.firstRevision = log.firstRevision();
+            written.size = lines.size();
+        }
+        journals[documentId] = written;
+        return true;
+    }
+
+    // Rebuilds the log ending at revision from its checkpoint references and
+    // the journal; checkpoint texts stay in the blob store until a seek
+    bool loadOperationLog(const QString& documentId, const QJsonObject& logObj, quint64 revision, OperationLog* log) {
+        QVector<OperationLog::Checkpoint> checkpoints;
+        for (const QJsonValue& value : logObj["checkpoints"].toArray()) {
+            QJsonObject checkpointObj = value.toObject();
+            checkpoints.append(OperationLog::Checkpoint{quint64(checkpointObj["revision"].toInteger()), TextRope(),
+                                                        toStringList(checkpointObj["chunks"].toArray())});
+        }
+        if (checkpoints.isEmpty() || checkpoints.first().revision > revision) {
+            return false;
+        }
+
+        QFile file(journalPath(documentId));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return checkpoints.first().revision == revision && log->restore(checkpoints, {});
+        }
+
+        // Entries from the first checkpoint on; a torn last line is skipped
+        const quint64 first = checkpoints.first().revision;
+        QVector<OperationLog::Entry> entries;
+        JournalState state;
+        bool started = false;
+        bool clean = true;
+        while (!file.atEnd()) {
+            const QJsonObject line = QJsonDocument::fromJson(file.readLine()).object();
+            if (line.isEmpty()) {
+                clean = false;
+                continue;
+            }
+            const quint64 lineRevision = quint64(line["revision"].toInteger());
+            if (!started) {
+                state.firstRevision = lineRevision - 1;
+                started = true;
+            }
+            state.lastRevision = lineRevision;
+            if (lineRevision != first + quint64(entries.size()) + 1 || lineRevision > revision) {
+                continue;
+            }
+            entries.append(OperationLog::Entry{line["position"].toInt(), line["removedLength"].toInt(),
+                                               line["insertedText"].toString(), line["userId"].toString(),
+                                               QDateTime::fromMSecsSinceEpoch(line["timestamp"].toInteger())});
+        }
+        state.size = file.size();
+        file.close();
+
+        if (first + quint64(entries.size()) != revision || !log->restore(checkpoints, entries)) {
+            return false;
+        }
+
+        // Appends carry on from here unless the file ran past the stored
+        // revision or ends in a torn line
+        if (started && clean && state.lastRevision == revision) {
+            QMutexLocker locker(&saveMutex);
+            journals[documentId] = state;
+        }
+        return true;
+    }
+
+    static void adoptCheckpointChunks(const std::shared_ptr<Document>& document,
+                                      const QVector<OperationLog::Checkpoint>& checkpoints) {
+        for (const OperationLog::Checkpoint& checkpoint : checkpoints) {
+            document->setCheckpointChunks(checkpoint.revision, checkpoint.chunks);
+        }
+    }
+
+    // Versions written as blobs can drop their in-memory text
+    static void adoptVersionChunks(const std::shared_ptr<Document>& document, const DocumentSnapshot& snapshot,
+                                   const QVector<QStringList>& versionChunks) {
+        QVector<DocumentVersion> versions = document->getVersionHistory();
+        for (int i = 0; i < versionChunks.size() && i < versions.size(); ++i) {
+            const DocumentVersion& saved = snapshot.versions[i];
+            if (saved.contentChunks.isEmpty() && !versionChunks[i].isEmpty()
+                    && versions[i].contentChunks.isEmpty() && versions[i].timestamp == saved.timestamp) {
+                document->setVersionChunks(i, versionChunks[i]);
+            }
+        }
+    }
+
+    static QStringList toStringList(const QJsonArray& array) {
+        QStringList result;
+        result.reserve(array.size());
+        for (const QJsonValue& value : array) {
+            result.append(value.toString());
+        }
+        return result;
+    }
+
+    static CatalogEntry catalogEntryFromJson(const QJsonObject& obj) {
+        CatalogEntry entry;
+        entry.id = obj["id"].toString();
+        entry.title = obj["title"].toString();
+        entry.ownerId = obj["ownerId"].toString();
+        entry.ownerName = obj["ownerName"].toString();
+        entry.language = obj["language"].toString();
+        entry.isPublic = obj["isPublic"].toBool();
+        entry.size = obj.contains("size") ? obj["size"].toInteger() : obj["content"].toString().length();
+        entry.lastModified = QDateTime::fromMSecsSinceEpoch(obj["lastModified"].toInteger());
+
+        QJsonObject accessObj = obj["access"].toObject();
+        for (auto it = accessObj.begin(); it != accessObj.end(); ++it) {
+            if (it.key() != entry.ownerId) {
+                entry.sharedWith[it.key()] = it.value().toInt();
+            }
+        }
+
+        // Group members see the document as shared with them at the group's level
+        QJsonObject groupsObj = obj["groups"].toObject();
+        for (auto it = groupsObj.begin(); it != groupsObj.end(); ++it) {
+            QJsonObject groupObj = it.value().toObject();
+            int level = static_cast<int>(Document::accessLevelForPermissions(
+                DocumentAcl::permissionsForRole(static_cast<DocumentAcl::Role>(groupObj["role"].toInt()))));
+            if (level == static_cast<int>(Document::AccessLevel::None)) {
+                continue;
+            }
+            for (const QJsonValue& member : groupObj["members"].toArray()) {
+                QString memberId = member.toString();
+                if (memberId != entry.ownerId && entry.sharedWith.value(memberId) < level) {
+                    entry.sharedWith[memberId] = level;
+                }
+            }
+        }
+        return entry;
+    }
+
+    // One-time scan of an existing documents/ tree that predates the catalog
+    void rebuildCatalog() {
+        qDebug() << "Building document catalog from existing documents";
+        QVector<CatalogEntry> entries;
+        QDirIterator it("documents", QStringList() << "*.json", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QString path = it.next();
+            if (path.contains("/.catalog/")) {
+                continue;
+            }
+
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+            file.close();
+
+            if (doc.isObject()) {
+                CatalogEntry entry = catalogEntryFromJson(doc.object());
+                if (!entry.lastModified.isValid() || entry.lastModified.toMSecsSinceEpoch() == 0) {
+                    entry.lastModified = QFileInfo(path).lastModified();
+                }
+                entries.append(entry);
+            }
+        }
+        catalog.replaceAll(entries);
+    }
+
+    // Private constructor for singleton
+    DocumentStorage()
+        : catalog("documents/.catalog")
+    {
+        if (!catalog.load()) {
+            rebuildCatalog();
+        }
+    }
     ~DocumentStorage() {}
     DocumentStorage(const DocumentStorage&) = delete;
     DocumentStorage& operator=(const DocumentStorage&) = delete;
+
+    DocumentCatalog catalog;
+
+    QMutex saveMutex; // Guards the tickets and ordered document writes
+    quint64 saveTicketCounter = 0;
+    QHash<QString, quint64> writtenTickets; // documentId -> ticket of the file on disk
+    QHash<QString, JournalState> journals;  // documentId -> journal as last written or read
 };
 
 #endif // DOCUMENTSTORAGE_H 
\ No newline at end of file
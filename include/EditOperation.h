@@ -3,17 +3,46 @@
 #define EDIT_OPERATION_H
 
 #include <QString>
+#include <QVector>
 #include <QJsonObject>
+#include <functional>
 
 struct EditOperation {
+    // Replace is the plain range replacement every peer understands. The
+    // other kinds describe bulk edits in a few fields and are sent only when
+    // every peer in the document supports them; expand() turns them into
+    // Replace steps for everyone else.
+    enum class Kind {
+        Replace,    // [position, position + deletionLength) becomes insertion
+        MoveRange,  // [position, position + deletionLength) moves to targetPosition
+        Indent,     // Lines in [position, position + deletionLength) get insertion prepended
+        Outdent,    // Those lines lose up to one insertion's worth of leading whitespace
+        ReplaceAll  // Each deletionLength match at positions becomes insertion,
+                    // or lengths[i] and replacements[i] when those are set
+    };
+
     QString userId;
     QString documentId;
-    int position;
+    int position = 0;
     QString insertion;
-    int deletionLength;
+    int deletionLength = 0;
+    Kind kind = Kind::Replace;
+    int targetPosition = 0;  // MoveRange, in the text before the move
+    QVector<int> positions;  // ReplaceAll, ascending, in the text before the edit
+    QVector<int> lengths;    // ReplaceAll, per match when they differ
+    QVector<QString> replacements; // ReplaceAll, per match when they differ
+    int sequence = 0;        // Sender's number for a rich operation, echoed if it is rejected
+
+    // Reads the text the operation applies to
+    using TextReader = std::function<QString(int position, int length)>;
+
+    bool isRich() const { return kind != Kind::Replace; }
+    // Replace steps with the same effect, to apply in order; empty if the
+    // operation does not fit a text of textLength characters
+    QVector<EditOperation> expand(const TextReader& textAt, int textLength) const;
 
     QJsonObject toJson() const;
     static EditOperation fromJson(const QJsonObject& json);
 };
 
-#endif // EDIT_OPERATION_H
\ No newline at end of file
+#endif // EDIT_OPERATION_H
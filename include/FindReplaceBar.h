@@ -0,0 +1,49 @@
+// FindReplaceBar.h
+#ifndef FINDREPLACEBAR_H
+#define FINDREPLACEBAR_H
+
+#include <QWidget>
+
+class CodeEditorWidget;
+class QLineEdit;
+class QCheckBox;
+class QLabel;
+class QKeyEvent;
+
+// Find and replace controls shown under the editor. Typing in the find
+// field searches as you type; the editor keeps the matches current while
+// the document is edited, and the bar only shows their count.
+class FindReplaceBar : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit FindReplaceBar(CodeEditorWidget* editor, QWidget* parent = nullptr);
+
+public slots:
+    // Shows the bar with the editor's selection as the search text
+    void activate();
+    void dismiss();
+
+protected:
+    void keyPressEvent(QKeyEvent* event) override;
+
+private slots:
+    void onQueryChanged();
+    void onMatchesChanged(int count);
+    void onFindNext();
+    void onFindPrevious();
+    void onReplace();
+    void onReplaceAll();
+
+private:
+    CodeEditorWidget* editor;
+    QLineEdit* findEdit;
+    QLineEdit* replaceEdit;
+    QCheckBox* caseBox;
+    QCheckBox* wordsBox;
+    QCheckBox* regexBox;
+    QLabel* countLabel;
+};
+
+#endif // FINDREPLACEBAR_H
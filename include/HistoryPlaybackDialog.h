@@ -0,0 +1,48 @@
+// HistoryPlaybackDialog.h
+#ifndef HISTORYPLAYBACKDIALOG_H
+#define HISTORYPLAYBACKDIALOG_H
+
+#include <QDialog>
+#include "OperationLog.h"
+
+class QPlainTextEdit;
+class QSlider;
+class QPushButton;
+class QComboBox;
+class QLabel;
+class QTimer;
+
+// Scrubs through a document's operation log. The slider seeks through the
+// log's checkpoints; playback and small forward moves apply the logged
+// edits to the view one by one instead of reloading the text.
+class HistoryPlaybackDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    // The log is copied, so the dialog shows history up to when it opened
+    HistoryPlaybackDialog(const OperationLog& operationLog, const QString& title, QWidget* parent = nullptr);
+
+private slots:
+    void onSliderMoved(int value);
+    void onPlayToggled();
+    void onPlaybackTick();
+
+private:
+    void seekTo(quint64 revision);
+    void stepForward(quint64 revision);
+    void updateInfo();
+    int sliderValue(quint64 revision) const;
+
+    OperationLog log;
+    quint64 shownRevision;
+
+    QPlainTextEdit* view;
+    QSlider* slider;
+    QPushButton* playButton;
+    QComboBox* speedBox;
+    QLabel* infoLabel;
+    QTimer* playTimer;
+};
+
+#endif // HISTORYPLAYBACKDIALOG_H
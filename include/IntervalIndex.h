@@ -0,0 +1,38 @@
+// IntervalIndex.h
+#ifndef INTERVALINDEX_H
+#define INTERVALINDEX_H
+
+#include <QVector>
+
+// Static interval tree over half-open ranges, each carrying an int value.
+// Intervals are sorted by start and viewed as an implicit balanced tree
+// over that array, with every node holding the largest end in its subtree,
+// so a stabbing query visits O(log n + k) nodes. Changes are batched:
+// insert what is needed, then build() before querying.
+class IntervalIndex {
+public:
+    void clear();
+    void insert(int start, int end, int value);
+    void build();
+
+    bool isEmpty() const { return intervals.isEmpty(); }
+    int size() const { return intervals.size(); }
+
+    // Values of the intervals overlapping [start, end), in start order
+    QVector<int> overlapping(int start, int end) const;
+
+private:
+    struct Interval {
+        int start;
+        int end;
+        int value;
+    };
+
+    int buildMaxEnd(int low, int high);
+    void collect(int low, int high, int start, int end, QVector<int>* out) const;
+
+    QVector<Interval> intervals;
+    QVector<int> maxEnd; // Per implicit node: the largest end in [low, high)
+};
+
+#endif // INTERVALINDEX_H
@@ -0,0 +1,57 @@
+// LineIndex.h
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QString>
+#include <QtGlobal>
+#include <vector>
+
+// Line-start index over a text buffer. Line lengths (including the '\n')
+// are kept in an implicit treap with subtree sums, so an edit costs
+// O(log n + k) for k inserted line breaks and offset <-> (line, column)
+// lookups cost O(log n). Lines and columns are 0-based UTF-16 units.
+class LineIndex {
+public:
+    LineIndex();
+
+    void reset(const QString& text);
+    void applyEdit(int position, int removedLength, const QString& insertedText);
+
+    int lineCount() const;
+    int textLength() const;
+
+    int lineAt(int offset) const;
+    int lineStart(int line) const;
+    int lineLength(int line) const; // Without the line break
+
+    void lineColumnAt(int offset, int* line, int* column) const;
+    int offsetAt(int line, int column) const;
+
+private:
+    struct Node {
+        int left;
+        int right;
+        quint32 priority;
+        int length; // Line length including its '\n'
+        int count;  // Lines in this subtree
+        int sum;    // Characters in this subtree
+    };
+
+    int createNode(int length);
+    void releaseTree(int node);
+    void update(int node);
+    void split(int node, int lines, int* left, int* right);
+    int merge(int left, int right);
+    int buildFromLengths(const std::vector<int>& lengths);
+    int findLine(int offset, int* lineStartOffset) const;
+    int lineLengthWithBreak(int line, int* lineStartOffset) const;
+    int count(int node) const { return node < 0 ? 0 : nodes[node].count; }
+    int sum(int node) const { return node < 0 ? 0 : nodes[node].sum; }
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root;
+    quint32 seed;
+};
+
+#endif // LINEINDEX_H
@@ -15,6 +15,10 @@
 #include "CollaborationClient.h"
 
 class CodeEditorWidget;
+class MinimapWidget;
+class FindReplaceBar;
+class OutlinePanel;
+class CompletionIndex;
 class LoginDialog;
 class QTextEdit;
 class QSplitter;
@@ -22,6 +26,7 @@ class QPlainTextEdit;
 class QLineEdit;
 class QListWidget;
 class QAction;
+class QTimer;
 
 namespace Ui {
     class MainWindow;
@@ -46,7 +51,9 @@ private slots:
     void onOpenSharedDocument();
     void onSaveDocument();
     void onShareDocument();
-    void onTextChanged();
+    void onShowHistory();
+    void onLocalEdit(const EditOperation& operation);
+    void saveCurrentDocument();
     void onCursorPositionChanged();
     void onSendChatMessage();
     void onUserConnected(const QString& userId, const QString& username);
@@ -71,6 +78,7 @@ private:
     void updateUserList();
     void removeDocument(const QString& documentId);
     void updateDocumentAccess(const QString& documentId, const QString& userId, Document::AccessLevel level);
+    QString chooseDocumentFromCatalog();
     bool eventFilter(QObject *obj, QEvent *event) override;
 
     Ui::MainWindow *ui;
@@ -84,10 +92,18 @@ private:
     std::unique_ptr<QLineEdit> chatInputLine;
     std::unique_ptr<QListWidget> userList;
     std::unique_ptr<QAction> publicAccessAction;
+    std::unique_ptr<QTimer> saveTimer;
+    MinimapWidget* minimap = nullptr; // Owned by mainSplitter
+    FindReplaceBar* findBar = nullptr; // Owned by the editor panel
+    OutlinePanel* outlinePanel = nullptr; // Owned by rightSplitter
+    CompletionIndex* completionIndex = nullptr; // Words of the open documents
 
     // Core objects
     std::shared_ptr<User> currentUser;
     std::shared_ptr<Document> currentDocument;
+    std::shared_ptr<Document> pendingSaveDocument; // Edited, waiting for saveTimer
+    std::weak_ptr<Document> openedFileDocument;    // Document last loaded from openedFilePath
+    QString openedFilePath;
     std::shared_ptr<CollaborationManager> collaborationManager;
     std::unique_ptr<CollaborationClient> collaborationClient;
 
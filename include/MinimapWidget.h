@@ -0,0 +1,72 @@
+// MinimapWidget.h
+#ifndef MINIMAPWIDGET_H
+#define MINIMAPWIDGET_H
+
+#include <QWidget>
+#include <QImage>
+#include <QVector>
+#include <QColor>
+
+class CodeEditorWidget;
+class QTimer;
+
+// Overview strip for a CodeEditorWidget: the whole document scaled to the
+// widget height, with the viewport, remote cursors and recent remote edits
+// drawn on top. The text is drawn into fixed-height tiles that are cached
+// and redrawn only for lines an edit touched. Lines are mapped to rows by
+// a power-of-two scale, so it changes only when the line count doubles or
+// halves; an edit that adds or removes lines leaves the tiles below it
+// slightly out of place until a short idle timer redraws them.
+class MinimapWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MinimapWidget(CodeEditorWidget* editor, QWidget* parent = nullptr);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void onDocumentModelChanged();
+    void onRemoteEditApplied(const QString& userId, int position, int length);
+    void refreshStaleTiles();
+    void expireRecentEdits();
+
+private:
+    // A range a peer edited lately, held by editor anchors so it follows edits
+    struct RecentEdit {
+        QString userId;
+        int startAnchor;
+        int endAnchor;
+        QColor color;
+        qint64 time;
+    };
+
+    void resetTiles();
+    void clearRecentEdits();
+    bool updateScale();
+    int lineToY(int line) const;
+    int yToLine(int y) const;
+    void invalidateLines(int firstLine, int lastLine);
+    QImage renderTile(int tile) const;
+    void scrollEditorTo(int y);
+
+    CodeEditorWidget* editor;
+    int scaleShift; // Lines per row are 1 << scaleShift; -1 gives two rows per line
+    int lastBlockCount;
+    QVector<QImage> tiles;    // Null until painted or after an edit
+    QVector<bool> staleTiles; // Shown as they are until refreshTimer fires
+    QTimer* refreshTimer;
+
+    QVector<RecentEdit> recentEdits;
+    QTimer* expireTimer;
+};
+
+#endif // MINIMAPWIDGET_H
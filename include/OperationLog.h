@@ -0,0 +1,70 @@
+// OperationLog.h
+#ifndef OPERATIONLOG_H
+#define OPERATIONLOG_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QDateTime>
+#include "TextRope.h"
+
+// Every edit applied to a document, with a text checkpoint every
+// checkpointInterval edits. Checkpoints share chunks with the live text,
+// so they cost little more than the chunks later edits replace. Seeking to
+// a revision starts from the nearest checkpoint and replays at most
+// checkpointInterval edits, whatever the log's length.
+// Once more than maxEntries edits are kept, the oldest are dropped along
+// with their checkpoints, so the log starts at a later checkpoint.
+// DocumentStorage keeps the log with the document: checkpoints as BlobStore
+// chunks and the entries in an append-only journal.
+class OperationLog {
+public:
+    struct Entry {
+        int position;
+        int removedLength;
+        QString insertedText;
+        QString userId;
+        QDateTime timestamp;
+    };
+
+    // A text to replay from. chunks is set once the text is in the BlobStore;
+    // a checkpoint read back from storage has only those, and its text is
+    // loaded when a seek needs it.
+    struct Checkpoint {
+        quint64 revision;
+        TextRope text;
+        QStringList chunks;
+    };
+
+    explicit OperationLog(int checkpointInterval = 256, int maxEntries = 65536);
+
+    // Starts a new log whose first state is text at revision
+    void reset(const TextRope& text, quint64 revision);
+    // Records the edit that produced revision; textAfter is the resulting text
+    bool append(quint64 revision, const Entry& entry, const TextRope& textAfter);
+
+    quint64 firstRevision() const { return baseRevision; }
+    quint64 lastRevision() const { return baseRevision + quint64(entries.size()); }
+    int entryCount() const { return entries.size(); }
+
+    // The edit that turned revision - 1 into revision
+    const Entry& entryFor(quint64 revision) const;
+    bool textAt(quint64 revision, TextRope* text) const;
+
+    // Used by DocumentStorage to persist and reload the log
+    const QVector<Checkpoint>& checkpointList() const { return checkpoints; }
+    void setCheckpointChunks(quint64 revision, const QStringList& chunkRefs);
+    // Checkpoints ascend from the first state; entries follow it in order
+    bool restore(const QVector<Checkpoint>& storedCheckpoints, const QVector<Entry>& storedEntries);
+
+private:
+    void compact();
+
+    int checkpointInterval;
+    int maxEntries;
+    quint64 baseRevision;
+    QVector<Entry> entries;          // entries[i] produced baseRevision + i + 1
+    QVector<Checkpoint> checkpoints; // Ascending; the first is the base state
+};
+
+#endif // OPERATIONLOG_H
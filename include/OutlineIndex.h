@@ -0,0 +1,79 @@
+// OutlineIndex.h
+#ifndef OUTLINEINDEX_H
+#define OUTLINEINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class Document;
+class QTimer;
+
+// The classes, functions and methods of a C++, Python, JavaScript or Java
+// document, found line by line by a lightweight pattern parser. Parsing
+// runs on the global thread pool over an O(1) snapshot of the text, and an
+// edit only queues the lines it touched; symbols elsewhere are shifted by
+// the line count change. Edits made while a parse runs are replayed onto
+// its result, so typing never waits for it or throws it away. Nesting is
+// taken from indentation, which all four languages follow by convention.
+class OutlineIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Symbol {
+        enum Kind { Namespace, Class, Function };
+        Kind kind;
+        QString name;
+        int line;   // 0-based
+        int indent; // Leading whitespace in columns, tabs counting 4
+    };
+
+    explicit OutlineIndex(QObject* parent = nullptr);
+
+    void setDocument(std::shared_ptr<Document> document);
+    // [position, position + charsRemoved) of the document became charsAdded
+    // characters; the document must already hold the new text
+    void applyEdit(int position, int charsRemoved, int charsAdded);
+
+    // Ascending by line; indices stay valid until symbolsChanged()
+    const QVector<Symbol>& symbols() const { return current; }
+
+    // Symbols in text, whose first line is firstLine. Thread-safe.
+    static QVector<Symbol> parse(const QString& text, int firstLine, const QString& language);
+
+signals:
+    void symbolsChanged();
+
+private slots:
+    void reparseAll();
+    void startParse();
+
+private:
+    // Lines [firstLine, oldLastLine] became [firstLine, newLastLine]
+    struct LineEdit {
+        int firstLine;
+        int oldLastLine;
+        int newLastLine;
+    };
+
+    static int mapLine(int line, const LineEdit& edit);
+    void onParsed(QVector<Symbol> symbols, int firstLine, int lastLine, quint64 ticket);
+
+    std::shared_ptr<Document> document;
+    QVector<Symbol> current;
+    int lineCount;
+
+    // Lines waiting to be parsed, or -1
+    int dirtyFirst;
+    int dirtyLast;
+
+    // Edits since the running parse took its snapshot
+    bool parsing;
+    QVector<LineEdit> editsDuringParse;
+    quint64 generation; // Bumped per document, so late results are dropped
+    QTimer* parseTimer;
+};
+
+#endif // OUTLINEINDEX_H
@@ -0,0 +1,28 @@
+// OutlinePanel.h
+#ifndef OUTLINEPANEL_H
+#define OUTLINEPANEL_H
+
+#include <QTreeWidget>
+
+class CodeEditorWidget;
+class OutlineIndex;
+
+// Tree of the symbols in the editor's document, nested by indentation.
+// Activating a symbol moves the editor's caret to its line.
+class OutlinePanel : public QTreeWidget
+{
+    Q_OBJECT
+
+public:
+    explicit OutlinePanel(CodeEditorWidget* editor, QWidget* parent = nullptr);
+
+private slots:
+    void rebuild();
+    void jumpToSymbol(QTreeWidgetItem* item);
+
+private:
+    CodeEditorWidget* editor;
+    OutlineIndex* index;
+};
+
+#endif // OUTLINEPANEL_H
@@ -5,6 +5,7 @@
 #include <QRegularExpression>
 #include <QVector>
 #include <QTextCharFormat>
+#include <QTextLayout>
 
 class QTextDocument;
 
@@ -15,7 +16,24 @@ class SyntaxHighlighter : public QSyntaxHighlighter
 public:
     explicit SyntaxHighlighter(QTextDocument *parent = nullptr);
 
+    // Set on the string and comment formats, so callers reading a block's
+    // formats can tell code from text (e.g. for bracket matching)
+    static constexpr int NonCodeProperty = QTextFormat::UserProperty + 1;
+
     void setLanguage(const QString& language);
+    QString language() const { return currentLanguage; }
+
+    // The language's keywords, as highlighted (also offered by completion)
+    static QStringList keywords(const QString& language);
+
+    // Formats for one line without a document attached, for callers that
+    // highlight only part of a document. state carries multi-line comments.
+    QVector<QTextLayout::FormatRange> formatRanges(const QString& text, int previousState, int* state) const;
+
+signals:
+    // Blocks reformatted for an edit, sent once their formats are applied.
+    // rehighlight() does not report.
+    void blocksFormatted(int firstBlock, int lastBlock);
 
 protected:
     void highlightBlock(const QString &text) override;
@@ -49,6 +67,10 @@ private:
     // For multi-line comments
     QRegularExpression commentStartExpression;
     QRegularExpression commentEndExpression;
+
+    bool recordingFormatted = false;
+    int formattedFirst = -1;
+    int formattedLast = -1;
 };
 
 #endif // SYNTAXHIGHLIGHTER_H
\ No newline at end of file
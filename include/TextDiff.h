@@ -0,0 +1,31 @@
+// TextDiff.h
+#ifndef TEXTDIFF_H
+#define TEXTDIFF_H
+
+#include <QString>
+#include <QVector>
+
+// Turns one text into another as a short list of range replacements. The
+// common prefix and suffix are trimmed with vector compares, the rest is
+// diffed line by line (Myers, on hashed lines) and each changed hunk is
+// trimmed again to the characters that differ.
+class TextDiff {
+public:
+    struct Edit {
+        int position;      // In the text as left by the previous edits
+        int removedLength;
+        QString insertedText;
+    };
+
+    // Edits ascend and apply in order. Above maxEditCost changed lines the
+    // middle is replaced as one edit rather than searched further.
+    static QVector<Edit> diff(const QString& oldText, const QString& newText,
+                              int maxEditCost = 1000);
+
+    // Matching characters at the start of a and b, at most length
+    static int commonPrefixLength(const QChar* a, const QChar* b, int length);
+    // Matching characters just before aEnd and bEnd, at most length
+    static int commonSuffixLength(const QChar* aEnd, const QChar* bEnd, int length);
+};
+
+#endif // TEXTDIFF_H
@@ -0,0 +1,24 @@
+// TextFileLoader.h
+#ifndef TEXTFILELOADER_H
+#define TEXTFILELOADER_H
+
+#include <QString>
+#include <functional>
+
+// Loads a local text file by memory-mapping it and decoding it in slices
+// straight into a single QString buffer, normalising CRLF line endings on
+// the way. The mapped pages are file-backed, so peak memory stays close to
+// one decoded copy of the text.
+class TextFileLoader {
+public:
+    // Called after each slice; return false to cancel the load
+    using ProgressCallback = std::function<bool(qint64 bytesDone, qint64 bytesTotal)>;
+
+    static bool load(const QString& fileName, QString* content,
+                     const ProgressCallback& progress = ProgressCallback(),
+                     QString* errorMessage = nullptr);
+
+    static qint64 fileSize(const QString& fileName);
+};
+
+#endif // TEXTFILELOADER_H
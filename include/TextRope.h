@@ -0,0 +1,39 @@
+// TextRope.h
+#ifndef TEXTROPE_H
+#define TEXTROPE_H
+
+#include <QString>
+#include <QVector>
+
+// Text stored as a flat list of implicitly shared chunks of a few KiB, with
+// the start offset of each chunk kept alongside so a position is found by
+// binary search. Copying a rope is O(1). The first edit after a copy
+// detaches the chunk list, which costs one reference per chunk but no text;
+// only the chunks an edit touches are rewritten, so copies stay valid and
+// can be read from other threads while the original keeps changing.
+class TextRope {
+public:
+    TextRope();
+    explicit TextRope(const QString& text);
+
+    int length() const { return totalLength; }
+    bool isEmpty() const { return totalLength == 0; }
+
+    QString toString() const;
+    QString mid(int position, int length) const;
+    const QVector<QString>& chunks() const { return pieces; }
+
+    // Replaces [position, position + removedLength) with text
+    bool replace(int position, int removedLength, const QString& text);
+
+private:
+    int findChunk(int position, int* chunkStart) const;
+    void updateStarts(int fromChunk);
+    static void splitInto(const QString& text, QVector<QString>* out);
+
+    QVector<QString> pieces;
+    QVector<int> starts; // starts[i] is the offset of pieces[i]
+    int totalLength;
+};
+
+#endif // TEXTROPE_H
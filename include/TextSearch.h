@@ -0,0 +1,69 @@
+// TextSearch.h
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QString>
+#include <QVector>
+#include <QRegularExpression>
+#include <functional>
+
+// Finds every match of a literal or regular-expression query and keeps the
+// match set current through edits. Literal queries use a vector filter on
+// the first and last character of the pattern, so most of the text is
+// skipped eight characters at a time. An edit only re-searches the window
+// the caller passes in (the edited lines), widened to any match it cut;
+// matches after it are shifted. Regular expressions that span lines may be
+// missed next to an edit until the next full search.
+class TextSearch {
+public:
+    struct Query {
+        QString pattern;
+        bool caseSensitive = false;
+        bool wholeWords = false;
+        bool regularExpression = false;
+    };
+
+    struct Match {
+        int position;
+        int length;
+    };
+
+    using TextReader = std::function<QString(int position, int length)>;
+
+    // False, with errorString() set, when the regular expression is invalid
+    bool setQuery(const Query& query);
+    const Query& query() const { return currentQuery; }
+    bool isActive() const { return active; }
+    QString errorString() const { return error; }
+    void clear();
+
+    // Replaces the match set with the matches in text
+    void searchAll(const QString& text);
+    // [position, position + removedLength) became addedLength characters;
+    // [windowStart, windowEnd) is a range of the new text covering the edit
+    void applyEdit(int position, int removedLength, int addedLength,
+                   int windowStart, int windowEnd, const TextReader& textAt);
+
+    // Ascending and non-overlapping
+    const QVector<Match>& matches() const { return found; }
+
+    // The replacement text for a match in text, the whole text it was found
+    // in; \0..\9 refer to regex captures
+    QString replacementFor(const QString& text, const Match& match, const QString& replacement) const;
+
+    // Index of needle in text at or after from, or -1. Case-insensitive
+    // search uses simple case mapping.
+    static int indexOf(const QChar* text, int length, const QChar* needle, int needleLength,
+                       int from, Qt::CaseSensitivity cs);
+
+private:
+    QVector<Match> find(const QString& text, int offset) const;
+
+    Query currentQuery;
+    QRegularExpression expression;
+    bool active = false;
+    QString error;
+    QVector<Match> found;
+};
+
+#endif // TEXTSEARCH_H
@@ -0,0 +1,68 @@
+// UndoManager.h
+#ifndef UNDOMANAGER_H
+#define UNDOMANAGER_H
+
+#include <QString>
+#include <QVector>
+
+// Undo and redo for the local user's edits only. Remote edits are not
+// recorded; they shift the stored edits instead, and once a peer touches
+// text a step would revert, that step and the older ones are dropped rather
+// than undone over their work.
+// Consecutive typing or deleting is merged into one step, and the oldest
+// steps are discarded once the entry or character budget is exceeded.
+class UndoManager {
+public:
+    // A range replacement to apply to the current text
+    struct Edit {
+        int position;
+        int removedLength;
+        QString insertedText;
+    };
+
+    explicit UndoManager(int maxEntries = 1000, int maxCharacters = 1024 * 1024);
+
+    // A local edit that replaced removedText at position with insertedText
+    void recordLocal(int position, const QString& removedText, const QString& insertedText);
+    // A remote edit already applied to the text
+    void transform(int position, int removedLength, int insertedLength);
+
+    bool canUndo() const { return !undoStack.isEmpty(); }
+    bool canRedo() const { return !redoStack.isEmpty(); }
+    // Fill *edits with what to apply, in order; the step moves to the other stack
+    bool undo(QVector<Edit>* edits);
+    bool redo(QVector<Edit>* edits);
+
+    // Local edits recorded between these form a single step
+    void beginCompound();
+    void endCompound();
+
+    // Stops the current typing run, so the next edit starts a new step
+    void closeRun() { runOpen = false; }
+    void clear();
+
+private:
+    struct Entry {
+        int position;
+        QString removedText;
+        QString insertedText;
+        qint64 timestamp;
+        int step; // Entries of one compound step share this
+    };
+
+    bool mergeInto(Entry* last, const Entry& entry) const;
+    void transformStack(QVector<Entry>* stack, bool undoSide, int position, int removedLength, int insertedLength);
+    void enforceBudget();
+    static int entrySize(const Entry& entry) { return entry.removedText.length() + entry.insertedText.length(); }
+
+    QVector<Entry> undoStack; // Inserted text of each entry is in the document
+    QVector<Entry> redoStack; // Removed text of each entry is in the document
+    int maxEntries;
+    int maxCharacters;
+    int storedCharacters;
+    bool runOpen;
+    int nextStep;
+    int compoundStep; // Step of the open compound, or -1
+};
+
+#endif // UNDOMANAGER_H
@@ -4,10 +4,19 @@
 #include <QString>
 #include <QJsonObject>
 
+// Users are kept in an in-memory hash loaded once from users.json plus the
+// append-only users.journal. Registrations append one journal record and
+// the journal is folded back into users.json once it grows. Access is
+// guarded by a read/write lock in-process and a lock file across processes.
 namespace UserStorage {
 QString getUserFilePath();
+QString getJournalFilePath();
 QJsonObject readUsersFromFile();
 bool writeUsersToFile(const QJsonObject& users);
+
+bool findUser(const QString& username, QJsonObject* userInfo);
+bool addUser(const QString& username, const QJsonObject& userInfo);
+bool compact();
 }
 
 #endif // USERSTORAGE_H
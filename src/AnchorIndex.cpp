@@ -0,0 +1,253 @@
+// AnchorIndex.cpp
+#include "AnchorIndex.h"
+
+AnchorIndex::AnchorIndex()
+    : root(-1)
+    , liveCount(0)
+    , seed(0x9E3779B9u)
+{
+}
+
+int AnchorIndex::create(int position)
+{
+    // xorshift32 priorities keep the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.parent = -1;
+    node.priority = seed;
+    node.position = qMax(0, position);
+    node.add = 0;
+    node.assignValue = 0;
+    node.hasAssign = false;
+    node.alive = true;
+
+    int index;
+    if (!freeNodes.empty()) {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = node;
+    } else {
+        index = int(nodes.size());
+        nodes.push_back(node);
+    }
+
+    insert(index);
+    ++liveCount;
+    return index;
+}
+
+void AnchorIndex::remove(int anchor)
+{
+    if (!isValid(anchor)) {
+        return;
+    }
+    detach(anchor);
+    nodes[anchor].alive = false;
+    freeNodes.push_back(anchor);
+    --liveCount;
+}
+
+bool AnchorIndex::isValid(int anchor) const
+{
+    return anchor >= 0 && anchor < int(nodes.size()) && nodes[anchor].alive;
+}
+
+int AnchorIndex::position(int anchor)
+{
+    if (!isValid(anchor)) {
+        return -1;
+    }
+    pushPath(anchor);
+    return nodes[anchor].position;
+}
+
+void AnchorIndex::setPosition(int anchor, int position)
+{
+    if (!isValid(anchor)) {
+        return;
+    }
+    detach(anchor);
+    nodes[anchor].position = qMax(0, position);
+    insert(anchor);
+}
+
+void AnchorIndex::applyEdit(int position, int removedLength, int insertedLength)
+{
+    if (root < 0 || position < 0 || removedLength < 0 || insertedLength < 0) {
+        return;
+    }
+
+    // before: [0, position)  removed: [position, position + removedLength)  after: the rest
+    int before = -1;
+    int rest = -1;
+    int removed = -1;
+    int after = -1;
+    splitLess(root, position, &before, &rest);
+    splitLess(rest, position + removedLength, &removed, &after);
+
+    if (removed >= 0) {
+        applyAssign(removed, position + insertedLength);
+    }
+    if (after >= 0) {
+        applyAdd(after, insertedLength - removedLength);
+    }
+
+    root = merge(merge(before, removed), after);
+    if (root >= 0) {
+        nodes[root].parent = -1;
+    }
+}
+
+void AnchorIndex::clear()
+{
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+    liveCount = 0;
+}
+
+void AnchorIndex::applyAdd(int node, int delta)
+{
+    Node& n = nodes[node];
+    n.position += delta;
+    if (n.hasAssign) {
+        n.assignValue += delta;
+    } else {
+        n.add += delta;
+    }
+}
+
+void AnchorIndex::applyAssign(int node, int value)
+{
+    Node& n = nodes[node];
+    n.position = value;
+    n.hasAssign = true;
+    n.assignValue = value;
+    n.add = 0;
+}
+
+void AnchorIndex::push(int node)
+{
+    Node& n = nodes[node];
+    if (n.hasAssign) {
+        if (n.left >= 0) applyAssign(n.left, n.assignValue);
+        if (n.right >= 0) applyAssign(n.right, n.assignValue);
+        n.hasAssign = false;
+    }
+    if (n.add != 0) {
+        if (n.left >= 0) applyAdd(n.left, n.add);
+        if (n.right >= 0) applyAdd(n.right, n.add);
+        n.add = 0;
+    }
+}
+
+void AnchorIndex::pushPath(int node)
+{
+    // Tags are pushed from the root down so the node's own position is current
+    std::vector<int> path;
+    for (int current = node; current >= 0; current = nodes[current].parent) {
+        path.push_back(current);
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        push(*it);
+    }
+}
+
+void AnchorIndex::setLeft(int node, int child)
+{
+    nodes[node].left = child;
+    if (child >= 0) {
+        nodes[child].parent = node;
+    }
+}
+
+void AnchorIndex::setRight(int node, int child)
+{
+    nodes[node].right = child;
+    if (child >= 0) {
+        nodes[child].parent = node;
+    }
+}
+
+void AnchorIndex::splitLess(int node, int key, int* left, int* right)
+{
+    if (node < 0) {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+
+    push(node);
+    int l = -1;
+    int r = -1;
+    if (nodes[node].position < key) {
+        splitLess(nodes[node].right, key, &l, &r);
+        setRight(node, l);
+        if (r >= 0) nodes[r].parent = -1;
+        *left = node;
+        *right = r;
+    } else {
+        splitLess(nodes[node].left, key, &l, &r);
+        setLeft(node, r);
+        if (l >= 0) nodes[l].parent = -1;
+        *left = l;
+        *right = node;
+    }
+    nodes[node].parent = -1;
+}
+
+int AnchorIndex::merge(int left, int right)
+{
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+
+    if (nodes[left].priority > nodes[right].priority) {
+        push(left);
+        setRight(left, merge(nodes[left].right, right));
+        return left;
+    }
+
+    push(right);
+    setLeft(right, merge(left, nodes[right].left));
+    return right;
+}
+
+void AnchorIndex::detach(int node)
+{
+    pushPath(node);
+    push(node);
+
+    int parent = nodes[node].parent;
+    int replacement = merge(nodes[node].left, nodes[node].right);
+
+    if (parent < 0) {
+        root = replacement;
+        if (replacement >= 0) nodes[replacement].parent = -1;
+    } else if (nodes[parent].left == node) {
+        setLeft(parent, replacement);
+    } else {
+        setRight(parent, replacement);
+    }
+
+    nodes[node].left = -1;
+    nodes[node].right = -1;
+    nodes[node].parent = -1;
+}
+
+void AnchorIndex::insert(int node)
+{
+    int left = -1;
+    int right = -1;
+    splitLess(root, nodes[node].position, &left, &right);
+    root = merge(merge(left, node), right);
+    nodes[root].parent = -1;
+}
@@ -0,0 +1,369 @@
+// AuthorshipMap.cpp
+#include "AuthorshipMap.h"
+
+#include <QJsonArray>
+
+AuthorshipMap::AuthorshipMap()
+    : root(-1)
+    , seed(0x9E3779B9u)
+{
+}
+
+void AuthorshipMap::reset(int length, const QString& author)
+{
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+    authors.clear();
+    authorIds.clear();
+    if (length > 0) {
+        root = createNode(Run{length, authorIndex(author)});
+    }
+}
+
+bool AuthorshipMap::applyEdit(int position, int removedLength, int insertedLength, const QString& author)
+{
+    if (position < 0 || removedLength < 0 || insertedLength < 0 || position + removedLength > length()) {
+        return false;
+    }
+
+    // Cut out the removed range, then the runs next to it, so equal authors
+    // meeting at either seam become one run
+    int left = -1;
+    int middle = -1;
+    int right = -1;
+    split(root, position, &left, &middle);
+    split(middle, removedLength, &middle, &right);
+    releaseTree(middle);
+
+    std::vector<Run> seam;
+    int before = -1;
+    int after = -1;
+    if (left >= 0) {
+        int node = left;
+        while (nodes[node].right >= 0) {
+            node = nodes[node].right;
+        }
+        split(left, sum(left) - nodes[node].length, &left, &before);
+        seam.push_back(Run{nodes[before].length, nodes[before].author});
+    }
+    if (insertedLength > 0) {
+        seam.push_back(Run{insertedLength, authorIndex(author)});
+    }
+    if (right >= 0) {
+        int node = right;
+        while (nodes[node].left >= 0) {
+            node = nodes[node].left;
+        }
+        split(right, nodes[node].length, &after, &right);
+        seam.push_back(Run{nodes[after].length, nodes[after].author});
+    }
+    releaseTree(before);
+    releaseTree(after);
+
+    std::vector<Run> merged;
+    for (const Run& run : seam) {
+        if (!merged.empty() && merged.back().author == run.author) {
+            merged.back().length += run.length;
+        } else {
+            merged.push_back(run);
+        }
+    }
+    root = merge(merge(left, buildFromRuns(merged)), right);
+    return true;
+}
+
+QString AuthorshipMap::authorAt(int offset) const
+{
+    int runStart = 0;
+    const int node = findRun(offset, &runStart);
+    return node < 0 ? QString() : authors.value(nodes[node].author);
+}
+
+QStringList AuthorshipMap::dominantAuthors(const QVector<QPair<int, int>>& ranges) const
+{
+    QStringList result;
+    result.reserve(ranges.size());
+    QHash<int, int> counts;
+    const int total = length();
+
+    for (const QPair<int, int>& range : ranges) {
+        const int start = range.first;
+        const int end = start + qMax(1, range.second);
+
+        int scanStart = 0;
+        int node = findRun(start, &scanStart);
+        if (node < 0) {
+            result.append(QString());
+            continue;
+        }
+
+        // Each step is one lookup; a range spans few runs
+        counts.clear();
+        int bestAuthor = nodes[node].author;
+        int bestCount = 0;
+        while (node >= 0 && scanStart < end) {
+            const int runEnd = scanStart + nodes[node].length;
+            const int overlap = qMin(end, runEnd) - qMax(start, scanStart);
+            if (overlap > 0) {
+                const int count = counts[nodes[node].author] += overlap;
+                if (count > bestCount) {
+                    bestCount = count;
+                    bestAuthor = nodes[node].author;
+                }
+            }
+            node = runEnd < total ? findRun(runEnd, &scanStart) : -1;
+        }
+        result.append(authors.value(bestAuthor));
+    }
+    return result;
+}
+
+QJsonObject AuthorshipMap::toJson() const
+{
+    std::vector<Run> runs;
+    runs.reserve(count(root));
+    appendRuns(root, &runs);
+
+    // Runs are flattened to [length, author, length, author, ...]
+    QJsonArray runArray;
+    for (const Run& run : runs) {
+        runArray.append(run.length);
+        runArray.append(run.author);
+    }
+
+    QJsonObject json;
+    json["authors"] = QJsonArray::fromStringList(authors);
+    json["runs"] = runArray;
+    return json;
+}
+
+bool AuthorshipMap::fromJson(const QJsonObject& json, int expectedLength)
+{
+    QStringList loadedAuthors;
+    for (const QJsonValue& value : json["authors"].toArray()) {
+        loadedAuthors.append(value.toString());
+    }
+
+    std::vector<Run> loadedRuns;
+    const QJsonArray runArray = json["runs"].toArray();
+    int length = 0;
+    for (int i = 0; i + 1 < runArray.size(); i += 2) {
+        Run run{runArray[i].toInt(), runArray[i + 1].toInt()};
+        if (run.length <= 0 || run.author < 0 || run.author >= loadedAuthors.size()) {
+            return false;
+        }
+        length += run.length;
+        loadedRuns.push_back(run);
+    }
+    if (length != expectedLength) {
+        return false; // Content changed outside the editor, authorship no longer lines up
+    }
+
+    nodes.clear();
+    freeNodes.clear();
+    nodes.reserve(loadedRuns.size());
+    root = buildFromRuns(loadedRuns);
+    authors = loadedAuthors;
+    authorIds.clear();
+    for (int i = 0; i < authors.size(); ++i) {
+        authorIds.insert(authors[i], i);
+    }
+    return true;
+}
+
+int AuthorshipMap::authorIndex(const QString& author)
+{
+    auto it = authorIds.constFind(author);
+    if (it != authorIds.constEnd()) {
+        return it.value();
+    }
+    int index = authors.size();
+    authors.append(author);
+    authorIds.insert(author, index);
+    return index;
+}
+
+int AuthorshipMap::createNode(const Run& run)
+{
+    // xorshift32 priorities keep the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.priority = seed;
+    node.length = run.length;
+    node.author = run.author;
+    node.count = 1;
+    node.sum = run.length;
+
+    if (!freeNodes.empty()) {
+        int index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = node;
+        return index;
+    }
+    nodes.push_back(node);
+    return int(nodes.size()) - 1;
+}
+
+void AuthorshipMap::releaseTree(int node)
+{
+    std::vector<int> pending;
+    if (node >= 0) {
+        pending.push_back(node);
+    }
+    while (!pending.empty()) {
+        int current = pending.back();
+        pending.pop_back();
+        if (nodes[current].left >= 0) {
+            pending.push_back(nodes[current].left);
+        }
+        if (nodes[current].right >= 0) {
+            pending.push_back(nodes[current].right);
+        }
+        freeNodes.push_back(current);
+    }
+}
+
+void AuthorshipMap::update(int node)
+{
+    Node& n = nodes[node];
+    n.count = 1 + count(n.left) + count(n.right);
+    n.sum = n.length + sum(n.left) + sum(n.right);
+}
+
+void AuthorshipMap::split(int node, int offset, int* left, int* right)
+{
+    // The left tree gets the first offset characters; a run straddling the
+    // cut is divided in two
+    if (node < 0) {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+
+    const int leftSum = sum(nodes[node].left);
+    int l = -1;
+    int r = -1;
+    if (offset <= leftSum) {
+        split(nodes[node].left, offset, &l, &r);
+        nodes[node].left = r;
+        update(node);
+        *left = l;
+        *right = node;
+    } else if (offset >= leftSum + nodes[node].length) {
+        split(nodes[node].right, offset - leftSum - nodes[node].length, &l, &r);
+        nodes[node].right = l;
+        update(node);
+        *left = node;
+        *right = r;
+    } else {
+        const int tail = createNode(Run{leftSum + nodes[node].length - offset, nodes[node].author});
+        const int rest = nodes[node].right;
+        nodes[node].length = offset - leftSum;
+        nodes[node].right = -1;
+        update(node);
+        *left = node;
+        *right = merge(tail, rest);
+    }
+}
+
+int AuthorshipMap::merge(int left, int right)
+{
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+
+    if (nodes[left].priority > nodes[right].priority) {
+        int merged = merge(nodes[left].right, right);
+        nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+
+    int merged = merge(left, nodes[right].left);
+    nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+int AuthorshipMap::buildFromRuns(const std::vector<Run>& runs)
+{
+    // Cartesian-tree build: O(k) for k runs instead of k merges
+    std::vector<int> spine;
+    for (const Run& run : runs) {
+        int node = createNode(run);
+        int lastPopped = -1;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[node].priority) {
+            lastPopped = spine.back();
+            spine.pop_back();
+            update(lastPopped);
+        }
+        nodes[node].left = lastPopped;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = node;
+        }
+        spine.push_back(node);
+    }
+
+    while (spine.size() > 1) {
+        update(spine.back());
+        spine.pop_back();
+    }
+    if (spine.empty()) {
+        return -1;
+    }
+    update(spine.front());
+    return spine.front();
+}
+
+void AuthorshipMap::appendRuns(int node, std::vector<Run>* out) const
+{
+    // In order, without recursion
+    std::vector<int> pending;
+    while (node >= 0 || !pending.empty()) {
+        while (node >= 0) {
+            pending.push_back(node);
+            node = nodes[node].left;
+        }
+        node = pending.back();
+        pending.pop_back();
+        out->push_back(Run{nodes[node].length, nodes[node].author});
+        node = nodes[node].right;
+    }
+}
+
+int AuthorshipMap::findRun(int offset, int* runStart) const
+{
+    // The run holding offset; the end of the text belongs to the last run
+    offset = qMax(0, offset);
+    int node = root;
+    int base = 0;
+    int last = -1;
+    int lastStart = 0;
+    while (node >= 0) {
+        const Node& n = nodes[node];
+        const int leftSum = sum(n.left);
+        if (offset < leftSum) {
+            node = n.left;
+        } else if (offset < leftSum + n.length) {
+            *runStart = base + leftSum;
+            return node;
+        } else {
+            last = node;
+            lastStart = base + leftSum;
+            base += leftSum + n.length;
+            offset -= leftSum + n.length;
+            node = n.right;
+        }
+    }
+    *runStart = lastStart;
+    return last;
+}
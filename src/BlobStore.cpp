@@ -0,0 +1,175 @@
+// BlobStore.cpp
+#include "BlobStore.h"
+
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QMutexLocker>
+#include <QDebug>
+
+namespace {
+
+// Chunk boundaries are content-defined (gear rolling hash), so an insertion
+// only changes the chunks around it instead of shifting every later chunk.
+const int MinChunkSize = 2 * 1024;
+const int MaxChunkSize = 64 * 1024;
+const quint64 BoundaryMask = quint64(0x1FFF) << 51; // ~8 KiB average chunk
+
+struct GearTable {
+    quint64 values[256];
+
+    GearTable() {
+        // splitmix64 gives a fixed pseudo-random table, stable across runs
+        quint64 state = 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < 256; ++i) {
+            state += 0x9E3779B97F4A7C15ULL;
+            quint64 z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            values[i] = z ^ (z >> 31);
+        }
+    }
+};
+
+int nextChunkLength(const char* data, int length)
+{
+    static const GearTable gear;
+
+    if (length <= MinChunkSize) {
+        return length;
+    }
+
+    int limit = qMin(length, MaxChunkSize);
+    quint64 hash = 0;
+    for (int i = MinChunkSize; i < limit; ++i) {
+        hash = (hash << 1) + gear.values[static_cast<uchar>(data[i])];
+        if ((hash & BoundaryMask) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+} // namespace
+
+BlobStore::BlobStore()
+    : rootPath("documents/blobs")
+{
+}
+
+QStringList BlobStore::storeContent(const QString& content, bool* ok)
+{
+    if (ok) {
+        *ok = false;
+    }
+
+    QStringList chunkRefs;
+    QByteArray bytes = content.toUtf8();
+
+    int offset = 0;
+    while (offset < bytes.size()) {
+        int length = nextChunkLength(bytes.constData() + offset, bytes.size() - offset);
+        QByteArray chunk = bytes.mid(offset, length);
+        QString chunkRef = QString::fromLatin1(
+            QCryptographicHash::hash(chunk, QCryptographicHash::Sha256).toHex());
+
+        if (!hasChunk(chunkRef) && !writeChunk(chunkRef, chunk)) {
+            qDebug() << "Failed to store chunk" << chunkRef;
+            return QStringList();
+        }
+
+        chunkRefs.append(chunkRef);
+        offset += length;
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return chunkRefs;
+}
+
+QString BlobStore::loadContent(const QStringList& chunkRefs, bool* ok)
+{
+    QByteArray bytes;
+    bool success = true;
+
+    for (const QString& chunkRef : chunkRefs) {
+        bool chunkOk = false;
+        QByteArray chunk = readChunk(chunkRef, &chunkOk);
+        if (!chunkOk) {
+            qDebug() << "Missing or corrupt chunk" << chunkRef;
+            success = false;
+            break;
+        }
+        bytes.append(chunk);
+    }
+
+    if (ok) {
+        *ok = success;
+    }
+    return success ? QString::fromUtf8(bytes) : QString();
+}
+
+bool BlobStore::hasChunk(const QString& chunkRef)
+{
+    QMutexLocker locker(&mutex);
+    if (knownChunks.contains(chunkRef)) {
+        return true;
+    }
+
+    if (QFile::exists(chunkPath(chunkRef))) {
+        knownChunks.insert(chunkRef);
+        return true;
+    }
+    return false;
+}
+
+QString BlobStore::chunkPath(const QString& chunkRef) const
+{
+    // Fan out by the first byte of the hash to keep directories small
+    return rootPath + "/" + chunkRef.left(2) + "/" + chunkRef.mid(2);
+}
+
+bool BlobStore::writeChunk(const QString& chunkRef, const QByteArray& data)
+{
+    QString path = chunkPath(chunkRef);
+    QDir().mkpath(path.left(path.lastIndexOf('/')));
+
+    // QSaveFile renames into place, so readers never see a partial chunk
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(qCompress(data));
+    if (!file.commit()) {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    knownChunks.insert(chunkRef);
+    return true;
+}
+
+QByteArray BlobStore::readChunk(const QString& chunkRef, bool* ok)
+{
+    *ok = false;
+
+    QFile file(chunkPath(chunkRef));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QByteArray data = qUncompress(file.readAll());
+    file.close();
+
+    // Verify the chunk against its address before trusting it
+    QString actualRef = QString::fromLatin1(
+        QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex());
+    if (actualRef != chunkRef) {
+        return QByteArray();
+    }
+
+    *ok = true;
+    return data;
+}
@@ -0,0 +1,288 @@
+// BracketIndex.cpp
+#include "BracketIndex.h"
+
+BracketIndex::BracketIndex()
+    : root(-1)
+    , seed(0x9E3779B9u)
+{
+}
+
+void BracketIndex::reset(const std::vector<LineSummary>& lines)
+{
+    nodes.clear();
+    freeNodes.clear();
+    nodes.reserve(lines.size());
+    root = buildFromSummaries(lines);
+}
+
+void BracketIndex::replaceLines(int firstLine, int removedCount, const std::vector<LineSummary>& lines)
+{
+    firstLine = qBound(0, firstLine, lineCount());
+    removedCount = qBound(0, removedCount, lineCount() - firstLine);
+
+    int left = -1;
+    int middle = -1;
+    int right = -1;
+    split(root, firstLine, &left, &middle);
+    split(middle, removedCount, &middle, &right);
+    releaseTree(middle);
+    root = merge(merge(left, buildFromSummaries(lines)), right);
+}
+
+void BracketIndex::setLine(int line, const LineSummary& summary)
+{
+    if (line < 0 || line >= lineCount()) {
+        return;
+    }
+
+    // Walk down to the line, then refresh the aggregates on the way back up
+    std::vector<int> path;
+    int node = root;
+    while (node >= 0) {
+        path.push_back(node);
+        const int leftCount = count(nodes[node].left);
+        if (line < leftCount) {
+            node = nodes[node].left;
+        } else if (line == leftCount) {
+            nodes[node].summary = summary;
+            break;
+        } else {
+            line -= leftCount + 1;
+            node = nodes[node].right;
+        }
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        update(*it);
+    }
+}
+
+int BracketIndex::lineCount() const
+{
+    return count(root);
+}
+
+BracketIndex::LineSummary BracketIndex::line(int line) const
+{
+    int node = root;
+    while (node >= 0) {
+        const int leftCount = count(nodes[node].left);
+        if (line < leftCount) {
+            node = nodes[node].left;
+        } else if (line == leftCount) {
+            return nodes[node].summary;
+        } else {
+            line -= leftCount + 1;
+            node = nodes[node].right;
+        }
+    }
+    return LineSummary();
+}
+
+int BracketIndex::depthBefore(int line) const
+{
+    int depth = 0;
+    int node = root;
+    while (node >= 0) {
+        const Node& n = nodes[node];
+        const int leftCount = count(n.left);
+        if (line <= leftCount) {
+            node = n.left;
+        } else {
+            depth += delta(n.left) + n.summary.delta;
+            line -= leftCount + 1;
+            node = n.right;
+        }
+    }
+    return depth;
+}
+
+int BracketIndex::findForward(int fromLine, int depth) const
+{
+    return findFirst(root, 0, 0, qMax(0, fromLine), depth);
+}
+
+int BracketIndex::findBackward(int toLine, int depth) const
+{
+    return findLast(root, 0, 0, qMin(lineCount() - 1, toLine), depth);
+}
+
+int BracketIndex::findFirst(int node, int base, int offset, int fromLine, int depth) const
+{
+    // Subtrees wholly before fromLine, or wholly inside the range and never
+    // reaching depth, are skipped without descending
+    if (node < 0 || base + count(node) <= fromLine) {
+        return -1;
+    }
+    if (base >= fromLine && offset + minPrefix(node) > depth) {
+        return -1;
+    }
+
+    const Node& n = nodes[node];
+    const int found = findFirst(n.left, base, offset, fromLine, depth);
+    if (found >= 0) {
+        return found;
+    }
+    const int line = base + count(n.left);
+    const int before = offset + delta(n.left);
+    if (line >= fromLine && before + n.summary.minDepth <= depth) {
+        return line;
+    }
+    return findFirst(n.right, line + 1, before + n.summary.delta, fromLine, depth);
+}
+
+int BracketIndex::findLast(int node, int base, int offset, int toLine, int depth) const
+{
+    if (node < 0 || base > toLine) {
+        return -1;
+    }
+    if (base + count(node) - 1 <= toLine && offset + minPrefix(node) > depth) {
+        return -1;
+    }
+
+    const Node& n = nodes[node];
+    const int line = base + count(n.left);
+    const int before = offset + delta(n.left);
+    const int found = findLast(n.right, line + 1, before + n.summary.delta, toLine, depth);
+    if (found >= 0) {
+        return found;
+    }
+    if (line <= toLine && before + n.summary.minDepth <= depth) {
+        return line;
+    }
+    return findLast(n.left, base, offset, toLine, depth);
+}
+
+int BracketIndex::createNode(const LineSummary& summary)
+{
+    // xorshift32 priorities keep the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.priority = seed;
+    node.summary = summary;
+    node.count = 1;
+    node.delta = summary.delta;
+    node.minPrefix = summary.minDepth;
+
+    if (!freeNodes.empty()) {
+        int index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = node;
+        return index;
+    }
+    nodes.push_back(node);
+    return int(nodes.size()) - 1;
+}
+
+void BracketIndex::releaseTree(int node)
+{
+    std::vector<int> pending;
+    if (node >= 0) {
+        pending.push_back(node);
+    }
+    while (!pending.empty()) {
+        int current = pending.back();
+        pending.pop_back();
+        if (nodes[current].left >= 0) {
+            pending.push_back(nodes[current].left);
+        }
+        if (nodes[current].right >= 0) {
+            pending.push_back(nodes[current].right);
+        }
+        freeNodes.push_back(current);
+    }
+}
+
+void BracketIndex::update(int node)
+{
+    Node& n = nodes[node];
+    const int leftDelta = delta(n.left);
+    n.count = 1 + count(n.left) + count(n.right);
+    n.delta = leftDelta + n.summary.delta + delta(n.right);
+    n.minPrefix = qMin(leftDelta + n.summary.minDepth, leftDelta + n.summary.delta + minPrefix(n.right));
+    if (n.left >= 0) {
+        n.minPrefix = qMin(n.minPrefix, minPrefix(n.left));
+    }
+}
+
+void BracketIndex::split(int node, int lines, int* left, int* right)
+{
+    if (node < 0) {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+
+    int leftCount = count(nodes[node].left);
+    int l = -1;
+    int r = -1;
+    if (lines <= leftCount) {
+        split(nodes[node].left, lines, &l, &r);
+        nodes[node].left = r;
+        update(node);
+        *left = l;
+        *right = node;
+    } else {
+        split(nodes[node].right, lines - leftCount - 1, &l, &r);
+        nodes[node].right = l;
+        update(node);
+        *left = node;
+        *right = r;
+    }
+}
+
+int BracketIndex::merge(int left, int right)
+{
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+
+    if (nodes[left].priority > nodes[right].priority) {
+        int merged = merge(nodes[left].right, right);
+        nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+
+    int merged = merge(left, nodes[right].left);
+    nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+int BracketIndex::buildFromSummaries(const std::vector<LineSummary>& lines)
+{
+    // Cartesian-tree build: O(k) for k lines instead of k merges
+    std::vector<int> spine;
+    for (const LineSummary& summary : lines) {
+        int node = createNode(summary);
+        int lastPopped = -1;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[node].priority) {
+            lastPopped = spine.back();
+            spine.pop_back();
+            update(lastPopped);
+        }
+        nodes[node].left = lastPopped;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = node;
+        }
+        spine.push_back(node);
+    }
+
+    while (spine.size() > 1) {
+        update(spine.back());
+        spine.pop_back();
+    }
+    if (spine.empty()) {
+        return -1;
+    }
+    update(spine.front());
+    return spine.front();
+}
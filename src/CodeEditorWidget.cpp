@@ -3,30 +3,171 @@
 #include "SyntaxHighlighter.h"
 #include "Document.h"
 #include "CollaborationManager.h"
+#include "CompletionIndex.h"
 
 #include <QPainter>
 #include <QTextBlock>
+#include <QAbstractTextDocumentLayout>
 #include <QPaintEvent>
 #include <QKeyEvent>
+#include <QMouseEvent>
 #include <QScrollBar>
 #include <QDebug>
 #include <QResizeEvent>
+#include <QMetaMethod>
+#include <QHelpEvent>
+#include <QToolTip>
+#include <QTextLayout>
+#include <QTimer>
+#include <QSettings>
+#include <QCompleter>
+#include <QStringListModel>
+#include <QAbstractItemView>
+#include <algorithm>
+
+namespace {
+
+// Width of the authorship strip at the left edge of the gutter
+const int AuthorshipStripWidth = 5;
+
+// Inserted by Tab and removed by Shift+Tab
+const QString IndentUnit = QStringLiteral("    ");
+
+// Remote edits arriving within one frame are applied together
+const int RemoteEditFrameMs = 16;
+
+// Rich operations whose steps are kept in case the server rejects them
+const int MaxSentRichOperations = 32;
+
+// Default large-file limits, overridable in the "editor" settings group
+const int DefaultLargeFileCharacters = 8 * 1024 * 1024;
+const int DefaultLargeFileLines = 200000;
+
+// Memory for texts kept for switching back, overridable in the "editor"
+// settings group, and a rough cost per character of text, block layouts
+// and highlighting formats
+const int DefaultDocumentCacheMegabytes = 256;
+const int CachedBytesPerCharacter = 16;
+
+// Gutter column holding the fold markers
+const int FoldMarkerWidth = 10;
+
+// Completion pops up by itself once a word has this many characters
+const int MinCompletionPrefix = 2;
+const int MaxCompletions = 12;
+
+// +1 for an opening bracket, -1 for a closing one, 0 otherwise
+int bracketDelta(QChar c)
+{
+    switch (c.unicode()) {
+    case '(': case '[': case '{':
+        return 1;
+    case ')': case ']': case '}':
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+// Characters the highlighter formatted as strings or comments; their
+// brackets do not count
+QVector<bool> nonCodeMask(const QTextBlock& block)
+{
+    QVector<bool> mask(block.length(), false);
+    for (const QTextLayout::FormatRange& range : block.layout()->formats()) {
+        if (range.format.boolProperty(SyntaxHighlighter::NonCodeProperty)) {
+            const int start = qBound(0, range.start, int(mask.size()));
+            const int end = qBound(start, range.start + range.length, int(mask.size()));
+            std::fill(mask.begin() + start, mask.begin() + end, true);
+        }
+    }
+    return mask;
+}
+
+// Depth change over the code brackets of block before endColumn (-1 for all)
+BracketIndex::LineSummary bracketSummary(const QTextBlock& block, int endColumn = -1)
+{
+    BracketIndex::LineSummary summary;
+    const QString text = block.text();
+    const int end = endColumn < 0 ? int(text.length()) : qMin(endColumn, int(text.length()));
+    QVector<bool> mask;
+    for (int i = 0; i < end; ++i) {
+        const int delta = bracketDelta(text.at(i));
+        if (!delta) {
+            continue;
+        }
+        if (mask.isEmpty()) {
+            mask = nonCodeMask(block);
+        }
+        if (!mask[i]) {
+            summary.delta += delta;
+            summary.minDepth = qMin(summary.minDepth, summary.delta);
+        }
+    }
+    return summary;
+}
+
+} // namespace
 
 CodeEditorWidget::CodeEditorWidget(QWidget *parent)
     : QPlainTextEdit(parent)
     , lineNumberArea(new LineNumberArea(this))
     , syntaxHighlighter(nullptr)
     , currentLanguage("Plain")
+    , localUserId("local")
+    , lastHorizontalScroll(0)
+    , selectionIndexDirty(false)
+    , remoteEditTimer(new QTimer(this))
+    , expectedCursorAfterEdit(-1)
+    , cursorMoveFromEdit(false)
+    , applyingUndo(false)
+    , richOperationsEnabled(false)
+    , lastRichSequence(0)
     , ignoreChanges(false)
+    , authorshipVisible(false)
+    , largeFileMode(false)
+    , highlightedFirstBlock(-1)
+    , highlightedLastBlock(-1)
+    , highlightedRevision(-1)
+    , bracketsEnabled(false)
+    , foldsPresent(false)
+    , completionIndex(nullptr)
+    , completer(new QCompleter(this))
+    , completionModel(new QStringListModel(this))
 {
     setLineWrapMode(QPlainTextEdit::NoWrap);
+    setUndoRedoEnabled(false);
 
     // Enable line numbers
     connect(this, &QPlainTextEdit::blockCountChanged, this, &CodeEditorWidget::updateLineNumberAreaWidth);
     connect(this, &QPlainTextEdit::updateRequest, this, &CodeEditorWidget::updateLineNumberArea);
     connect(this, &QPlainTextEdit::cursorPositionChanged, this, &CodeEditorWidget::highlightCurrentLine);
-    connect(this, &QPlainTextEdit::textChanged, this, &CodeEditorWidget::onTextChanged);
     connect(this, &QPlainTextEdit::cursorPositionChanged, this, &CodeEditorWidget::onCursorPositionChanged);
+    connectTextDocument(document());
+    // Large files are highlighted as they scroll into view
+    connect(this, &QPlainTextEdit::updateRequest, this, [this]() {
+        if (largeFileMode) {
+            highlightViewport();
+        }
+    });
+
+    // The index has already ranked and filtered the words
+    completer->setModel(completionModel);
+    completer->setWidget(this);
+    completer->setCompletionMode(QCompleter::PopupCompletion);
+    completer->setCaseSensitivity(Qt::CaseSensitive);
+    completer->setModelSorting(QCompleter::UnsortedModel);
+    connect(completer, qOverload<const QString&>(&QCompleter::activated),
+            this, &CodeEditorWidget::insertCompletion);
+
+    remoteEditTimer->setSingleShot(true);
+    remoteEditTimer->setInterval(RemoteEditFrameMs);
+    connect(remoteEditTimer, &QTimer::timeout, this, &CodeEditorWidget::flushRemoteEdits);
+
+    connect(horizontalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        scrollRemoteCursorGeometry(lastHorizontalScroll - value, 0);
+        lastHorizontalScroll = value;
+    });
 
     updateLineNumberAreaWidth(0);
     highlightCurrentLine();
@@ -44,35 +185,265 @@ CodeEditorWidget::CodeEditorWidget(QWidget *parent)
 CodeEditorWidget::~CodeEditorWidget()
 {
     delete syntaxHighlighter;
+    // Cached texts are children; only their highlighters may be unowned
+    for (const CachedDocument& entry : std::as_const(documentCache)) {
+        delete entry.highlighter;
+    }
     // lineNumberArea is automatically deleted as a child widget
 }
 
+void CodeEditorWidget::connectTextDocument(QTextDocument* text)
+{
+    // Cached texts keep their connections, so each handler first checks the
+    // text is on show; a hidden one may still be reformatted by its highlighter.
+    // Connected ahead of the highlighter, so the edited lines still carry
+    // their old formats here; the bracket index reads them again once the
+    // highlighter reports the blocks it formatted
+    connect(text, &QTextDocument::contentsChange, this,
+        [this, text](int position, int charsRemoved, int charsAdded) {
+            if (text != document()) {
+                return;
+            }
+            onContentsChange(position, charsRemoved, charsAdded);
+            selectionIndexDirty = !remoteSelections.isEmpty() || selectionIndexDirty;
+            updateSearchAfterEdit(position, charsRemoved, charsAdded);
+            updateBracketIndex(position, charsRemoved, charsAdded);
+            emit contentsChange(position, charsRemoved, charsAdded);
+        });
+
+    // Remote cursor rectangles are cached: layout changes drop them, scrolling moves them
+    connect(text->documentLayout(), &QAbstractTextDocumentLayout::update, this, [this, text]() {
+        if (text == document()) {
+            invalidateRemoteCursorGeometry();
+        }
+    });
+}
+
 void CodeEditorWidget::setDocument(std::shared_ptr<Document> doc)
 {
+    // Queued edits belong to the previous document
+    flushRemoteEdits();
+    completer->popup()->hide();
+
+    // The outgoing text is kept with its layout, formats, folds and undo
+    // history. One that cannot be kept is deleted once it is off screen, so
+    // its highlighter's clean-up is not taken for an edit; QPlainTextEdit
+    // deletes its own initial text itself.
+    QTextDocument* previousText = document();
+    const bool previousCached = cacheCurrentDocument();
+    const bool deletePrevious = !previousCached && previousText->parent() == this;
+    QSyntaxHighlighter* previousHighlighter = previousCached ? nullptr : syntaxHighlighter;
+    syntaxHighlighter = nullptr;
+
     currentDocument = doc;
-    qDebug() << "Setting document:" << currentDocument->getId();
-    qDebug() << "Document content:" << currentDocument->getContent();
-    qDebug() << "Doc content:" << doc->getContent();
+    CachedDocument cached;
+    if (takeCachedDocument(currentDocument, &cached)) {
+        restoreCachedDocument(cached);
+    } else {
+        loadDocument();
+    }
+
+    // The view and everything derived from the text follow the new one
+    updateLineNumberAreaWidth(0);
+    invalidateRemoteCursorGeometry();
+    selectionIndexDirty = true;
+    if (textSearch.isActive()) {
+        textSearch.searchAll(currentDocument ? currentDocument->getContent() : QString());
+        emit searchMatchesChanged(textSearch.matches().size());
+    }
+    if (completionIndex && currentDocument) {
+        completionIndex->addDocument(currentDocument);
+    }
+
+    delete previousHighlighter;
+    if (deletePrevious && previousText != document()) {
+        delete previousText;
+    }
+    trimDocumentCache();
+    emit documentModelChanged();
+}
+
+void CodeEditorWidget::loadDocument()
+{
     if (currentDocument) {
-        // First set the content in the editor
-        ignoreChanges = true;  // Prevent triggering textChanged signal
-        setPlainText(currentDocument->getContent());
-        ignoreChanges = false;
+        qDebug() << "Setting document:" << currentDocument->getId()
+                 << "length:" << currentDocument->length();
+    }
 
-        // Then set up syntax highlighting
-        if (syntaxHighlighter) {
-            delete syntaxHighlighter;
-            syntaxHighlighter = nullptr;
-        }
+    // A new text, filled before it is shown so the view lays it out once
+    QTextDocument* text = new QTextDocument(this);
+    text->setDocumentLayout(new QPlainTextDocumentLayout(text));
+    text->setDefaultFont(document()->defaultFont());
+    text->setDefaultTextOption(document()->defaultTextOption());
+    text->setUndoRedoEnabled(false);
+    connectTextDocument(text);
+    if (currentDocument) {
+        text->setPlainText(currentDocument->getContent());
+    }
+
+    bracketsEnabled = false;
+    foldsPresent = false;
+    ignoreChanges = true;  // The caret moves with the text, not by the user
+    QPlainTextEdit::setDocument(text);
+    ignoreChanges = false;
+    undoManager.clear();
+    richOperationsEnabled = false; // Until the server reports the new document's peers
+    sentRichSteps.clear();
+
+    // Large files keep the highlighter detached and format only the
+    // viewport; QPlainTextEdit already lays out only what it paints
+    largeFileMode = currentDocument && exceedsLargeFileLimits();
+    highlightedFirstBlock = -1;
+    if (largeFileMode) {
+        qDebug() << "Large-file mode for document" << currentDocument->getId();
+    }
+    highlightCurrentLine();
 
+    if (currentDocument) {
         // Create a new syntax highlighter
-        syntaxHighlighter = new SyntaxHighlighter(document());
+        SyntaxHighlighter* highlighter = new SyntaxHighlighter(largeFileMode ? nullptr : document());
+        syntaxHighlighter = highlighter;
+        connect(highlighter, &SyntaxHighlighter::blocksFormatted, this, [this, text](int first, int last) {
+            if (text == document()) {
+                refreshBracketLines(first, last);
+            }
+        });
 
         // Call the method on our custom SyntaxHighlighter class
-        dynamic_cast<SyntaxHighlighter*>(syntaxHighlighter)->setLanguage(currentDocument->getLanguage());
+        highlighter->setLanguage(currentDocument->getLanguage());
+        highlightViewport();
+    }
+
+    // Brackets need every line's formats, which large files never get
+    bracketsEnabled = currentDocument && !largeFileMode;
+    rebuildBracketIndex();
+}
+
+bool CodeEditorWidget::cacheCurrentDocument()
+{
+    // Only texts made by loadDocument() that still match their model
+    if (!currentDocument || document()->parent() != this
+        || document()->characterCount() - 1 != currentDocument->length()) {
+        return false;
+    }
+
+    CachedDocument entry;
+    entry.model = currentDocument;
+    entry.revision = currentDocument->getRevision();
+    entry.text = document();
+    entry.highlighter = syntaxHighlighter;
+    entry.undoManager = std::move(undoManager);
+    entry.bracketIndex = std::move(bracketIndex);
+    entry.largeFileMode = largeFileMode;
+    entry.bracketsEnabled = bracketsEnabled;
+    entry.foldsPresent = foldsPresent;
+    entry.highlightedFirstBlock = highlightedFirstBlock;
+    entry.highlightedLastBlock = highlightedLastBlock;
+    entry.highlightedRevision = highlightedRevision;
+    const QTextCursor cursor = textCursor();
+    entry.cursorAnchor = cursor.anchor();
+    entry.cursorPosition = cursor.position();
+    entry.horizontalScroll = horizontalScrollBar()->value();
+    entry.verticalScroll = verticalScrollBar()->value();
+    documentCache.prepend(entry);
+
+    undoManager = UndoManager();
+    bracketIndex = BracketIndex();
+    return true;
+}
+
+bool CodeEditorWidget::takeCachedDocument(const std::shared_ptr<Document>& doc, CachedDocument* entry)
+{
+    if (!doc) {
+        return false;
+    }
+
+    for (int i = 0; i < documentCache.size(); ++i) {
+        if (documentCache[i].model.lock() != doc) {
+            continue;
+        }
+        *entry = documentCache.takeAt(i);
+
+        // Changed without going through this editor, e.g. a restored version
+        if (entry->revision != doc->getRevision() || entry->text->characterCount() - 1 != doc->length()) {
+            releaseCachedDocument(*entry);
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void CodeEditorWidget::restoreCachedDocument(CachedDocument& entry)
+{
+    // The state goes back before the cursor moves, since the cursor
+    // handlers read the folds and the bracket index
+    syntaxHighlighter = entry.highlighter;
+    undoManager = std::move(entry.undoManager);
+    bracketIndex = std::move(entry.bracketIndex);
+    largeFileMode = entry.largeFileMode;
+    bracketsEnabled = entry.bracketsEnabled;
+    foldsPresent = entry.foldsPresent;
+    highlightedFirstBlock = entry.highlightedFirstBlock;
+    highlightedLastBlock = entry.highlightedLastBlock;
+    highlightedRevision = entry.highlightedRevision;
+    richOperationsEnabled = false; // Until the server reports the document's peers
+    sentRichSteps.clear();
+
+    ignoreChanges = true;
+    QPlainTextEdit::setDocument(entry.text);
+    QTextCursor cursor(entry.text);
+    cursor.setPosition(entry.cursorAnchor);
+    cursor.setPosition(entry.cursorPosition, QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    ignoreChanges = false;
+    horizontalScrollBar()->setValue(entry.horizontalScroll);
+    verticalScrollBar()->setValue(entry.verticalScroll);
+
+    // The language may have changed while the document was hidden; new
+    // formats mean new bracket summaries
+    SyntaxHighlighter* highlighter = dynamic_cast<SyntaxHighlighter*>(syntaxHighlighter);
+    if (highlighter->language() != currentDocument->getLanguage()) {
+        highlighter->setLanguage(currentDocument->getLanguage());
+        rebuildBracketIndex();
+    }
+    highlightViewport();
+    highlightCurrentLine();
+}
+
+void CodeEditorWidget::releaseCachedDocument(const CachedDocument& entry)
+{
+    // Deleted ahead of its text, which may or may not be its parent
+    delete entry.highlighter;
+    delete entry.text;
+}
+
+void CodeEditorWidget::trimDocumentCache()
+{
+    // Most recently shown texts are kept while they fit the budget; those
+    // of closed documents are always dropped
+    QSettings settings;
+    const qint64 budget = settings.value("editor/documentCacheMegabytes", DefaultDocumentCacheMegabytes).toLongLong()
+                          * 1024 * 1024;
+    qint64 used = 0;
+    for (auto it = documentCache.begin(); it != documentCache.end();) {
+        const qint64 cost = qint64(it->text->characterCount()) * CachedBytesPerCharacter;
+        if (it->model.expired() || used + cost > budget) {
+            releaseCachedDocument(*it);
+            it = documentCache.erase(it);
+        } else {
+            used += cost;
+            ++it;
+        }
+    }
+}
+
+void CodeEditorWidget::setCompletionIndex(CompletionIndex* index)
+{
+    completionIndex = index;
+    if (completionIndex && currentDocument) {
+        completionIndex->addDocument(currentDocument);
     }
-    qDebug() << "Setting document done";
-    qDebug() << "Document content:" << currentDocument->getContent();
 }
 
 void CodeEditorWidget::setCollaborationManager(std::shared_ptr<CollaborationManager> manager)
@@ -84,26 +455,406 @@ void CodeEditorWidget::setLanguage(const QString& language)
 {
     currentLanguage = language;
     if (syntaxHighlighter) {
-        // Call the method on our custom SyntaxHighlighter class
-        dynamic_cast<SyntaxHighlighter*>(syntaxHighlighter)->setLanguage(language);
+        // Call the method on our custom SyntaxHighlighter class; a new
+        // language rehighlights, and bracket summaries read the formats
+        SyntaxHighlighter* highlighter = dynamic_cast<SyntaxHighlighter*>(syntaxHighlighter);
+        const bool changed = highlighter->language() != language;
+        highlighter->setLanguage(language);
+        if (changed) {
+            rebuildBracketIndex();
+        }
+        highlightedFirstBlock = -1;
+        highlightViewport();
     }
 }
 
 void CodeEditorWidget::highlightSyntax()
 {
-    if (syntaxHighlighter) {
+    if (largeFileMode) {
+        highlightedFirstBlock = -1;
+        highlightViewport();
+    } else if (syntaxHighlighter) {
         syntaxHighlighter->rehighlight();
+        rebuildBracketIndex();
+    }
+}
+
+bool CodeEditorWidget::exceedsLargeFileLimits() const
+{
+    QSettings settings;
+    const int maxCharacters = settings.value("editor/largeFileCharacters", DefaultLargeFileCharacters).toInt();
+    const int maxLines = settings.value("editor/largeFileLines", DefaultLargeFileLines).toInt();
+    return currentDocument->length() > maxCharacters || blockCount() > maxLines;
+}
+
+void CodeEditorWidget::highlightViewport()
+{
+    if (!largeFileMode || !syntaxHighlighter) {
+        return;
+    }
+
+    QTextBlock block = firstVisibleBlock();
+    const int first = block.blockNumber();
+    const int last = first + visibleLineCount();
+    const int revision = document()->revision();
+    if (first == highlightedFirstBlock && last == highlightedLastBlock && revision == highlightedRevision) {
+        return;
+    }
+    highlightedFirstBlock = first;
+    highlightedLastBlock = last;
+    highlightedRevision = revision;
+
+    // Comment state is followed from the block above, which is formatted
+    // only if it was on screen before; otherwise it starts fresh
+    const SyntaxHighlighter* highlighter = static_cast<const SyntaxHighlighter*>(syntaxHighlighter);
+    int state = block.previous().isValid() ? block.previous().userState() : -1;
+    int dirtyStart = -1;
+    int dirtyEnd = -1;
+    for (int number = first; block.isValid() && number <= last; block = block.next(), ++number) {
+        const QVector<QTextLayout::FormatRange> ranges = highlighter->formatRanges(block.text(), state, &state);
+        block.setUserState(state);
+        if (block.layout()->formats() == ranges) {
+            continue;
+        }
+        block.layout()->setFormats(ranges);
+        if (dirtyStart < 0) {
+            dirtyStart = block.position();
+        }
+        dirtyEnd = block.position() + block.length();
+    }
+
+    // Formats live in the layouts; marking the range dirty repaints it
+    if (dirtyStart >= 0) {
+        ignoreChanges = true;
+        document()->markContentsDirty(dirtyStart, dirtyEnd - dirtyStart);
+        ignoreChanges = false;
+    }
+}
+
+void CodeEditorWidget::updateBracketIndex(int position, int /* charsRemoved */, int charsAdded)
+{
+    if (!bracketsEnabled) {
+        return;
+    }
+
+    // The lines the change covers in the new text; the old text had as many
+    // more as the document has lost since the index last saw it
+    QTextBlock block = document()->findBlock(position);
+    if (!block.isValid()) {
+        rebuildBracketIndex();
+        return;
+    }
+    QTextBlock last = document()->findBlock(position + charsAdded);
+    if (!last.isValid()) {
+        last = document()->lastBlock();
     }
+    const int firstLine = block.blockNumber();
+    const int lastLine = last.blockNumber();
+    const int removedCount = lastLine - firstLine + 1 + bracketIndex.lineCount() - blockCount();
+
+    std::vector<BracketIndex::LineSummary> lines;
+    lines.reserve(lastLine - firstLine + 1);
+    for (int line = firstLine; line <= lastLine && block.isValid(); ++line, block = block.next()) {
+        lines.push_back(bracketSummary(block));
+    }
+    bracketIndex.replaceLines(firstLine, removedCount, lines);
 }
 
-void CodeEditorWidget::updateRemoteCursor(const QString& userId, const QString& username, int position)
+void CodeEditorWidget::refreshBracketLines(int firstLine, int lastLine)
 {
-    // Create or update remote cursor
-    RemoteCursor cursor;
-    cursor.userId = userId;
-    cursor.username = username;
-    cursor.position = position;
+    // Same line count, new formats
+    lastLine = qMin(lastLine, bracketIndex.lineCount() - 1);
+    if (!bracketsEnabled || firstLine < 0 || firstLine > lastLine) {
+        return;
+    }
 
+    std::vector<BracketIndex::LineSummary> lines;
+    lines.reserve(lastLine - firstLine + 1);
+    QTextBlock block = document()->findBlockByNumber(firstLine);
+    for (int line = firstLine; line <= lastLine && block.isValid(); ++line, block = block.next()) {
+        lines.push_back(bracketSummary(block));
+    }
+    bracketIndex.replaceLines(firstLine, int(lines.size()), lines);
+}
+
+void CodeEditorWidget::rebuildBracketIndex()
+{
+    std::vector<BracketIndex::LineSummary> lines;
+    if (bracketsEnabled) {
+        lines.reserve(blockCount());
+        for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+            lines.push_back(bracketSummary(block));
+        }
+    }
+    bracketIndex.reset(lines);
+}
+
+int CodeEditorWidget::matchingBracket(int position) const
+{
+    if (!bracketsEnabled || position < 0 || position >= document()->characterCount() - 1) {
+        return -1;
+    }
+
+    const QTextBlock block = document()->findBlock(position);
+    const QString text = block.text();
+    const int column = position - block.position();
+    const int delta = column < text.length() ? bracketDelta(text.at(column)) : 0;
+    if (!delta || nonCodeMask(block)[column]) {
+        return -1;
+    }
+
+    // Depths are taken just before a character; an opener's partner is the
+    // first closer after it back at its depth, a closer's partner the
+    // opener after the last point before it at its depth less one
+    const int line = block.blockNumber();
+    const int lineDepth = bracketIndex.depthBefore(line);
+    const int target = lineDepth + bracketSummary(block, column).delta - (delta < 0 ? 1 : 0);
+    int partnerLine = line;
+    if (delta > 0) {
+        const QVector<bool> mask = nonCodeMask(block);
+        int depth = target + 1;
+        for (int i = column + 1; i < text.length(); ++i) {
+            if (!mask[i] && (depth += bracketDelta(text.at(i))) <= target) {
+                return block.position() + i;
+            }
+        }
+        partnerLine = bracketIndex.findForward(line + 1, target);
+    } else if (lineDepth + bracketSummary(block, column).minDepth > target) {
+        partnerLine = bracketIndex.findBackward(line - 1, target);
+    }
+    if (partnerLine < 0) {
+        return -1;
+    }
+
+    const QTextBlock partner = document()->findBlockByNumber(partnerLine);
+    const QString partnerText = partner.text();
+    const QVector<bool> mask = nonCodeMask(partner);
+    int depth = bracketIndex.depthBefore(partnerLine);
+    if (delta > 0) {
+        for (int i = 0; i < partnerText.length(); ++i) {
+            if (!mask[i] && (depth += bracketDelta(partnerText.at(i))) <= target) {
+                return partner.position() + i;
+            }
+        }
+        return -1;
+    }
+
+    // The last point at the target depth, then the next bracket after it
+    const int end = partnerLine == line ? column : int(partnerText.length());
+    int lastPoint = -1;
+    for (int i = 0; i < end; ++i) {
+        if (depth <= target) {
+            lastPoint = i;
+        }
+        if (!mask[i]) {
+            depth += bracketDelta(partnerText.at(i));
+        }
+    }
+    for (int i = qMax(0, lastPoint); i < end; ++i) {
+        if (!mask[i] && bracketDelta(partnerText.at(i)) > 0) {
+            return partner.position() + i;
+        }
+    }
+    return -1;
+}
+
+int CodeEditorWidget::foldEnd(int line) const
+{
+    // A line with brackets left open folds up to the line before the one
+    // closing the outermost of them
+    if (!bracketsEnabled || line < 0 || line >= bracketIndex.lineCount()) {
+        return -1;
+    }
+    const BracketIndex::LineSummary summary = bracketIndex.line(line);
+    if (summary.delta <= summary.minDepth) {
+        return -1;
+    }
+    const int closing = bracketIndex.findForward(line + 1, bracketIndex.depthBefore(line) + summary.minDepth);
+    return closing > line + 1 ? closing - 1 : -1;
+}
+
+bool CodeEditorWidget::isFoldable(int line) const
+{
+    return foldEnd(line) >= 0 || isFolded(line);
+}
+
+bool CodeEditorWidget::isFolded(int line) const
+{
+    const QTextBlock next = document()->findBlockByNumber(line + 1);
+    return next.isValid() && !next.isVisible();
+}
+
+void CodeEditorWidget::toggleFold(int line)
+{
+    if (isFolded(line)) {
+        // Everything hidden below the line comes back, nested folds included
+        int last = line + 1;
+        for (QTextBlock block = document()->findBlockByNumber(last + 1); block.isValid() && !block.isVisible();
+             block = block.next()) {
+            ++last;
+        }
+        setLinesVisible(line + 1, last, true);
+        return;
+    }
+
+    const int end = foldEnd(line);
+    if (end < 0) {
+        return;
+    }
+    setLinesVisible(line + 1, end, false);
+    foldsPresent = true;
+
+    // The caret cannot stay on a hidden line
+    const int caretLine = textCursor().blockNumber();
+    if (caretLine > line && caretLine <= end) {
+        QTextCursor cursor = textCursor();
+        cursor.setPosition(document()->findBlockByNumber(line).position());
+        cursor.movePosition(QTextCursor::EndOfBlock);
+        setTextCursor(cursor);
+    }
+}
+
+void CodeEditorWidget::unfoldAll()
+{
+    if (foldsPresent) {
+        setLinesVisible(0, blockCount() - 1, true);
+        foldsPresent = false;
+    }
+}
+
+void CodeEditorWidget::setLinesVisible(int firstLine, int lastLine, bool visible)
+{
+    QTextBlock block = document()->findBlockByNumber(firstLine);
+    if (!block.isValid()) {
+        return;
+    }
+    const int start = block.position();
+    int end = start;
+    for (int line = firstLine; line <= lastLine && block.isValid(); ++line, block = block.next()) {
+        block.setVisible(visible);
+        end = block.position() + block.length();
+    }
+
+    // Hidden blocks take no height, so the layout skips laying them out and
+    // painting them; marking the range dirty makes it relayout
+    ignoreChanges = true;
+    document()->markContentsDirty(start, end - start);
+    ignoreChanges = false;
+    viewport()->update();
+    lineNumberArea->update();
+}
+
+void CodeEditorWidget::updateRemoteCursor(const QString& userId, const QString& username, int position,
+                                          int selectionAnchor)
+{
+    // The position refers to the text after every edit the peer sent before it
+    flushRemoteEdits();
+
+    // Update the existing anchor, or create the cursor
+    QRect oldBounds;
+    auto it = remoteCursors.find(userId);
+    if (it != remoteCursors.end()) {
+        if (it->geometryValid && it->onScreen) {
+            oldBounds = remoteCursorBounds(*it);
+        }
+        updateRemoteSelectionArea(*it);
+        it->username = username;
+        anchors.setPosition(it->anchor, position);
+    } else {
+        RemoteCursor cursor;
+        cursor.userId = userId;
+        cursor.username = username;
+        cursor.anchor = anchors.create(position);
+        cursor.color = colorForUser(userId);
+        it = remoteCursors.insert(userId, cursor);
+    }
+
+    if (selectionAnchor >= 0 && selectionAnchor != position) {
+        if (it->selectionAnchor < 0) {
+            it->selectionAnchor = anchors.create(selectionAnchor);
+        } else {
+            anchors.setPosition(it->selectionAnchor, selectionAnchor);
+        }
+        selectionIndexDirty = true;
+        updateRemoteSelectionArea(*it);
+    } else {
+        releaseRemoteSelection(*it);
+    }
+
+    // Repaint only where the cursor was and where it is now
+    updateRemoteCursorGeometry(*it);
+    if (!oldBounds.isNull()) {
+        viewport()->update(oldBounds);
+    }
+    if (it->onScreen) {
+        viewport()->update(remoteCursorBounds(*it));
+    }
+    emit remoteCursorsChanged();
+}
+
+void CodeEditorWidget::updateRemoteCursorGeometry(RemoteCursor& cursor)
+{
+    cursor.geometryValid = true;
+    cursor.onScreen = false;
+
+    const int position = qBound(0, anchors.position(cursor.anchor), document()->characterCount() - 1);
+    const QTextBlock block = document()->findBlock(position);
+    const QTextBlock first = firstVisibleBlock();
+    if (!block.isValid() || !block.isVisible() || block.blockNumber() < first.blockNumber()) {
+        return;
+    }
+
+    // cursorRect() walks the blocks from the top of the viewport, so blocks
+    // further down than the viewport are skipped without asking
+    if (block.blockNumber() > lastVisibleBlockNumber()) {
+        return;
+    }
+
+    QTextCursor textCursor(document());
+    textCursor.setPosition(position);
+    const QRect caret = QPlainTextEdit::cursorRect(textCursor);
+    if (caret.bottom() < 0 || caret.top() > viewport()->height()) {
+        return;
+    }
+
+    QFont labelFont = font();
+    labelFont.setBold(true);
+    const QFontMetrics labelMetrics(labelFont);
+
+    cursor.onScreen = true;
+    cursor.caretRect = caret;
+    cursor.labelRect = QRect(caret.left(), caret.top() - labelMetrics.height(),
+                             labelMetrics.horizontalAdvance(cursor.username) + 10, labelMetrics.height());
+}
+
+void CodeEditorWidget::invalidateRemoteCursorGeometry()
+{
+    for (RemoteCursor& cursor : remoteCursors) {
+        cursor.geometryValid = false;
+    }
+}
+
+void CodeEditorWidget::scrollRemoteCursorGeometry(int dx, int dy)
+{
+    // Cursors that were off screen may now be visible, so only those are recomputed
+    for (RemoteCursor& cursor : remoteCursors) {
+        if (cursor.geometryValid && cursor.onScreen) {
+            cursor.caretRect.translate(dx, dy);
+            cursor.labelRect.translate(dx, dy);
+        } else {
+            cursor.geometryValid = false;
+        }
+    }
+}
+
+QRect CodeEditorWidget::remoteCursorBounds(const RemoteCursor& cursor)
+{
+    // The caret is drawn with a 2px pen
+    return cursor.caretRect.adjusted(-1, 0, 1, 0).united(cursor.labelRect);
+}
+
+QColor CodeEditorWidget::colorForUser(const QString& userId)
+{
     // Use a fixed set of distinct colors for different users
     static const QColor colors[] = {
          QColor(255, 0, 0),     // Red
@@ -127,20 +878,185 @@ void CodeEditorWidget::updateRemoteCursor(const QString& userId, const QString&
 
         colorIndex = sum % 8;
     }
-    cursor.color = colors[colorIndex];
+    return colors[colorIndex];
+}
 
-    // Store the cursor
-    remoteCursors[userId] = cursor;
+void CodeEditorWidget::removeRemoteCursor(const QString& userId)
+{
+    auto it = remoteCursors.find(userId);
+    if (it != remoteCursors.end()) {
+        if (it->geometryValid && it->onScreen) {
+            viewport()->update(remoteCursorBounds(*it));
+        }
+        releaseRemoteSelection(*it);
+        anchors.remove(it->anchor);
+        remoteCursors.erase(it);
+        emit remoteCursorsChanged();
+    }
+}
 
-    // Trigger repaint
-    viewport()->update();
+QVector<QPair<int, QColor>> CodeEditorWidget::remoteCursorPositions()
+{
+    QVector<QPair<int, QColor>> positions;
+    positions.reserve(remoteCursors.size());
+    for (const RemoteCursor& cursor : std::as_const(remoteCursors)) {
+        positions.append(qMakePair(anchors.position(cursor.anchor), cursor.color));
+    }
+    return positions;
 }
 
-void CodeEditorWidget::removeRemoteCursor(const QString& userId)
+void CodeEditorWidget::releaseRemoteSelection(RemoteCursor& cursor)
+{
+    if (cursor.selectionAnchor < 0) {
+        return;
+    }
+    updateRemoteSelectionArea(cursor);
+    anchors.remove(cursor.selectionAnchor);
+    cursor.selectionAnchor = -1;
+    selectionIndexDirty = true;
+}
+
+void CodeEditorWidget::updateRemoteSelectionArea(const RemoteCursor& cursor)
+{
+    if (cursor.selectionAnchor < 0) {
+        return;
+    }
+    const int position = anchors.position(cursor.anchor);
+    const int other = anchors.position(cursor.selectionAnchor);
+    const QRect area = visibleRangeRect(qMin(position, other), qMax(position, other));
+    if (!area.isNull()) {
+        viewport()->update(area);
+    }
+}
+
+int CodeEditorWidget::visibleLineCount() const
+{
+    return viewport()->height() / qMax(1, fontMetrics().lineSpacing()) + 1;
+}
+
+int CodeEditorWidget::lastVisibleBlockNumber() const
+{
+    // A screenful of lines below the first, unless folds hide some of them
+    if (!foldsPresent) {
+        return firstVisibleBlock().blockNumber() + visibleLineCount();
+    }
+    return cursorForPosition(QPoint(0, viewport()->height())).blockNumber();
+}
+
+QRect CodeEditorWidget::visibleRangeRect(int start, int end)
+{
+    // The full-width band of the viewport holding the visible lines of [start, end]
+    const int maxPosition = document()->characterCount() - 1;
+    const int firstNumber = firstVisibleBlock().blockNumber();
+    const int startNumber = qMax(firstNumber, document()->findBlock(qBound(0, start, maxPosition)).blockNumber());
+    const int endNumber = qMin(lastVisibleBlockNumber(),
+                               document()->findBlock(qBound(0, end, maxPosition)).blockNumber());
+    if (startNumber > endNumber) {
+        return QRect();
+    }
+
+    const QRectF top = blockBoundingGeometry(document()->findBlockByNumber(startNumber)).translated(contentOffset());
+    const QRectF bottom = blockBoundingGeometry(document()->findBlockByNumber(endNumber)).translated(contentOffset());
+    return QRect(0, int(top.top()), viewport()->width(), int(bottom.bottom() - top.top()) + 1);
+}
+
+void CodeEditorWidget::rebuildSelectionIndex()
+{
+    selectionIndexDirty = false;
+    remoteSelections.clear();
+    selectionIndex.clear();
+    for (const RemoteCursor& cursor : remoteCursors) {
+        if (cursor.selectionAnchor < 0) {
+            continue;
+        }
+        const int position = anchors.position(cursor.anchor);
+        const int other = anchors.position(cursor.selectionAnchor);
+        QColor tint = cursor.color;
+        tint.setAlpha(60);
+        selectionIndex.insert(qMin(position, other), qMax(position, other), remoteSelections.size());
+        remoteSelections.append(RemoteSelection{qMin(position, other), qMax(position, other), tint});
+    }
+    selectionIndex.build();
+}
+
+void CodeEditorWidget::collectVisibleBlocks(const QRect& area, QVector<QTextBlock>* blocks, QVector<QRectF>* rects)
+{
+    // Geometry of the blocks in the repainted area, collected in one walk
+    const QPointF offset = contentOffset();
+    QTextBlock block = firstVisibleBlock();
+    QRectF rect = blockBoundingGeometry(block).translated(offset);
+    while (block.isValid() && rect.top() <= area.bottom()) {
+        rect.setHeight(blockBoundingRect(block).height());
+        if (block.isVisible() && rect.bottom() >= area.top()) {
+            blocks->append(block);
+            rects->append(rect);
+        }
+        rect.translate(0, rect.height());
+        block = block.next();
+    }
+}
+
+void CodeEditorWidget::fillTextRange(QPainter& painter, const QVector<QTextBlock>& blocks, const QVector<QRectF>& rects,
+                                     int start, int end, const QColor& color)
+{
+    const qreal textLeft = contentOffset().x() + document()->documentMargin();
+
+    // First collected block that the range reaches
+    auto first = std::lower_bound(blocks.cbegin(), blocks.cend(), start,
+        [](const QTextBlock& b, int position) { return b.position() + b.length() <= position; });
+    for (int i = int(first - blocks.cbegin()); i < blocks.size(); ++i) {
+        const QTextBlock& current = blocks[i];
+        const int blockStart = current.position();
+        const int textEnd = blockStart + current.length() - 1;
+        if (end <= blockStart) {
+            break;
+        }
+
+        // Ends inside the line use the layout; the rest run to the edges
+        qreal left = textLeft;
+        qreal right = viewport()->width();
+        if (start > blockStart) {
+            const int column = start - blockStart;
+            left = rects[i].left() + current.layout()->lineForTextPosition(column).cursorToX(column);
+        }
+        if (end <= textEnd) {
+            const int column = end - blockStart;
+            right = rects[i].left() + current.layout()->lineForTextPosition(column).cursorToX(column);
+        }
+        painter.fillRect(QRectF(left, rects[i].top(), right - left, rects[i].height()), color);
+    }
+}
+
+void CodeEditorWidget::paintRemoteSelections(QPainter& painter, const QVector<QTextBlock>& blocks,
+                                             const QVector<QRectF>& rects)
 {
-    if (remoteCursors.contains(userId)) {
-        remoteCursors.remove(userId);
-        viewport()->update();
+    if (selectionIndexDirty) {
+        rebuildSelectionIndex();
+    }
+    if (selectionIndex.isEmpty()) {
+        return;
+    }
+
+    const int rangeStart = blocks.first().position();
+    const int rangeEnd = blocks.last().position() + blocks.last().length();
+    for (int hit : selectionIndex.overlapping(rangeStart, rangeEnd)) {
+        const RemoteSelection& selection = remoteSelections[hit];
+        fillTextRange(painter, blocks, rects, selection.start, selection.end, selection.color);
+    }
+}
+
+void CodeEditorWidget::paintSearchMatches(QPainter& painter, const QVector<QTextBlock>& blocks,
+                                          const QVector<QRectF>& rects)
+{
+    // Matches ascend, so the visible ones are found by binary search
+    const QVector<TextSearch::Match>& matches = textSearch.matches();
+    const int rangeStart = blocks.first().position();
+    const int rangeEnd = blocks.last().position() + blocks.last().length();
+    auto it = std::lower_bound(matches.cbegin(), matches.cend(), rangeStart,
+        [](const TextSearch::Match& match, int position) { return match.position + match.length <= position; });
+    const QColor tint(255, 200, 0, 90);
+    for (; it != matches.cend() && it->position < rangeEnd; ++it) {
+        fillTextRange(painter, blocks, rects, it->position, it->position + it->length, tint);
     }
 }
 
@@ -149,43 +1065,45 @@ void CodeEditorWidget::paintEvent(QPaintEvent* event)
     // First do the standard painting
     QPlainTextEdit::paintEvent(event);
 
-    // Now draw remote cursors
+    if (remoteCursors.isEmpty() && textSearch.matches().isEmpty()) {
+        return;
+    }
+
     QPainter painter(viewport());
+    QVector<QTextBlock> blocks;
+    QVector<QRectF> blockRects;
+    collectVisibleBlocks(event->rect(), &blocks, &blockRects);
+    if (!blocks.isEmpty()) {
+        paintSearchMatches(painter, blocks, blockRects);
+        paintRemoteSelections(painter, blocks, blockRects);
+    }
 
-    for (const auto& cursor : remoteCursors) {
-        // Get the position of the cursor in the document
-        QTextCursor textCursor = QTextCursor(document());
-        textCursor.setPosition(cursor.position);
+    // Now draw the remote cursors that fall in the repainted area
+    QFont labelFont = painter.font();
+    labelFont.setBold(true);
+    painter.setFont(labelFont);
 
-        // Get the cursor rectangle using the correct method for Qt 6.9.0
-        // Use QPlainTextEdit:: prefix to avoid naming conflict with local variable
-        QRect cursorRectangle = QPlainTextEdit::cursorRect(textCursor);
+    for (RemoteCursor& cursor : remoteCursors) {
+        if (!cursor.geometryValid) {
+            updateRemoteCursorGeometry(cursor);
+        }
+        if (!cursor.onScreen || !event->rect().intersects(remoteCursorBounds(cursor))) {
+            continue;
+        }
 
         // Draw a vertical line for the cursor
         painter.setPen(QPen(cursor.color, 2));
-        painter.drawLine(cursorRectangle.topLeft(), cursorRectangle.bottomLeft());
+        painter.drawLine(cursor.caretRect.topLeft(), cursor.caretRect.bottomLeft());
 
-        // Draw the username above the cursor
-        QFont font = painter.font();
-        font.setBold(true);
-        painter.setFont(font);
-
-        QRect nameRect = cursorRectangle;
-        nameRect.setHeight(fontMetrics().height());
-        nameRect.moveTop(cursorRectangle.top() - nameRect.height());
-        nameRect.setLeft(cursorRectangle.left());
-        nameRect.setWidth(fontMetrics().horizontalAdvance(cursor.username) + 10);
-
-        // Draw a semi-transparent background rectangle
+        // Draw the username above the cursor on a semi-transparent background
         QColor bgColor = cursor.color;
-        bgColor.setAlpha(180); // Make it semi-transparent
-        painter.fillRect(nameRect, bgColor);
+        bgColor.setAlpha(180);
+        painter.fillRect(cursor.labelRect, bgColor);
 
-        // Draw the text with contrasting color
-         // If the background is light, use dark text; if dark, use light text
-         QColor textColor = (bgColor.lightness() > 128) ? Qt::black : Qt::white;
-         painter.setPen(textColor);
-        painter.drawText(nameRect, Qt::AlignCenter, cursor.username);
+        // If the background is light, use dark text; if dark, use light text
+        QColor textColor = (bgColor.lightness() > 128) ? Qt::black : Qt::white;
+        painter.setPen(textColor);
+        painter.drawText(cursor.labelRect, Qt::AlignCenter, cursor.username);
     }
 }
 
@@ -199,12 +1117,39 @@ void CodeEditorWidget::lineNumberAreaPaintEvent(QPaintEvent *event)
     int top = (int) blockBoundingGeometry(block).translated(contentOffset()).top();
     int bottom = top + (int) blockBoundingRect(block).height();
 
+    // Visible lines, collected so their authors are resolved in one pass
+    QVector<QPair<int, int>> lineRanges;
+    QVector<QRect> stripRects;
+
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
             QString number = QString::number(blockNumber + 1);
             painter.setPen(Qt::darkGray);
-            painter.drawText(0, top, lineNumberArea->width(), fontMetrics().height(),
+            painter.drawText(0, top, lineNumberArea->width() - FoldMarkerWidth, fontMetrics().height(),
                              Qt::AlignRight, number);
+
+            // Fold markers: a triangle pointing right when folded, down when open
+            if (isFoldable(blockNumber)) {
+                const int size = qMin(FoldMarkerWidth - 4, fontMetrics().height() / 2);
+                const QPointF center(lineNumberArea->width() - FoldMarkerWidth / 2.0,
+                                     top + fontMetrics().height() / 2.0);
+                QPolygonF marker;
+                if (isFolded(blockNumber)) {
+                    marker << center + QPointF(-size / 2.0, -size / 2.0) << center + QPointF(size / 2.0, 0)
+                           << center + QPointF(-size / 2.0, size / 2.0);
+                } else {
+                    marker << center + QPointF(-size / 2.0, -size / 4.0) << center + QPointF(size / 2.0, -size / 4.0)
+                           << center + QPointF(0, size / 2.0);
+                }
+                painter.setRenderHint(QPainter::Antialiasing);
+                painter.setBrush(Qt::darkGray);
+                painter.drawPolygon(marker);
+            }
+
+            if (authorshipVisible) {
+                lineRanges.append(qMakePair(block.position(), block.length()));
+                stripRects.append(QRect(0, top, AuthorshipStripWidth, bottom - top));
+            }
         }
 
         block = block.next();
@@ -212,6 +1157,72 @@ void CodeEditorWidget::lineNumberAreaPaintEvent(QPaintEvent *event)
         bottom = top + (int) blockBoundingRect(block).height();
         ++blockNumber;
     }
+
+    if (authorshipVisible && currentDocument && !lineRanges.isEmpty()) {
+        QStringList authors = currentDocument->getAuthorship().dominantAuthors(lineRanges);
+        for (int i = 0; i < authors.size(); ++i) {
+            if (!authors[i].isEmpty()) {
+                painter.fillRect(stripRects[i], colorForUser(authors[i]));
+            }
+        }
+    }
+}
+
+void CodeEditorWidget::lineNumberAreaMousePress(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton
+        || event->position().x() < lineNumberArea->width() - FoldMarkerWidth) {
+        return;
+    }
+    const QTextBlock block = cursorForPosition(QPoint(0, int(event->position().y()))).block();
+    if (block.isValid() && isFoldable(block.blockNumber())) {
+        toggleFold(block.blockNumber());
+    }
+}
+
+bool CodeEditorWidget::LineNumberArea::event(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip && codeEditor->authorshipVisible) {
+        codeEditor->showAuthorshipToolTip(static_cast<QHelpEvent*>(event));
+        return true;
+    }
+    return QWidget::event(event);
+}
+
+void CodeEditorWidget::setAuthorshipVisible(bool visible)
+{
+    if (authorshipVisible != visible) {
+        authorshipVisible = visible;
+        updateLineNumberAreaWidth(0);
+        lineNumberArea->update();
+    }
+}
+
+void CodeEditorWidget::showAuthorshipToolTip(QHelpEvent *event)
+{
+    if (!currentDocument) {
+        QToolTip::hideText();
+        return;
+    }
+
+    QTextBlock block = cursorForPosition(QPoint(0, event->pos().y())).block();
+    QVector<QPair<int, int>> range;
+    range.append(qMakePair(block.position(), block.length()));
+    QString author = currentDocument->getAuthorship().dominantAuthors(range).value(0);
+
+    QString text = author.isEmpty()
+        ? QString("Line %1: author unknown").arg(block.blockNumber() + 1)
+        : QString("Line %1: %2").arg(block.blockNumber() + 1).arg(displayNameForUser(author));
+    QToolTip::showText(event->globalPos(), text, lineNumberArea);
+}
+
+QString CodeEditorWidget::displayNameForUser(const QString& userId) const
+{
+    if (userId == localUserId) {
+        return "You";
+    }
+    auto it = remoteCursors.constFind(userId);
+    return it != remoteCursors.constEnd() ? it->username : userId;
 }
 
 int CodeEditorWidget::lineNumberAreaWidth() const
@@ -223,7 +1234,10 @@ int CodeEditorWidget::lineNumberAreaWidth() const
         ++digits;
     }
 
-    int space = 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
+    int space = 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits + FoldMarkerWidth;
+    if (authorshipVisible) {
+        space += AuthorshipStripWidth + 2;
+    }
     return space;
 }
 
@@ -234,9 +1248,10 @@ void CodeEditorWidget::updateLineNumberAreaWidth(int /* newBlockCount */)
 
 void CodeEditorWidget::updateLineNumberArea(const QRect &rect, int dy)
 {
-    if (dy)
+    if (dy) {
         lineNumberArea->scroll(0, dy);
-    else
+        scrollRemoteCursorGeometry(0, dy);
+    } else
         lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
 
     if (rect.contains(viewport()->rect()))
@@ -246,6 +1261,7 @@ void CodeEditorWidget::updateLineNumberArea(const QRect &rect, int dy)
 void CodeEditorWidget::resizeEvent(QResizeEvent *e)
 {
     QPlainTextEdit::resizeEvent(e);
+    invalidateRemoteCursorGeometry();
 
     QRect cr = contentsRect();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
@@ -255,7 +1271,8 @@ void CodeEditorWidget::highlightCurrentLine()
 {
     QList<QTextEdit::ExtraSelection> extraSelections;
 
-    if (!isReadOnly()) {
+    // Skipped for large files, where it repaints a full-width band on every move
+    if (!isReadOnly() && !largeFileMode) {
         QTextEdit::ExtraSelection selection;
 
         // Use a light grey color for the current line highlight
@@ -268,15 +1285,73 @@ void CodeEditorWidget::highlightCurrentLine()
         extraSelections.append(selection);
     }
 
+    // The bracket at the caret, or just before it, and its partner
+    const int position = textCursor().position();
+    int bracket = position;
+    int partner = matchingBracket(bracket);
+    if (partner < 0 && position > 0) {
+        bracket = position - 1;
+        partner = matchingBracket(bracket);
+    }
+    if (partner >= 0) {
+        for (int at : {bracket, partner}) {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(QColor(120, 200, 120, 120));
+            selection.cursor = QTextCursor(document());
+            selection.cursor.setPosition(at);
+            selection.cursor.setPosition(at + 1, QTextCursor::KeepAnchor);
+            extraSelections.append(selection);
+        }
+    }
+
     setExtraSelections(extraSelections);
 }
 
 void CodeEditorWidget::keyPressEvent(QKeyEvent *event)
 {
+    // Local input applies on top of everything already received
+    flushRemoteEdits();
+
+    // Keys that choose or dismiss a completion are left to the popup
+    if (completer->popup()->isVisible()) {
+        switch (event->key()) {
+        case Qt::Key_Enter:
+        case Qt::Key_Return:
+        case Qt::Key_Escape:
+        case Qt::Key_Tab:
+        case Qt::Key_Backtab:
+            event->ignore();
+            return;
+        default:
+            break;
+        }
+    }
+
     // Handle special keys for editing
-    if (event->key() == Qt::Key_Tab) {
-        // Insert 4 spaces instead of a tab
-        textCursor().insertText("    ");
+    if (event->key() == Qt::Key_Space && (event->modifiers() & Qt::ControlModifier)) {
+        updateCompletion(true);
+        event->accept();
+    } else if (event->matches(QKeySequence::Undo)) {
+        undoLocalEdit();
+        event->accept();
+    } else if (event->matches(QKeySequence::Redo)) {
+        redoLocalEdit();
+        event->accept();
+    } else if ((event->modifiers() & Qt::AltModifier)
+               && (event->key() == Qt::Key_Up || event->key() == Qt::Key_Down)) {
+        moveSelectedLines(event->key() == Qt::Key_Up ? -1 : 1);
+        event->accept();
+    } else if (event->key() == Qt::Key_Backtab) {
+        indentSelectedLines(false);
+        event->accept();
+    } else if (event->key() == Qt::Key_Tab) {
+        QTextCursor cursor = textCursor();
+        if (document()->findBlock(cursor.selectionStart()) != document()->findBlock(cursor.selectionEnd())) {
+            indentSelectedLines(true);
+        } else {
+            // Insert 4 spaces instead of a tab
+            cursor.insertText(IndentUnit);
+        }
         event->accept();
     } else if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
         // Auto-indent: copy whitespace from the current line
@@ -293,9 +1368,11 @@ void CodeEditorWidget::keyPressEvent(QKeyEvent *event)
             }
         }
 
-        // Add extra indent after brackets
-        if (currentLine.contains('{') && !currentLine.contains('}')) {
-            indent += "    ";
+        // One level deeper when a bracket before the caret is left open
+        // (brackets in strings and comments do not count)
+        const BracketIndex::LineSummary before = bracketSummary(cursor.block(), cursor.positionInBlock());
+        if (before.delta > before.minDepth) {
+            indent += IndentUnit;
         }
 
         // Insert newline with indent
@@ -303,47 +1380,260 @@ void CodeEditorWidget::keyPressEvent(QKeyEvent *event)
         textCursor().insertText(indent);
     } else {
         QPlainTextEdit::keyPressEvent(event);
+
+        // Typing a word offers completions; other keys refresh an open list
+        const QString text = event->text();
+        if ((!text.isEmpty() && CompletionIndex::isWordCharacter(text.back())) || completer->popup()->isVisible()) {
+            updateCompletion(false);
+        }
     }
 }
 
-void CodeEditorWidget::onTextChanged()
+QString CodeEditorWidget::wordBeforeCursor() const
+{
+    const QTextCursor cursor = textCursor();
+    const QString text = cursor.block().text();
+    int start = cursor.positionInBlock();
+    while (start > 0 && CompletionIndex::isWordCharacter(text.at(start - 1))) {
+        --start;
+    }
+    // Numbers are not completed
+    if (start < cursor.positionInBlock() && text.at(start).isDigit()) {
+        return QString();
+    }
+    return text.mid(start, cursor.positionInBlock() - start);
+}
+
+void CodeEditorWidget::updateCompletion(bool forced)
+{
+    const QString prefix = wordBeforeCursor();
+    QStringList words;
+    if (completionIndex && currentDocument && (forced || prefix.length() >= MinCompletionPrefix)) {
+        words = completionIndex->complete(prefix, currentDocument.get(), MaxCompletions);
+    }
+    if (words.isEmpty()) {
+        completer->popup()->hide();
+        return;
+    }
+
+    completionModel->setStringList(words);
+    completer->setCompletionPrefix(prefix);
+    completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
+    QRect rect = cursorRect();
+    rect.setWidth(completer->popup()->sizeHintForColumn(0)
+                  + completer->popup()->verticalScrollBar()->sizeHint().width());
+    completer->complete(rect);
+}
+
+void CodeEditorWidget::insertCompletion(const QString& word)
+{
+    QTextCursor cursor = textCursor();
+    cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, int(wordBeforeCursor().length()));
+    cursor.insertText(word);
+    setTextCursor(cursor);
+}
+
+void CodeEditorWidget::onContentsChange(int position, int charsRemoved, int charsAdded)
 {
     if (ignoreChanges || !currentDocument) return;
 
-    // Track local changes
+    // QTextDocument reports format-only updates (e.g. from the highlighter) as
+    // equal removal and addition, and counts the final block separator in
+    // whole-document edits, so clamp to the real text before trusting it
+    const int editorLength = document()->characterCount() - 1;
+    const int modelLength = currentDocument->length();
+    charsRemoved = qMin(charsRemoved, modelLength - position);
+    charsAdded = qMin(charsAdded, editorLength - position);
+
+    if (position < 0 || charsRemoved < 0 || charsAdded < 0
+        || modelLength - charsRemoved + charsAdded != editorLength) {
+        resynchronizeDocument();
+        return;
+    }
+
+    QString inserted = textRange(position, charsAdded);
+    if (charsRemoved == charsAdded && inserted == currentDocument->textAt(position, charsRemoved)) {
+        return;
+    }
+
+    // Apply only the changed range to the document model
+    const QString removed = applyingUndo ? QString() : currentDocument->textAt(position, charsRemoved);
+    if (!currentDocument->applyEdit(position, charsRemoved, inserted, localUserId)) {
+        resynchronizeDocument();
+        return;
+    }
+    if (!applyingUndo) {
+        undoManager.recordLocal(position, removed, inserted);
+    }
+    anchors.applyEdit(position, charsRemoved, charsAdded);
+    expectedCursorAfterEdit = position + charsAdded;
+
+    DocumentChange change;
+    change.position = position;
+    change.removedLength = charsRemoved;
+    change.insertedText = inserted;
+    change.revision = currentDocument->getRevision();
+    change.userId = localUserId;
+    publishLocalEdit(change);
+}
+
+void CodeEditorWidget::resynchronizeDocument()
+{
+    // Fallback when the reported range cannot be trusted: diff against the model
+    qDebug() << "Resynchronizing document model with editor content";
+    undoManager.clear(); // Recorded positions can no longer be trusted
+    const QVector<DocumentChange> changes = currentDocument->replaceContent(toPlainText(), localUserId);
+    for (const DocumentChange& change : changes) {
+        anchors.applyEdit(change.position, change.removedLength, change.insertedText.length());
+        publishLocalEdit(change);
+    }
+}
+
+void CodeEditorWidget::publishLocalEdit(const DocumentChange& change)
+{
+    EditOperation op;
+    op.userId = localUserId;
+    op.documentId = currentDocument->getId();
+    op.position = change.position;
+    op.deletionLength = change.removedLength;
+    op.insertion = change.insertedText;
+    publishOperation(op);
+}
+
+void CodeEditorWidget::publishOperation(const EditOperation& op)
+{
+    emit localEditApplied(op);
+
+    static const QMetaMethod editorContentChangedSignal =
+        QMetaMethod::fromSignal(&CodeEditorWidget::editorContentChanged);
+    if (isSignalConnected(editorContentChangedSignal)) {
+        emit editorContentChanged(currentDocument->getContent());
+    }
+
+    // Send the operation to the collaboration manager
+    if (collaborationManager) {
+        collaborationManager->synchronizeChanges(op);
+    }
+}
+
+QString CodeEditorWidget::textRange(int position, int length) const
+{
+    if (length <= 0) {
+        return QString();
+    }
+
+    QTextCursor cursor(document());
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+
+    // selectedText() uses Unicode separators where toPlainText() uses '\n'
+    QString text = cursor.selectedText();
+    text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+    return text;
+}
+
+void CodeEditorWidget::replaceContent(const QString& content, bool publish)
+{
+    flushRemoteEdits();
+    if (!currentDocument) return;
+
+    // The change is applied here either way, so the editor signals are muted
     ignoreChanges = true;
-    QString content = toPlainText();
+    if (document()->characterCount() - 1 != currentDocument->length()) {
+        // Editor and model are out of step, so there is nothing to diff against
+        setPlainText(content);
+        currentDocument->replaceContent(content);
+        undoManager.clear();
+        ignoreChanges = false;
+        return;
+    }
 
-    // Only update if content actually changed
-    if (content != currentDocument->getContent()) {
-        // Notify about content changes
-        emit editorContentChanged(content);
+    // Only the ranges that differ are rewritten, in one undo step, so the
+    // caret, remote cursors and undo history survive the update
+    const QVector<DocumentChange> changes =
+        currentDocument->replaceContent(content, publish ? localUserId : QString());
+    QTextCursor cursor(document());
+    cursor.beginEditBlock();
+    for (const DocumentChange& change : changes) {
+        cursor.setPosition(change.position);
+        cursor.setPosition(change.position + change.removedLength, QTextCursor::KeepAnchor);
+        cursor.insertText(change.insertedText);
+        anchors.applyEdit(change.position, change.removedLength, change.insertedText.length());
+        undoManager.transform(change.position, change.removedLength, change.insertedText.length());
+    }
+    cursor.endEditBlock();
+    ignoreChanges = false;
 
-        // Update document content
-        currentDocument->setContent(content);
+    if (publish) {
+        for (const DocumentChange& change : changes) {
+            publishLocalEdit(change);
+        }
+    }
+}
 
-        // Create an edit operation
-        if (collaborationManager) {
-            EditOperation op;
-            op.userId = "local";
-            op.documentId = currentDocument->getId();
-            op.position = textCursor().position();
-            
-            // For the prototype, we'll just send the entire content as an insertion
-            // In a real implementation, we would calculate the actual changes
-            op.insertion = content;
-            op.deletionLength = 0;
+void CodeEditorWidget::undoLocalEdit()
+{
+    flushRemoteEdits();
+    QVector<UndoManager::Edit> edits;
+    if (!isReadOnly() && undoManager.undo(&edits)) {
+        for (const UndoManager::Edit& edit : edits) {
+            applyUndoEdit(edit);
+        }
+    }
+}
 
-            // Send the operation to the collaboration manager
-            collaborationManager->synchronizeChanges(op);
+void CodeEditorWidget::redoLocalEdit()
+{
+    flushRemoteEdits();
+    QVector<UndoManager::Edit> edits;
+    if (!isReadOnly() && undoManager.redo(&edits)) {
+        for (const UndoManager::Edit& edit : edits) {
+            applyUndoEdit(edit);
         }
     }
+}
 
-    ignoreChanges = false;
+void CodeEditorWidget::applyUndoEdit(const UndoManager::Edit& edit)
+{
+    if (!currentDocument || edit.position + edit.removedLength > currentDocument->length()) {
+        undoManager.clear();
+        return;
+    }
+
+    // Goes through onContentsChange like typing, so it reaches the model and
+    // peers, but is not recorded as a new step
+    applyingUndo = true;
+    QTextCursor cursor(document());
+    cursor.setPosition(edit.position);
+    cursor.setPosition(edit.position + edit.removedLength, QTextCursor::KeepAnchor);
+    cursor.insertText(edit.insertedText);
+    applyingUndo = false;
+
+    cursor.setPosition(edit.position + edit.insertedText.length());
+    setTextCursor(cursor);
 }
 
 void CodeEditorWidget::onCursorPositionChanged()
 {
+    // A caret carried along by a remote edit, or left right after a local
+    // one, is where peers already place it
+    QTextCursor cursor = textCursor();
+    cursorMoveFromEdit = !cursor.hasSelection()
+        && (ignoreChanges || cursor.position() == expectedCursorAfterEdit);
+    expectedCursorAfterEdit = -1;
+
+    // A caret moved onto a folded line (e.g. by find) opens the fold
+    if (!cursor.block().isVisible()) {
+        QTextBlock header = cursor.block();
+        while (header.isValid() && !header.isVisible()) {
+            header = header.previous();
+        }
+        if (header.isValid()) {
+            toggleFold(header.blockNumber());
+        }
+    }
+
     // Update UI
     highlightCurrentLine();
 
@@ -361,51 +1651,376 @@ void CodeEditorWidget::mouseReleaseEvent(QMouseEvent *event)
     QPlainTextEdit::mouseReleaseEvent(event);
 }
 
+void CodeEditorWidget::inputMethodEvent(QInputMethodEvent *event)
+{
+    flushRemoteEdits();
+    QPlainTextEdit::inputMethodEvent(event);
+}
+
+void CodeEditorWidget::insertFromMimeData(const QMimeData *source)
+{
+    // Paste and drop edit the text without a key press
+    flushRemoteEdits();
+    QPlainTextEdit::insertFromMimeData(source);
+}
+
+bool CodeEditorWidget::applyLocalOperation(const EditOperation& operation)
+{
+    flushRemoteEdits();
+    if (!currentDocument || isReadOnly() || ignoreChanges) return false;
+
+    EditOperation op = operation;
+    op.userId = localUserId;
+    op.documentId = currentDocument->getId();
+    const QVector<EditOperation> steps = op.expand(
+        [this](int position, int length) { return currentDocument->textAt(position, length); },
+        currentDocument->length());
+    if (steps.isEmpty()) {
+        return false;
+    }
+
+    applyOperationSteps(steps);
+
+    // Peers that all understand the kind get it as is, otherwise as plain steps
+    if (!op.isRich()) {
+        publishOperation(op);
+    } else if (richOperationsEnabled) {
+        // The steps are kept until the server has had time to reject it
+        op.sequence = ++lastRichSequence;
+        sentRichSteps.insert(op.sequence, steps);
+        if (sentRichSteps.size() > MaxSentRichOperations) {
+            sentRichSteps.erase(sentRichSteps.begin());
+        }
+        publishOperation(op);
+    } else {
+        for (const EditOperation& step : steps) {
+            publishOperation(step);
+        }
+    }
+    return true;
+}
+
+bool CodeEditorWidget::resendAsSteps(int sequence)
+{
+    // The steps are in the text here already; only peers still need them
+    auto it = sentRichSteps.find(sequence);
+    if (it == sentRichSteps.end()) {
+        return false;
+    }
+    const QVector<EditOperation> steps = it.value();
+    sentRichSteps.erase(it);
+    for (const EditOperation& step : steps) {
+        publishOperation(step);
+    }
+    return true;
+}
+
+void CodeEditorWidget::applyOperationSteps(const QVector<EditOperation>& steps)
+{
+    // One edit block for the editor; the model, anchors and undo history
+    // take the steps one at a time, and the operation is one undo step
+    ignoreChanges = true;
+    undoManager.beginCompound();
+    QTextCursor cursor(document());
+    cursor.beginEditBlock();
+    for (const EditOperation& step : steps) {
+        const QString removed = currentDocument->textAt(step.position, step.deletionLength);
+        cursor.setPosition(step.position);
+        cursor.setPosition(step.position + step.deletionLength, QTextCursor::KeepAnchor);
+        cursor.insertText(step.insertion);
+
+        currentDocument->applyEdit(step.position, step.deletionLength, step.insertion, localUserId);
+        anchors.applyEdit(step.position, step.deletionLength, step.insertion.length());
+        undoManager.recordLocal(step.position, removed, step.insertion);
+    }
+    cursor.endEditBlock();
+    undoManager.endCompound();
+    ignoreChanges = false;
+}
+
+void CodeEditorWidget::indentSelectedLines(bool indent)
+{
+    QTextCursor cursor = textCursor();
+    QTextBlock first = document()->findBlock(cursor.selectionStart());
+    QTextBlock last = document()->findBlock(cursor.selectionEnd());
+    // A selection that ends at a line start leaves that line alone
+    if (last != first && cursor.selectionEnd() == last.position()) {
+        last = last.previous();
+    }
+
+    EditOperation op;
+    op.kind = indent ? EditOperation::Kind::Indent : EditOperation::Kind::Outdent;
+    op.position = first.position();
+    op.deletionLength = last.position() + last.length() - 1 - first.position();
+    op.insertion = IndentUnit;
+    if (!applyLocalOperation(op)) {
+        return;
+    }
+
+    // Keep the whole lines selected
+    if (cursor.hasSelection()) {
+        cursor.setPosition(first.position());
+        cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+        setTextCursor(cursor);
+    }
+}
+
+void CodeEditorWidget::moveSelectedLines(int direction)
+{
+    QTextCursor cursor = textCursor();
+    QTextBlock first = document()->findBlock(cursor.selectionStart());
+    QTextBlock last = document()->findBlock(cursor.selectionEnd());
+    if (last != first && cursor.selectionEnd() == last.position()) {
+        last = last.previous();
+    }
+    const QTextBlock neighbour = direction < 0 ? first.previous() : last.next();
+    if (!neighbour.isValid()) {
+        return;
+    }
+
+    const int textLength = document()->characterCount() - 1;
+    const int start = first.position();
+    const int linesEnd = last.position() + last.length() - 1; // Before the last line break
+    const int neighbourEnd = neighbour.position() + neighbour.length() - 1;
+    const int newStart = direction < 0 ? neighbour.position() : start + neighbour.length();
+
+    EditOperation op;
+    if (linesEnd < textLength && neighbourEnd < textLength) {
+        // Whole lines with their line breaks move past the neighbouring line
+        op.kind = EditOperation::Kind::MoveRange;
+        op.position = start;
+        op.deletionLength = linesEnd + 1 - start;
+        op.targetPosition = direction < 0 ? neighbour.position() : neighbourEnd + 1;
+    } else {
+        // The last line has no line break to carry, so the two are swapped as text
+        const QString lines = currentDocument->textAt(start, linesEnd - start);
+        const QString other = currentDocument->textAt(neighbour.position(), neighbourEnd - neighbour.position());
+        op.position = qMin(start, neighbour.position());
+        op.deletionLength = qMax(linesEnd, neighbourEnd) - op.position;
+        op.insertion = direction < 0 ? lines + QLatin1Char('\n') + other : other + QLatin1Char('\n') + lines;
+    }
+
+    const int anchor = cursor.anchor() - start + newStart;
+    const int position = cursor.position() - start + newStart;
+    if (applyLocalOperation(op)) {
+        cursor.setPosition(anchor);
+        cursor.setPosition(position, QTextCursor::KeepAnchor);
+        setTextCursor(cursor);
+    }
+}
+
 void CodeEditorWidget::applyRemoteEdit(const EditOperation& operation)
 {
     if (!currentDocument || ignoreChanges) return;
 
-    // Set flag to avoid triggering local change events
-    ignoreChanges = true;
+    // A burst of operations costs one relayout, rehighlight and repaint
+    pendingRemoteEdits.append(operation);
+    if (!remoteEditTimer->isActive()) {
+        remoteEditTimer->start();
+    }
+}
 
-    // Get current content
-    QString content = toPlainText();
+void CodeEditorWidget::flushRemoteEdits()
+{
+    remoteEditTimer->stop();
+    if (pendingRemoteEdits.isEmpty() || !currentDocument) {
+        pendingRemoteEdits.clear();
+        return;
+    }
+    const QVector<EditOperation> operations = std::move(pendingRemoteEdits);
+    pendingRemoteEdits.clear();
 
-    // Apply the edit operation
-    if (operation.position >= 0 && operation.position <= content.length()) {
-        // Create a new text cursor
-        QTextCursor cursor = textCursor();
-        
-        // Store current cursor position and selection
-        int oldPosition = cursor.position();
-        int oldAnchor = cursor.anchor();
-        
-        // Move cursor to the operation position
-        cursor.setPosition(operation.position);
-        
-        // If there's a deletion, select the text to be deleted
-        if (operation.deletionLength > 0) {
-            cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, operation.deletionLength);
-        }
-        
-        // Insert the new text (this will replace the selected text if any)
-        cursor.insertText(operation.insertion);
-        
-        // Restore cursor position if it was within the edited region
-        if (oldPosition > operation.position) {
-            int newPosition = oldPosition;
-            if (oldPosition > operation.position + operation.deletionLength) {
-                // Cursor was after the deleted text
-                newPosition = oldPosition - operation.deletionLength + operation.insertion.length();
-            } else if (oldPosition > operation.position) {
-                // Cursor was within the deleted text
-                newPosition = operation.position + operation.insertion.length();
+    // The editor takes the whole batch in one edit block, so contentsChange
+    // and the highlighter see a single merged range. The model, anchors and
+    // undo history still take each operation in order. The local cursor is
+    // a QTextCursor on the same document and shifts along with the edits.
+    ignoreChanges = true;
+    QTextCursor cursor(document());
+    cursor.beginEditBlock();
+    for (const EditOperation& operation : operations) {
+        if (operation.isRich()) {
+            const QVector<EditOperation> steps = operation.expand(
+                [this](int position, int length) { return currentDocument->textAt(position, length); },
+                currentDocument->length());
+            for (const EditOperation& step : steps) {
+                if (applyRemoteStep(cursor, step, operation.userId)) {
+                    emit remoteEditApplied(operation.userId, step.position, step.insertion.length());
+                }
             }
-            cursor.setPosition(newPosition);
-            setTextCursor(cursor);
+            continue;
         }
-    }
 
-    // Reset flag
+        if (!applyRemoteStep(cursor, operation, operation.userId)) {
+            continue;
+        }
+        emit remoteEditApplied(operation.userId, operation.position, operation.insertion.length());
+
+        // Put the author's cursor after their change
+        auto author = remoteCursors.find(operation.userId);
+        if (author != remoteCursors.end()) {
+            releaseRemoteSelection(*author); // Typing replaces the selection
+            anchors.setPosition(author->anchor, operation.position + operation.insertion.length());
+        }
+    }
+    cursor.endEditBlock();
     ignoreChanges = false;
-}
\ No newline at end of file
+}
+
+bool CodeEditorWidget::applyRemoteStep(QTextCursor& cursor, const EditOperation& step, const QString& userId)
+{
+    // Bounds come from the model, which is in step with the editor
+    if (step.position < 0 || step.deletionLength < 0
+        || step.position + step.deletionLength > currentDocument->length()) {
+        qDebug() << "Dropping remote edit outside the document at" << step.position;
+        return false;
+    }
+
+    cursor.setPosition(step.position);
+    cursor.setPosition(step.position + step.deletionLength, QTextCursor::KeepAnchor);
+    cursor.insertText(step.insertion);
+
+    currentDocument->applyEdit(step.position, step.deletionLength, step.insertion, userId);
+    anchors.applyEdit(step.position, step.deletionLength, step.insertion.length());
+    undoManager.transform(step.position, step.deletionLength, step.insertion.length());
+    return true;
+}
+
+bool CodeEditorWidget::setSearchQuery(const TextSearch::Query& query)
+{
+    const bool valid = textSearch.setQuery(query);
+    if (textSearch.isActive()) {
+        textSearch.searchAll(currentDocument ? currentDocument->getContent() : toPlainText());
+    }
+    viewport()->update();
+    emit searchMatchesChanged(textSearch.matches().size());
+    return valid;
+}
+
+void CodeEditorWidget::clearSearch()
+{
+    textSearch.clear();
+    viewport()->update();
+    emit searchMatchesChanged(0);
+}
+
+void CodeEditorWidget::updateSearchAfterEdit(int position, int charsRemoved, int charsAdded)
+{
+    if (!textSearch.isActive()) {
+        return;
+    }
+
+    const int length = document()->characterCount() - 1;
+    if (position == 0 && charsAdded >= length) {
+        // The whole text was replaced
+        textSearch.searchAll(toPlainText());
+    } else {
+        // Re-search the edited lines only; later matches are shifted
+        charsAdded = qMin(charsAdded, length - position);
+        const int windowStart = document()->findBlock(position).position();
+        const QTextBlock endBlock = document()->findBlock(position + charsAdded);
+        const int windowEnd = endBlock.isValid() ? endBlock.position() + endBlock.length() - 1 : length;
+        textSearch.applyEdit(position, charsRemoved, charsAdded, windowStart, windowEnd,
+                             [this](int start, int count) { return textRange(start, count); });
+    }
+    emit searchMatchesChanged(textSearch.matches().size());
+}
+
+bool CodeEditorWidget::findNext(bool backward)
+{
+    const QVector<TextSearch::Match>& matches = textSearch.matches();
+    if (matches.isEmpty()) {
+        return false;
+    }
+
+    // Search from the end of the selection, or its start going backwards, wrapping around
+    QTextCursor cursor = textCursor();
+    const int from = backward ? cursor.selectionStart() : cursor.selectionEnd();
+    auto it = std::lower_bound(matches.cbegin(), matches.cend(), from,
+        [](const TextSearch::Match& match, int position) { return match.position < position; });
+    if (backward) {
+        it = it == matches.cbegin() ? matches.cend() - 1 : it - 1;
+    } else if (it == matches.cend()) {
+        it = matches.cbegin();
+    }
+
+    cursor.setPosition(it->position);
+    cursor.setPosition(it->position + it->length, QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    return true;
+}
+
+bool CodeEditorWidget::replaceCurrent(const QString& replacement)
+{
+    if (!currentDocument || isReadOnly()) {
+        return false;
+    }
+    flushRemoteEdits();
+
+    // Only a selection that is exactly a match is replaced; otherwise go to the next one
+    const QVector<TextSearch::Match>& matches = textSearch.matches();
+    QTextCursor cursor = textCursor();
+    const int start = cursor.selectionStart();
+    auto it = std::lower_bound(matches.cbegin(), matches.cend(), start,
+        [](const TextSearch::Match& match, int position) { return match.position < position; });
+    if (it == matches.cend() || it->position != start || it->length != cursor.selectionEnd() - start) {
+        return findNext();
+    }
+
+    EditOperation op;
+    op.position = start;
+    op.deletionLength = it->length;
+    const QString text = textSearch.query().regularExpression ? currentDocument->getContent() : QString();
+    op.insertion = textSearch.replacementFor(text, *it, replacement);
+    if (!applyLocalOperation(op)) {
+        return false;
+    }
+
+    cursor.setPosition(start + op.insertion.length());
+    setTextCursor(cursor);
+    findNext();
+    return true;
+}
+
+int CodeEditorWidget::replaceAll(const QString& replacement)
+{
+    if (!currentDocument || isReadOnly()) {
+        return 0;
+    }
+    flushRemoteEdits();
+
+    const QVector<TextSearch::Match> matches = textSearch.matches();
+    if (matches.isEmpty()) {
+        return 0;
+    }
+
+    // Regex replacements can differ per match; literal ones never read the text
+    const QString text = textSearch.query().regularExpression ? currentDocument->getContent() : QString();
+    QVector<QString> replacements;
+    replacements.reserve(matches.size());
+    bool sameLength = true;
+    bool sameReplacement = true;
+    for (const TextSearch::Match& match : matches) {
+        replacements.append(textSearch.replacementFor(text, match, replacement));
+        sameLength = sameLength && match.length == matches.first().length;
+        sameReplacement = sameReplacement && replacements.last() == replacements.first();
+    }
+
+    // One ReplaceAll carries every position; lengths and texts are listed
+    // per match only when they differ
+    EditOperation op;
+    op.kind = EditOperation::Kind::ReplaceAll;
+    op.position = matches.first().position;
+    op.deletionLength = matches.first().length;
+    op.insertion = replacements.first();
+    op.positions.reserve(matches.size());
+    for (const TextSearch::Match& match : matches) {
+        op.positions.append(match.position);
+        if (!sameLength) {
+            op.lengths.append(match.length);
+        }
+    }
+    if (!sameReplacement) {
+        op.replacements = replacements;
+    }
+    return applyLocalOperation(op) ? matches.size() : 0;
+}
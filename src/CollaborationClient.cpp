@@ -77,6 +77,22 @@ bool CollaborationClient::isConnected() const
 void CollaborationClient::setUser(std::shared_ptr<User> user)
 {
     currentUser = user;
+    if (isConnected()) {
+        sendHello();
+    }
+}
+
+void CollaborationClient::sendHello()
+{
+    if (!currentUser) {
+        return;
+    }
+
+    // Tells the server which user this connection belongs to
+    QJsonObject payload;
+    payload["userId"] = currentUser->getUserId();
+    payload["username"] = currentUser->getUsername();
+    sendMessage("hello", payload);
 }
 
 void CollaborationClient::setDocument(std::shared_ptr<Document> document)
@@ -96,6 +112,7 @@ void CollaborationClient::joinDocument(const QString& documentId)
     payload["documentId"] = documentId;
     payload["userId"] = currentUser->getUserId();
     payload["username"] = currentUser->getUsername();
+    payload["capabilities"] = QJsonArray{QStringLiteral("rich_operations")};
 
     sendMessage("join", payload);
     isDocumentJoined = true;
@@ -141,7 +158,7 @@ void CollaborationClient::sendEdit(const EditOperation& operation)
     sendMessage("edit", payload);
 }
 
-void CollaborationClient::sendCursorPosition(int position)
+void CollaborationClient::sendCursorPosition(int position, int anchor)
 {
     if (!isDocumentJoined || !currentUser || !currentDocument) {
         return;
@@ -153,6 +170,11 @@ void CollaborationClient::sendCursorPosition(int position)
     payload["userId"] = currentUser->getUserId();
     payload["username"] = currentUser->getUsername();
     payload["position"] = position;
+
+    // Peers draw the selection between the anchor and the cursor
+    if (anchor >= 0 && anchor != position) {
+        payload["anchor"] = anchor;
+    }
     
     // Send the message
     sendMessage("cursor", payload);
@@ -190,8 +212,62 @@ void CollaborationClient::requestLatestContent(const QString& documentId)
     sendMessage("request_content", payload);
 }
 
+void CollaborationClient::sendContentSync(const QString& documentId, const QString& content)
+{
+    if (!isDocumentJoined) {
+        return;
+    }
+
+    // Construct a reply to the server's content_sync_request
+    QJsonObject payload;
+    payload["documentId"] = documentId;
+    payload["content"] = content;
+
+    // Send the message
+    sendMessage("content_sync", payload);
+}
+
+void CollaborationClient::requestCatalog(const QString& ownerId, const QString& sharedWithUserId,
+                                         const QString& titleFilter, int offset, int limit, int requestId)
+{
+    if (!currentUser) {
+        emit error("No user is set");
+        return;
+    }
+
+    // Construct a catalog query; the server scopes results to the
+    // connection's user
+    QJsonObject payload;
+    payload["ownerId"] = ownerId;
+    payload["sharedWith"] = sharedWithUserId;
+    payload["title"] = titleFilter;
+    payload["offset"] = offset;
+    payload["limit"] = limit;
+    payload["requestId"] = requestId;
+
+    // Send the message
+    sendMessage("catalog_query", payload);
+}
+
+void CollaborationClient::sendAclUpdate(const QString& targetUserId, int level)
+{
+    if (!isDocumentJoined || !currentDocument) {
+        return;
+    }
+
+    // The server checks the share permission and updates live sessions
+    QJsonObject payload;
+    payload["documentId"] = currentDocument->getId();
+    payload["targetUserId"] = targetUserId;
+    payload["level"] = level;
+
+    // Send the message
+    sendMessage("acl_update", payload);
+}
+
 void CollaborationClient::onConnected()
 {
+    sendHello();
     emit connected();
     
     // For the prototype, simulate some users being available
@@ -217,11 +293,16 @@ void CollaborationClient::onTextMessageReceived(const QString& message)
     if (type == "edit") {
         EditOperation operation = EditOperation::fromJson(payload);
         emit editReceived(operation);
+    } else if (type == "edit_rejected") {
+        emit editRejected(payload["documentId"].toString(), payload["sequence"].toInt(), payload["reason"].toString());
+    } else if (type == "content_sync_request") {
+        emit contentSyncRequested(payload["documentId"].toString());
     } else if (type == "cursor") {
         QString userId = payload["userId"].toString();
         QString username = payload["username"].toString();
         int position = payload["position"].toInt();
-        emit cursorPositionReceived(userId, username, position);
+        int anchor = payload["anchor"].toInt(-1);
+        emit cursorPositionReceived(userId, username, position, anchor);
     } else if (type == "chat") {
         QString userId = payload["userId"].toString();
         QString username = payload["username"].toString();
@@ -237,6 +318,18 @@ void CollaborationClient::onTextMessageReceived(const QString& message)
     } else if (type == "content") {
         QString content = payload["content"].toString();
         emit contentReceived(content);
+    } else if (type == "catalog") {
+        emit catalogReceived(payload["entries"].toArray(), payload["total"].toInt(), payload["offset"].toInt(),
+                             payload["requestId"].toInt());
+    } else if (type == "permissions") {
+        emit permissionsChanged(payload["documentId"].toString(),
+                                static_cast<quint32>(payload["permissions"].toInteger()));
+    } else if (type == "doc_capabilities") {
+        emit documentCapabilitiesChanged(payload["documentId"].toString(), payload["richOperations"].toBool());
+    } else if (type == "acl_changed") {
+        if (payload.contains("targetUserId")) {
+            emit accessChanged(payload["targetUserId"].toString(), payload["level"].toInt());
+        }
     }
 }
 
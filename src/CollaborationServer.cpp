@@ -2,6 +2,9 @@
 #include "DocumentStorage.h"
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QPointer>
+#include <QThreadPool>
 #include <QDebug>
 
 CollaborationServer::CollaborationServer(quint16 port, QObject *parent)
@@ -19,6 +22,8 @@ CollaborationServer::CollaborationServer(quint16 port, QObject *parent)
 CollaborationServer::~CollaborationServer()
 {
     stop();
+    // Pending content encodes post back to this object
+    QThreadPool::globalInstance()->waitForDone();
 }
 
 bool CollaborationServer::start()
@@ -29,15 +34,15 @@ bool CollaborationServer::start()
 void CollaborationServer::stop()
 {
     // Close all client connections
-    for (QWebSocket* client : clientUserIds.keys()) {
+    for (QWebSocket* client : sessions.keys()) {
         client->close();
         client->deleteLater();
     }
     
     // Clear all maps
-    clientUserIds.clear();
+    sessions.clear();
     documentClients.clear();
-    userSessions.clear();
+    liveDocuments.clear();
     
     // Close the server
     server->close();
@@ -58,17 +63,9 @@ void CollaborationServer::onSocketDisconnected()
     QWebSocket *client = qobject_cast<QWebSocket *>(sender());
     if (!client) return;
 
-    QString userId = clientUserIds.value(client);
-    if (!userId.isEmpty()) {
-        QString documentId = userSessions.value(userId);
-        if (!documentId.isEmpty()) {
-            documentClients[documentId].remove(client);
-            if (documentClients[documentId].isEmpty()) {
-                documentClients.remove(documentId);
-            }
-        }
-        userSessions.remove(userId);
-        clientUserIds.remove(client);
+    if (sessions.contains(client)) {
+        detachFromDocument(client);
+        sessions.remove(client);
     }
 
     client->deleteLater();
@@ -90,7 +87,9 @@ void CollaborationServer::onTextMessageReceived(const QString &message)
     QString type = jsonMsg["type"].toString();
     QJsonObject payload = jsonMsg["payload"].toObject();
 
-    if (type == "join") {
+    if (type == "hello") {
+        handleHelloMessage(client, payload);
+    } else if (type == "join") {
         handleJoinMessage(client, payload);
     } else if (type == "leave") {
         handleLeaveMessage(client, payload);
@@ -102,6 +101,12 @@ void CollaborationServer::onTextMessageReceived(const QString &message)
         handleChatMessage(client, payload);
     } else if (type == "request_content") {
         handleContentRequest(client, payload);
+    } else if (type == "content_sync") {
+        handleContentSync(client, payload);
+    } else if (type == "catalog_query") {
+        handleCatalogQuery(client, payload);
+    } else if (type == "acl_update") {
+        handleAclUpdate(client, payload);
     }
 }
 
@@ -110,10 +115,35 @@ void CollaborationServer::handleJoinMessage(QWebSocket *client, const QJsonObjec
     QString documentId = payload["documentId"].toString();
     QString userId = payload["userId"].toString();
     QString username = payload["username"].toString();
+    if (documentId.isEmpty() || userId.isEmpty()) return;
+
+    // A connection speaks for one user for its whole lifetime
+    const QString boundUserId = sessions.value(client).userId;
+    if (!boundUserId.isEmpty() && boundUserId != userId) {
+        qDebug() << "Refusing join as" << userId << "on a connection bound to" << boundUserId;
+        return;
+    }
 
-    // Store user information
-    clientUserIds[client] = userId;
-    userSessions[userId] = documentId;
+    // Joining another document leaves the current one
+    detachFromDocument(client);
+
+    // Store user information; permissions are evaluated once here
+    ClientSession &session = sessions[client];
+    session.userId = userId;
+    session.documentId = documentId;
+    LiveDocument *live = liveDocument(documentId);
+    session.permissions = live ? live->acl.permissions(userId) : 0;
+    session.richOperations = payload["capabilities"].toArray().contains(QStringLiteral("rich_operations"));
+    sendPermissions(client, session);
+
+    if (!(session.permissions & DocumentAcl::Read)) {
+        qDebug() << "User" << userId << "has no access to document" << documentId;
+        session.documentId.clear();
+        if (!documentClients.contains(documentId)) {
+            liveDocuments.remove(documentId);
+        }
+        return;
+    }
     documentClients[documentId].insert(client);
 
     // Notify other clients in the document
@@ -125,89 +155,148 @@ void CollaborationServer::handleJoinMessage(QWebSocket *client, const QJsonObjec
     notification["payload"] = notificationPayload;
 
     broadcastToDocument(documentId, QJsonDocument(notification).toJson(QJsonDocument::Compact), client);
+    broadcastCapabilities(documentId);
 }
 
-void CollaborationServer::handleLeaveMessage(QWebSocket *client, const QJsonObject &/*payload*/)
+void CollaborationServer::handleHelloMessage(QWebSocket *client, const QJsonObject &payload)
 {
-    QString userId = clientUserIds.value(client);
+    // Binds the connection to its user before any document is joined, e.g.
+    // for catalog queries; a bound connection cannot be rebound
+    const QString userId = payload["userId"].toString();
     if (userId.isEmpty()) return;
 
-    QString documentId = userSessions.value(userId);
-    if (!documentId.isEmpty()) {
-        documentClients[documentId].remove(client);
-        if (documentClients[documentId].isEmpty()) {
-            documentClients.remove(documentId);
-        }
-
-        // Notify other clients
-        QJsonObject notification;
-        notification["type"] = "user_left";
-        QJsonObject notificationPayload;
-        notificationPayload["userId"] = userId;
-        notification["payload"] = notificationPayload;
-
-        broadcastToDocument(documentId, QJsonDocument(notification).toJson(QJsonDocument::Compact));
+    ClientSession &session = sessions[client];
+    if (session.userId.isEmpty()) {
+        session.userId = userId;
+    } else if (session.userId != userId) {
+        qDebug() << "Ignoring hello as" << userId << "on a connection bound to" << session.userId;
     }
+}
 
-    userSessions.remove(userId);
-    clientUserIds.remove(client);
+void CollaborationServer::handleLeaveMessage(QWebSocket *client, const QJsonObject &/*payload*/)
+{
+    if (!sessions.contains(client)) return;
+
+    // The session keeps its user until the connection closes
+    detachFromDocument(client);
 }
 
 void CollaborationServer::handleEditMessage(QWebSocket *client, const QJsonObject &payload)
 {
-    QString userId = clientUserIds.value(client);
-    if (userId.isEmpty()) return;
+    auto it = sessions.constFind(client);
+    if (it == sessions.constEnd() || it->documentId.isEmpty()) return;
 
-    QString documentId = userSessions.value(userId);
-    if (!documentId.isEmpty()) {
-        QJsonObject message;
-        message["type"] = "edit";
-        QJsonObject messagePayload = payload;
-        messagePayload["userId"] = userId;
-        message["payload"] = messagePayload;
+    // Cached at join and refreshed on ACL changes, so this is a bit test
+    if (!(it->permissions & DocumentAcl::Edit)) return;
 
-        broadcastToDocument(documentId, QJsonDocument(message).toJson(QJsonDocument::Compact), client);
+    LiveDocument *live = liveDocument(it->documentId);
+    if (!live) return;
+
+    const QString userId = it->userId;
+    const QString documentId = it->documentId;
+    EditOperation operation = EditOperation::fromJson(payload);
+    operation.userId = userId;
+
+    QJsonObject message;
+    message["type"] = "edit";
+    QJsonObject messagePayload = payload;
+    messagePayload["userId"] = userId;
+    message["payload"] = messagePayload;
+    const QString text = QJsonDocument(message).toJson(QJsonDocument::Compact);
+
+    QVector<EditOperation> steps;
+    if (!live->trusted || !applyToLiveText(*live, operation, &steps)) {
+        if (live->trusted) {
+            // The live copy has diverged; peers go back to plain edits
+            qDebug() << "Edit outside the live text of document" << documentId << "- asking a client for its copy";
+            live->trusted = false;
+            broadcastCapabilities(documentId);
+        } else if (client != live->syncSource) {
+            live->editedSinceSyncRequest = true;
+        }
+
+        if (operation.isRich()) {
+            // Nothing is expanded from a stale copy; the sender resends the
+            // plain steps it applied locally
+            QJsonObject rejection;
+            rejection["type"] = "edit_rejected";
+            QJsonObject rejectionPayload;
+            rejectionPayload["documentId"] = documentId;
+            rejectionPayload["sequence"] = operation.sequence;
+            rejectionPayload["reason"] = QStringLiteral("The edit does not match the server's copy of the document.");
+            rejection["payload"] = rejectionPayload;
+            client->sendTextMessage(QJsonDocument(rejection).toJson(QJsonDocument::Compact));
+        } else {
+            broadcastToDocument(documentId, text, client);
+        }
+
+        // Asked after the relay, so the copy that comes back has this edit
+        if (!live->syncSource) {
+            requestContentSync(documentId, *live, client);
+        }
+        return;
+    }
+
+    if (!operation.isRich()) {
+        broadcastToDocument(documentId, text, client);
+        return;
+    }
+
+    // A client that joined after the sender last heard every peer was rich
+    // gets the plain steps the operation expanded to on the live text
+    QStringList plainMessages;
+    for (QWebSocket *peer : documentClients.value(documentId)) {
+        if (peer == client || !peer->isValid()) continue;
+        if (sessions.value(peer).richOperations) {
+            peer->sendTextMessage(text);
+            continue;
+        }
+        if (plainMessages.isEmpty()) {
+            for (const EditOperation &step : steps) {
+                QJsonObject stepMessage;
+                stepMessage["type"] = "edit";
+                stepMessage["payload"] = step.toJson();
+                plainMessages.append(QJsonDocument(stepMessage).toJson(QJsonDocument::Compact));
+            }
+        }
+        for (const QString &plain : plainMessages) {
+            peer->sendTextMessage(plain);
+        }
     }
 }
 
 void CollaborationServer::handleCursorMessage(QWebSocket *client, const QJsonObject &payload)
 {
-    QString userId = clientUserIds.value(client);
-    if (userId.isEmpty()) return;
+    auto it = sessions.constFind(client);
+    if (it == sessions.constEnd() || it->documentId.isEmpty()) return;
 
-    QString documentId = userSessions.value(userId);
-    if (!documentId.isEmpty()) {
-        QJsonObject message;
-        message["type"] = "cursor";
-        QJsonObject messagePayload = payload;
-        messagePayload["userId"] = userId;
-        message["payload"] = messagePayload;
+    QJsonObject message;
+    message["type"] = "cursor";
+    QJsonObject messagePayload = payload;
+    messagePayload["userId"] = it->userId;
+    message["payload"] = messagePayload;
 
-        broadcastToDocument(documentId, QJsonDocument(message).toJson(QJsonDocument::Compact), client);
-    }
+    broadcastToDocument(it->documentId, QJsonDocument(message).toJson(QJsonDocument::Compact), client);
 }
 
 void CollaborationServer::handleChatMessage(QWebSocket *client, const QJsonObject &payload)
 {
-    QString userId = clientUserIds.value(client);
-    if (userId.isEmpty()) return;
+    auto it = sessions.constFind(client);
+    if (it == sessions.constEnd() || it->documentId.isEmpty()) return;
 
-    QString documentId = userSessions.value(userId);
-    if (!documentId.isEmpty()) {
-        QJsonObject message;
-        message["type"] = "chat";
-        QJsonObject messagePayload = payload;
-        messagePayload["userId"] = userId;
-        message["payload"] = messagePayload;
+    QJsonObject message;
+    message["type"] = "chat";
+    QJsonObject messagePayload = payload;
+    messagePayload["userId"] = it->userId;
+    message["payload"] = messagePayload;
 
-        broadcastToDocument(documentId, QJsonDocument(message).toJson(QJsonDocument::Compact));
-    }
+    broadcastToDocument(it->documentId, QJsonDocument(message).toJson(QJsonDocument::Compact));
 }
 
 void CollaborationServer::handleContentRequest(QWebSocket *client, const QJsonObject &payload)
 {
     QString documentId = payload["documentId"].toString();
-    QString userId = clientUserIds.value(client);
+    QString userId = sessions.value(client).userId;
     
     if (userId.isEmpty() || documentId.isEmpty()) return;
     
@@ -216,19 +305,289 @@ void CollaborationServer::handleContentRequest(QWebSocket *client, const QJsonOb
     if (!doc) return;
     
     // Check if user has access
-    if (doc->getAccessLevel(userId) == Document::AccessLevel::None) return;
+    if (!(doc->permissions(userId) & DocumentAcl::Read)) return;
     
-    // Send the content back to the client
+    // Encode from a snapshot on the thread pool; only the send happens here
+    DocumentSnapshot snapshot = doc->snapshot();
+    QPointer<QWebSocket> recipient(client);
+    QThreadPool::globalInstance()->start([this, snapshot, recipient]() {
+        QJsonObject message;
+        message["type"] = "content";
+        QJsonObject messagePayload;
+        messagePayload["documentId"] = snapshot.id;
+        messagePayload["content"] = snapshot.text.toString();
+        messagePayload["revision"] = qint64(snapshot.revision);
+        message["payload"] = messagePayload;
+        QString encoded = QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact));
+
+        QMetaObject::invokeMethod(this, [recipient, encoded]() {
+            if (recipient) {
+                recipient->sendTextMessage(encoded);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void CollaborationServer::handleContentSync(QWebSocket *client, const QJsonObject &payload)
+{
+    auto it = sessions.constFind(client);
+    if (it == sessions.constEnd() || it->documentId.isEmpty()) return;
+    const QString documentId = it->documentId;
+    if (payload["documentId"].toString() != documentId) return;
+
+    // Only the copy that was asked for is taken
+    auto live = liveDocuments.find(documentId);
+    if (live == liveDocuments.end() || live->trusted || live->syncSource != client) return;
+
+    // A peer's edit relayed after the request is missing from this copy
+    if (live->editedSinceSyncRequest) {
+        requestContentSync(documentId, *live, client);
+        return;
+    }
+
+    live->text = TextRope(payload["content"].toString());
+    live->trusted = true;
+    live->syncSource = nullptr;
+    qDebug() << "Live text of document" << documentId << "reseeded from" << it->userId;
+    broadcastCapabilities(documentId);
+}
+
+void CollaborationServer::handleCatalogQuery(QWebSocket *client, const QJsonObject &payload)
+{
+    // Only the user the connection is bound to; ids in the payload are ignored
+    const QString userId = sessions.value(client).userId;
+    if (userId.isEmpty()) {
+        qDebug() << "Catalog query on a connection without a user";
+        return;
+    }
+
+    // Results are always limited to documents the requesting user can read
+    CatalogQuery query;
+    query.accessibleTo = userId;
+    query.ownerId = payload["ownerId"].toString();
+    query.sharedWithUserId = payload["sharedWith"].toString();
+    query.titleFilter = payload["title"].toString();
+    query.offset = qMax(0, payload["offset"].toInt());
+    query.limit = qBound(1, payload["limit"].toInt(50), 500);
+
+    int total = 0;
+    QVector<CatalogEntry> page = DocumentStorage::getInstance().queryCatalog(query, &total);
+
+    QJsonArray entries;
+    for (const CatalogEntry &entry : page) {
+        entries.append(entry.toJson());
+    }
+
+    QJsonObject message;
+    message["type"] = "catalog";
+    QJsonObject messagePayload;
+    messagePayload["entries"] = entries;
+    messagePayload["total"] = total;
+    messagePayload["offset"] = query.offset;
+    messagePayload["requestId"] = payload["requestId"];
+    message["payload"] = messagePayload;
+
+    client->sendTextMessage(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void CollaborationServer::handleAclUpdate(QWebSocket *client, const QJsonObject &payload)
+{
+    QString userId = sessions.value(client).userId;
+    QString documentId = payload["documentId"].toString();
+    if (userId.isEmpty() || documentId.isEmpty()) return;
+
+    std::shared_ptr<Document> doc = DocumentStorage::getInstance().loadDocument(documentId);
+    if (!doc || !(doc->permissions(userId) & DocumentAcl::Share)) return;
+
+    // Either a user's level or a group's role and membership changes
+    DocumentAcl acl = doc->getAcl();
+    if (payload.contains("group")) {
+        QString group = payload["group"].toString();
+        acl.setGroupRole(group, static_cast<DocumentAcl::Role>(payload["role"].toInt()));
+        if (payload.contains("members")) {
+            for (const QString &member : acl.groupMembers(group)) {
+                acl.removeGroupMember(group, member);
+            }
+            for (const QJsonValue &member : payload["members"].toArray()) {
+                acl.addGroupMember(group, member.toString());
+            }
+        }
+    } else {
+        QString targetUserId = payload["targetUserId"].toString();
+        if (targetUserId.isEmpty() || acl.isOwner(targetUserId)) return;
+        auto level = static_cast<Document::AccessLevel>(payload["level"].toInt());
+        acl.setUserRole(targetUserId, Document::roleForAccessLevel(level));
+    }
+
+    doc->setAcl(acl);
+    if (!DocumentStorage::getInstance().saveDocument(doc)) {
+        qDebug() << "Failed to save ACL change for document" << documentId;
+        return;
+    }
+
+    auto live = liveDocuments.find(documentId);
+    if (live != liveDocuments.end()) {
+        live->acl = acl;
+    }
+
+    // Let every client update its copy of the ACL, then push new permission
+    // bits to the live sessions they affect
+    QJsonObject message;
+    message["type"] = "acl_changed";
+    QJsonObject messagePayload = payload;
+    messagePayload["userId"] = userId;
+    message["payload"] = messagePayload;
+    broadcastToDocument(documentId, QJsonDocument(message).toJson(QJsonDocument::Compact));
+
+    refreshPermissions(documentId);
+}
+
+CollaborationServer::LiveDocument *CollaborationServer::liveDocument(const QString &documentId)
+{
+    auto it = liveDocuments.find(documentId);
+    if (it != liveDocuments.end()) {
+        return &it.value();
+    }
+
+    // A document only exists once its creator has saved it; until then
+    // nobody gets any permissions, and nothing is kept for the id
+    std::shared_ptr<Document> doc = DocumentStorage::getInstance().loadDocument(documentId);
+    if (!doc) {
+        return nullptr;
+    }
+    return &liveDocuments.insert(documentId, LiveDocument{doc->getAcl(), doc->textSnapshot()}).value();
+}
+
+bool CollaborationServer::applyToLiveText(LiveDocument &live, const EditOperation &operation, QVector<EditOperation> *steps)
+{
+    TextRope &text = live.text;
+    *steps = operation.expand(
+        [&text](int position, int length) { return text.mid(position, length); }, text.length());
+    if (steps->isEmpty()) {
+        return false;
+    }
+    for (const EditOperation &step : *steps) {
+        text.replace(step.position, step.deletionLength, step.insertion);
+    }
+    return true;
+}
+
+void CollaborationServer::requestContentSync(const QString &documentId, LiveDocument &live, QWebSocket *preferred)
+{
+    // Clients that announce rich operations also answer content_sync_request
+    QWebSocket *source = nullptr;
+    if (preferred && sessions.value(preferred).richOperations) {
+        source = preferred;
+    } else {
+        for (QWebSocket *peer : documentClients.value(documentId)) {
+            if (peer->isValid() && sessions.value(peer).richOperations) {
+                source = peer;
+                break;
+            }
+        }
+    }
+
+    // Without one, the next edit tries again
+    live.syncSource = source;
+    live.editedSinceSyncRequest = false;
+    if (!source) return;
+
     QJsonObject message;
-    message["type"] = "content";
+    message["type"] = "content_sync_request";
     QJsonObject messagePayload;
     messagePayload["documentId"] = documentId;
-    messagePayload["content"] = doc->getContent();
     message["payload"] = messagePayload;
-    
+    source->sendTextMessage(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void CollaborationServer::detachFromDocument(QWebSocket *client)
+{
+    auto it = sessions.find(client);
+    if (it == sessions.end() || it->documentId.isEmpty()) return;
+
+    QString documentId = it->documentId;
+    QString userId = it->userId;
+    it->documentId.clear();
+    it->permissions = 0;
+
+    documentClients[documentId].remove(client);
+    if (documentClients[documentId].isEmpty()) {
+        documentClients.remove(documentId);
+        liveDocuments.remove(documentId);
+    } else {
+        // The copy that was asked for will not come
+        auto live = liveDocuments.find(documentId);
+        if (live != liveDocuments.end() && live->syncSource == client) {
+            requestContentSync(documentId, *live, nullptr);
+        }
+    }
+
+    // Notify other clients
+    QJsonObject notification;
+    notification["type"] = "user_left";
+    QJsonObject notificationPayload;
+    notificationPayload["userId"] = userId;
+    notification["payload"] = notificationPayload;
+
+    broadcastToDocument(documentId, QJsonDocument(notification).toJson(QJsonDocument::Compact));
+    broadcastCapabilities(documentId);
+}
+
+void CollaborationServer::refreshPermissions(const QString &documentId)
+{
+    auto liveIt = liveDocuments.constFind(documentId);
+    if (liveIt == liveDocuments.constEnd()) return;
+    const DocumentAcl acl = liveIt->acl;
+
+    const QSet<QWebSocket*> clients = documentClients.value(documentId);
+    for (QWebSocket *client : clients) {
+        ClientSession &session = sessions[client];
+        quint32 permissions = acl.permissions(session.userId);
+        if (permissions == session.permissions) {
+            continue;
+        }
+
+        session.permissions = permissions;
+        sendPermissions(client, session);
+        if (!(permissions & DocumentAcl::Read)) {
+            // Revoked: the session stops receiving the document's traffic
+            detachFromDocument(client);
+        }
+    }
+}
+
+void CollaborationServer::sendPermissions(QWebSocket *client, const ClientSession &session)
+{
+    QJsonObject message;
+    message["type"] = "permissions";
+    QJsonObject messagePayload;
+    messagePayload["documentId"] = session.documentId;
+    messagePayload["permissions"] = static_cast<qint64>(session.permissions);
+    message["payload"] = messagePayload;
+
     client->sendTextMessage(QJsonDocument(message).toJson(QJsonDocument::Compact));
 }
 
+void CollaborationServer::broadcastCapabilities(const QString &documentId)
+{
+    // Rich operation kinds are usable once every client in the document has
+    // them, and only while the live text can be trusted to expand them
+    auto live = liveDocuments.constFind(documentId);
+    bool richOperations = live == liveDocuments.constEnd() || live->trusted;
+    for (QWebSocket *client : documentClients.value(documentId)) {
+        richOperations = richOperations && sessions.value(client).richOperations;
+    }
+
+    QJsonObject message;
+    message["type"] = "doc_capabilities";
+    QJsonObject messagePayload;
+    messagePayload["documentId"] = documentId;
+    messagePayload["richOperations"] = richOperations;
+    message["payload"] = messagePayload;
+
+    broadcastToDocument(documentId, QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
 void CollaborationServer::broadcastToDocument(const QString &documentId, const QString &message, QWebSocket *exclude)
 {
     if (!documentClients.contains(documentId)) return;
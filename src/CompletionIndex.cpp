@@ -0,0 +1,192 @@
+// CompletionIndex.cpp
+#include "CompletionIndex.h"
+#include "Document.h"
+#include "SyntaxHighlighter.h"
+
+#include <QSet>
+#include <QThreadPool>
+#include <algorithm>
+
+namespace {
+
+const int MinWordLength = 2;
+// Longer runs are data, not identifiers worth offering
+const int MaxWordLength = 64;
+
+// Calls f for every identifier in text
+template<typename F>
+void forEachWord(QStringView text, F f)
+{
+    int start = 0;
+    const int length = int(text.length());
+    while (start < length) {
+        if (!CompletionIndex::isWordCharacter(text[start])) {
+            ++start;
+            continue;
+        }
+        int end = start + 1;
+        while (end < length && CompletionIndex::isWordCharacter(text[end])) {
+            ++end;
+        }
+        const int wordLength = end - start;
+        if (!text[start].isDigit() && wordLength >= MinWordLength && wordLength <= MaxWordLength) {
+            f(text.mid(start, wordLength));
+        }
+        start = end;
+    }
+}
+
+} // namespace
+
+CompletionIndex::CompletionIndex(QObject* parent)
+    : QObject(parent)
+    , nextTicket(0)
+{
+}
+
+void CompletionIndex::addDocument(const std::shared_ptr<Document>& document)
+{
+    Document* key = document.get();
+    if (!key || entries.contains(key)) {
+        return;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->ticket = ++nextTicket;
+    entries.insert(key, entry);
+
+    connect(key, &Document::textReplaced, this,
+        [this, key](int position, const QString& removedText, const QString& insertedText) {
+            onTextReplaced(key, position, removedText, insertedText);
+        });
+    connect(key, &QObject::destroyed, this, [this, key]() { entries.remove(key); });
+
+    // Edits from here on are counted by onTextReplaced and merged once this ends
+    const TextRope text = key->textSnapshot();
+    const quint64 ticket = entry->ticket;
+    QThreadPool::globalInstance()->start([this, key, text, ticket]() {
+        const QString content = text.toString();
+        auto words = std::make_shared<CompletionTrie>();
+        forEachWord(content, [&words](QStringView word) { words->add(word); });
+        QMetaObject::invokeMethod(this, [this, key, ticket, words]() {
+            onBuilt(key, ticket, words);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void CompletionIndex::onBuilt(Document* document, quint64 ticket, std::shared_ptr<CompletionTrie> words)
+{
+    auto it = entries.find(document);
+    if (it == entries.end() || it.value()->ticket != ticket) {
+        return;
+    }
+
+    Entry& entry = *it.value();
+    entry.words = std::move(*words);
+    for (auto pending = entry.pendingCounts.cbegin(); pending != entry.pendingCounts.cend(); ++pending) {
+        if (pending.value() > 0) {
+            entry.words.add(pending.key(), pending.value());
+        } else if (pending.value() < 0) {
+            entry.words.remove(pending.key(), -pending.value());
+        }
+    }
+    entry.pendingCounts.clear();
+    entry.building = false;
+}
+
+void CompletionIndex::onTextReplaced(Document* document, int position, const QString& removedText,
+                                     const QString& insertedText)
+{
+    auto it = entries.find(document);
+    if (it == entries.end()) {
+        return;
+    }
+    Entry& entry = *it.value();
+
+    // Words cut by the edit extend into the text on either side; one more
+    // character than the longest word is enough to see them whole or too long
+    const int leftStart = qMax(0, position - MaxWordLength - 1);
+    const QString left = document->textAt(leftStart, position - leftStart);
+    int leftLength = 0;
+    while (leftLength < left.length() && isWordCharacter(left[left.length() - 1 - leftLength])) {
+        ++leftLength;
+    }
+    const QString right = document->textAt(position + int(insertedText.length()), MaxWordLength + 1);
+    int rightLength = 0;
+    while (rightLength < right.length() && isWordCharacter(right[rightLength])) {
+        ++rightLength;
+    }
+    const QString before = left.right(leftLength);
+    const QString after = right.left(rightLength);
+    const QString oldText = before + removedText + after;
+    const QString newText = before + insertedText + after;
+
+    if (entry.building) {
+        forEachWord(oldText, [&entry](QStringView word) { --entry.pendingCounts[word.toString()]; });
+        forEachWord(newText, [&entry](QStringView word) { ++entry.pendingCounts[word.toString()]; });
+    } else {
+        forEachWord(oldText, [&entry](QStringView word) { entry.words.remove(word); });
+        forEachWord(newText, [&entry](QStringView word) { entry.words.add(word); });
+    }
+}
+
+const CompletionTrie& CompletionIndex::keywordTrie(const QString& language) const
+{
+    std::shared_ptr<CompletionTrie>& trie = keywords[language];
+    if (!trie) {
+        trie = std::make_shared<CompletionTrie>();
+        for (const QString& keyword : SyntaxHighlighter::keywords(language)) {
+            trie->add(keyword);
+        }
+    }
+    return *trie;
+}
+
+QStringList CompletionIndex::complete(const QString& prefix, Document* document, int limit) const
+{
+    QStringList result;
+    QSet<QString> seen{prefix};
+    const auto take = [&](const QVector<CompletionTrie::Completion>& completions) {
+        for (const CompletionTrie::Completion& completion : completions) {
+            if (result.size() >= limit) {
+                return;
+            }
+            if (!seen.contains(completion.word)) {
+                seen.insert(completion.word);
+                result.append(completion.word);
+            }
+        }
+    };
+
+    // One extra each, since the prefix itself may be among them
+    const auto own = entries.constFind(document);
+    if (own != entries.cend()) {
+        take(own.value()->words.complete(prefix, limit + 1));
+    }
+    if (document) {
+        take(keywordTrie(document->getLanguage()).complete(prefix, limit + 1));
+    }
+
+    // Other documents are ranked by their summed counts
+    if (result.size() < limit) {
+        QHash<QString, int> counts;
+        for (auto it = entries.cbegin(); it != entries.cend(); ++it) {
+            if (it.key() == document) {
+                continue;
+            }
+            for (const CompletionTrie::Completion& completion : it.value()->words.complete(prefix, limit + 1)) {
+                counts[completion.word] += completion.count;
+            }
+        }
+        QVector<CompletionTrie::Completion> others;
+        for (auto it = counts.cbegin(); it != counts.cend(); ++it) {
+            others.append({it.key(), it.value()});
+        }
+        std::sort(others.begin(), others.end(),
+            [](const CompletionTrie::Completion& a, const CompletionTrie::Completion& b) {
+                return a.count != b.count ? a.count > b.count : a.word < b.word;
+            });
+        take(others);
+    }
+    return result;
+}
@@ -0,0 +1,168 @@
+// CompletionTrie.cpp
+#include "CompletionTrie.h"
+
+#include <algorithm>
+#include <queue>
+
+CompletionTrie::CompletionTrie()
+{
+    clear();
+}
+
+void CompletionTrie::clear()
+{
+    nodes.assign(1, Node());
+    freeNodes.clear();
+}
+
+int CompletionTrie::findChild(int node, char16_t c) const
+{
+    const auto& children = nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), c,
+        [](const std::pair<char16_t, int>& child, char16_t key) { return child.first < key; });
+    return it != children.end() && it->first == c ? it->second : -1;
+}
+
+int CompletionTrie::createNode()
+{
+    if (!freeNodes.empty()) {
+        const int index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = Node();
+        return index;
+    }
+    nodes.push_back(Node());
+    return int(nodes.size()) - 1;
+}
+
+int CompletionTrie::findNode(QStringView word) const
+{
+    int node = 0;
+    for (QChar c : word) {
+        node = findChild(node, c.unicode());
+        if (node < 0) {
+            return -1;
+        }
+    }
+    return node;
+}
+
+void CompletionTrie::add(QStringView word, int count)
+{
+    if (word.isEmpty() || count <= 0) {
+        return;
+    }
+
+    std::vector<int> path;
+    path.reserve(word.size() + 1);
+    int node = 0;
+    path.push_back(node);
+    for (QChar c : word) {
+        int next = findChild(node, c.unicode());
+        if (next < 0) {
+            next = createNode(); // May reallocate nodes, so look the parent up again
+            auto& children = nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), c.unicode(),
+                [](const std::pair<char16_t, int>& child, char16_t key) { return child.first < key; });
+            children.insert(it, std::make_pair(char16_t(c.unicode()), next));
+        }
+        node = next;
+        path.push_back(node);
+    }
+
+    // Counts only grow here, so the subtree maxima only need raising
+    const int total = nodes[node].count += count;
+    for (int index : path) {
+        nodes[index].best = std::max(nodes[index].best, total);
+    }
+}
+
+void CompletionTrie::remove(QStringView word, int count)
+{
+    if (word.isEmpty() || count <= 0) {
+        return;
+    }
+
+    std::vector<int> path;
+    path.reserve(word.size() + 1);
+    int node = 0;
+    path.push_back(node);
+    for (QChar c : word) {
+        node = findChild(node, c.unicode());
+        if (node < 0) {
+            return;
+        }
+        path.push_back(node);
+    }
+    nodes[node].count = std::max(0, nodes[node].count - count);
+
+    // Recompute the maxima bottom-up, dropping nodes no word passes through
+    for (int i = int(path.size()) - 1; i >= 0; --i) {
+        Node& current = nodes[path[i]];
+        current.best = current.count;
+        for (const auto& child : current.children) {
+            current.best = std::max(current.best, nodes[child.second].best);
+        }
+        if (i > 0 && current.best == 0 && current.children.empty()) {
+            auto& siblings = nodes[path[i - 1]].children;
+            siblings.erase(std::find_if(siblings.begin(), siblings.end(),
+                [&path, i](const std::pair<char16_t, int>& child) { return child.second == path[i]; }));
+            freeNodes.push_back(path[i]);
+        }
+    }
+}
+
+int CompletionTrie::count(QStringView word) const
+{
+    const int node = findNode(word);
+    return node < 0 ? 0 : nodes[node].count;
+}
+
+QVector<CompletionTrie::Completion> CompletionTrie::complete(QStringView prefix, int limit) const
+{
+    QVector<Completion> result;
+    const int start = findNode(prefix);
+    if (start < 0 || limit <= 0) {
+        return result;
+    }
+
+    // Best-first over subtrees (keyed by their largest count) and finished
+    // words (keyed by their own); a word is taken once nothing left can beat it
+    struct Candidate {
+        int key;
+        bool isWord;
+        int node;
+        QString text;
+        bool operator<(const Candidate& other) const {
+            if (key != other.key) {
+                return key < other.key;
+            }
+            if (isWord != other.isWord) {
+                return !isWord; // Words first on ties
+            }
+            return text > other.text;
+        }
+    };
+    std::priority_queue<Candidate> queue;
+    queue.push(Candidate{nodes[start].best, false, start, prefix.toString()});
+    while (!queue.empty() && result.size() < limit) {
+        Candidate candidate = queue.top();
+        queue.pop();
+        if (candidate.key <= 0) {
+            break;
+        }
+        if (candidate.isWord) {
+            result.append(Completion{candidate.text, candidate.key});
+            continue;
+        }
+        const Node& node = nodes[candidate.node];
+        if (node.count > 0) {
+            queue.push(Candidate{node.count, true, candidate.node, candidate.text});
+        }
+        for (const auto& child : node.children) {
+            queue.push(Candidate{nodes[child.second].best, false, child.second,
+                                 candidate.text + QChar(child.first)});
+        }
+    }
+    return result;
+}
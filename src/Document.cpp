@@ -1,23 +1,26 @@
 // Document.cpp
 #include "Document.h"
+#include "TextDiff.h"
 #include "User.h"
+#include "BlobStore.h"
 #include <QDateTime>
+#include <QMetaMethod>
 #include <QDebug>
 
 Document::Document(const QString& id, const QString& title, std::shared_ptr<User> owner)
     : QObject(nullptr)
     , documentId(id)
     , title(title)
-    , content("")
+    , content()
     , language("Plain")
     , owner(owner)
     , lastModified(QDateTime::currentDateTime())
-    , isPublic(false)
+    , revision(0)
 {
     if (owner) {
         qDebug() << "Created document" << id << "owned by" << owner->getUserId();
-        // Owner gets edit access by default
-        sharedUsers[owner->getUserId()] = AccessLevel::Edit;
+        // The owner holds every permission through the ACL
+        acl.setOwner(owner->getUserId());
     }
     // Add first version to history
     addToVersionHistory(owner, "Initial document creation");
@@ -35,10 +38,95 @@ void Document::setTitle(const QString& newTitle)
 
 void Document::setContent(const QString& newContent)
 {
-    if (content != newContent) {
-        content = newContent;
+    replaceContent(newContent);
+}
+
+bool Document::applyEdit(int position, int removedLength, const QString& insertedText, const QString& userId)
+{
+    if (position < 0 || removedLength < 0 || position + removedLength > content.length()) {
+        return false;
+    }
+    if (removedLength == 0 && insertedText.isEmpty()) {
+        return true;
+    }
+
+    static const QMetaMethod textReplacedSignal = QMetaMethod::fromSignal(&Document::textReplaced);
+    const bool reportRemoved = isSignalConnected(textReplacedSignal);
+    const QString removedText = reportRemoved ? content.mid(position, removedLength) : QString();
+
+    content.replace(position, removedLength, insertedText);
+    lineIndex.applyEdit(position, removedLength, insertedText);
+    authorship.applyEdit(position, removedLength, insertedText.length(), userId);
+    lastModified = QDateTime::currentDateTime();
+    ++revision;
+    operationLog.append(revision, OperationLog::Entry{position, removedLength, insertedText, userId, lastModified}, content);
+
+    DocumentChange change;
+    change.position = position;
+    change.removedLength = removedLength;
+    change.insertedText = insertedText;
+    change.revision = revision;
+    change.userId = userId;
+    emit contentEdited(change);
+    if (reportRemoved) {
+        emit textReplaced(position, removedText, insertedText);
+    }
+    emitContentChanged();
+    return true;
+}
+
+QVector<DocumentChange> Document::replaceContent(const QString& newContent, const QString& userId)
+{
+    QVector<DocumentChange> changes;
+
+    if (content.isEmpty()) {
+        // Nothing to compare against, take over the new buffer as is
+        if (newContent.isEmpty()) {
+            return changes;
+        }
+        content = TextRope(newContent);
+        lineIndex.reset(newContent);
+        authorship.reset(newContent.length(), userId);
         lastModified = QDateTime::currentDateTime();
-        emit contentChanged(content);
+
+        DocumentChange change;
+        change.insertedText = newContent;
+        change.revision = ++revision;
+        change.userId = userId;
+        // History starts from the loaded text instead of logging it as an edit
+        operationLog.reset(content, revision);
+        emit contentEdited(change);
+        emit textReplaced(0, QString(), newContent);
+        emitContentChanged();
+        changes.append(change);
+        return changes;
+    }
+
+    // Only the ranges that differ are applied, so untouched text keeps its
+    // authorship and line index entries
+    const QVector<TextDiff::Edit> edits = TextDiff::diff(content.toString(), newContent);
+    changes.reserve(edits.size());
+    for (const TextDiff::Edit& edit : edits) {
+        if (!applyEdit(edit.position, edit.removedLength, edit.insertedText, userId)) {
+            break;
+        }
+        DocumentChange change;
+        change.position = edit.position;
+        change.removedLength = edit.removedLength;
+        change.insertedText = edit.insertedText;
+        change.revision = revision;
+        change.userId = userId;
+        changes.append(change);
+    }
+    return changes;
+}
+
+void Document::emitContentChanged()
+{
+    // Building the full-content argument is skipped when nobody listens
+    static const QMetaMethod contentChangedSignal = QMetaMethod::fromSignal(&Document::contentChanged);
+    if (isSignalConnected(contentChangedSignal)) {
+        emit contentChanged(content.toString());
     }
 }
 
@@ -60,9 +148,7 @@ bool Document::editContent(const QString& newContent, std::shared_ptr<User> edit
         return false;
     }
     
-    content = newContent;
-    lastModified = QDateTime::currentDateTime();
-    emit contentChanged(newContent);
+    replaceContent(newContent, editor->getUserId());
     return true;
 }
 
@@ -73,14 +159,7 @@ bool Document::updateContent(const QString& delta, int position, std::shared_ptr
     }
 
     // Apply the delta at the specified position
-    if (position >= 0 && position <= content.length()) {
-        QString newContent = content;
-        newContent.insert(position, delta);
-        setContent(newContent);
-        return true;
-    }
-
-    return false;
+    return applyEdit(position, 0, delta, editor->getUserId());
 }
 
 bool Document::addCollaborator(std::shared_ptr<User> user, bool canEdit)
@@ -89,7 +168,9 @@ bool Document::addCollaborator(std::shared_ptr<User> user, bool canEdit)
         return false;
     }
 
-    collaborators[user->getUserId()] = canEdit;
+    if (!shareWith(user->getUserId(), canEdit ? AccessLevel::Edit : AccessLevel::ReadOnly)) {
+        return false;
+    }
     emit collaboratorAdded(user);
     return true;
 }
@@ -100,7 +181,7 @@ bool Document::removeCollaborator(std::shared_ptr<User> user)
         return false;
     }
 
-    if (collaborators.remove(user->getUserId()) > 0) {
+    if (revokeAccess(user->getUserId())) {
         emit collaboratorRemoved(user);
         return true;
     }
@@ -110,22 +191,7 @@ bool Document::removeCollaborator(std::shared_ptr<User> user)
 
 bool Document::hasEditPermission(std::shared_ptr<User> user) const
 {
-    if (!user) {
-        return false;
-    }
-
-    // The owner always has edit permission
-    if (owner && user->getUserId() == owner->getUserId()) {
-        return true;
-    }
-
-    // Check if user is a collaborator with edit permission
-    auto it = collaborators.find(user->getUserId());
-    if (it != collaborators.end()) {
-        return it.value();
-    }
-
-    return false;
+    return user && canEdit(user->getUserId());
 }
 
 QVector<std::shared_ptr<User>> Document::getCollaborators() const
@@ -151,18 +217,84 @@ QVector<DocumentVersion> Document::getVersionHistory() const
     return versionHistory;
 }
 
-bool Document::restoreVersion(int versionIndex)
+QString Document::getVersionContent(int versionIndex, bool* ok) const
 {
+    if (ok) {
+        *ok = false;
+    }
     if (versionIndex < 0 || versionIndex >= versionHistory.size()) {
+        return QString();
+    }
+
+    const DocumentVersion& version = versionHistory[versionIndex];
+    if (version.content.isEmpty() && !version.contentChunks.isEmpty()) {
+        // Only the chunks of this version are read from the blob store
+        return BlobStore::getInstance().loadContent(version.contentChunks, ok);
+    }
+    if (ok) {
+        *ok = true;
+    }
+    return version.content.toString();
+}
+
+bool Document::restoreVersion(int versionIndex)
+{
+    // A version whose chunks are missing must not wipe the live text
+    bool loaded = false;
+    const QString versionContent = getVersionContent(versionIndex, &loaded);
+    if (!loaded) {
+        qDebug() << "Cannot restore version" << versionIndex << "of document" << documentId;
         return false;
     }
 
-    content = versionHistory[versionIndex].content;
-    emit contentChanged(content);
+    replaceContent(versionContent);
+    return true;
+}
+
+bool Document::restoreAuthorship(const AuthorshipMap& map)
+{
+    if (map.length() != content.length()) {
+        return false;
+    }
+    authorship = map;
+    return true;
+}
 
+bool Document::restoreOperationLog(const OperationLog& log)
+{
+    TextRope last;
+    if (!log.textAt(log.lastRevision(), &last) || last.toString() != content.toString()) {
+        return false;
+    }
+    operationLog = log;
+    revision = log.lastRevision();
     return true;
 }
 
+void Document::setCheckpointChunks(quint64 checkpointRevision, const QStringList& chunkRefs)
+{
+    // Later saves refer to the stored checkpoint instead of writing it again
+    operationLog.setCheckpointChunks(checkpointRevision, chunkRefs);
+}
+
+void Document::setVersionChunks(int versionIndex, const QStringList& chunkRefs)
+{
+    if (versionIndex < 0 || versionIndex >= versionHistory.size()) {
+        return;
+    }
+
+    // The chunks now hold the text, so drop the in-memory copy
+    versionHistory[versionIndex].contentChunks = chunkRefs;
+    versionHistory[versionIndex].content = TextRope();
+}
+
+void Document::restoreVersionHistory(const QVector<DocumentVersion>& history)
+{
+    if (!history.isEmpty()) {
+        versionHistory = history;
+    }
+}
+
 void Document::addToVersionHistory(std::shared_ptr<User> user, const QString& description)
 {
     DocumentVersion version;
@@ -175,80 +307,115 @@ void Document::addToVersionHistory(std::shared_ptr<User> user, const QString& de
     emit versionSaved(version);
 }
 
+DocumentSnapshot Document::snapshot() const
+{
+    DocumentSnapshot snapshot;
+    snapshot.id = documentId;
+    snapshot.title = title;
+    snapshot.language = language;
+    if (owner) {
+        snapshot.ownerId = owner->getUserId();
+        snapshot.ownerName = owner->getUsername();
+    }
+    snapshot.lastModified = lastModified;
+    snapshot.acl = acl;
+    snapshot.versions = versionHistory;
+    snapshot.text = content;
+    snapshot.authorship = authorship;
+    snapshot.operationLog = operationLog;
+    snapshot.revision = revision;
+    return snapshot;
+}
+
 void Document::setPublicAccess(bool publicAccess)
 {
-    if (isPublic != publicAccess) {
-        isPublic = publicAccess;
-        emit publicAccessChanged(isPublic);
+    if (acl.isPublic() != publicAccess) {
+        acl.setPublic(publicAccess);
+        emit publicAccessChanged(publicAccess);
     }
 }
 
 Document::AccessLevel Document::getAccessLevel(const QString& userId) const
 {
-    // Owner always has edit access
-    if (owner && userId == owner->getUserId()) {
-        qDebug() << "User is owner, granting edit access";
-        return AccessLevel::Edit;
-    }
+    return accessLevelForPermissions(acl.permissions(userId));
+}
 
-    // Check if document is public
-    if (isPublic) {
-        qDebug() << "Document is public, granting read-only access";
-        return AccessLevel::ReadOnly;
+QMap<QString, Document::AccessLevel> Document::getSharedWith() const
+{
+    QMap<QString, AccessLevel> result;
+    const QMap<QString, DocumentAcl::Role> roles = acl.userRoles();
+    for (auto it = roles.constBegin(); it != roles.constEnd(); ++it) {
+        result.insert(it.key(), accessLevelForPermissions(DocumentAcl::permissionsForRole(it.value())));
     }
-
-    // Check if user has explicit access
-    auto it = sharedUsers.find(userId);
-    if (it != sharedUsers.end()) {
-        qDebug() << "User has explicit access level:" << (it.value() == AccessLevel::Edit ? "Edit" : "ReadOnly");
-        return it.value();
+    if (owner) {
+        result.insert(owner->getUserId(), AccessLevel::Edit);
     }
+    return result;
+}
 
-    qDebug() << "User has no access to document";
-    return AccessLevel::None;
+void Document::setAcl(const DocumentAcl& newAcl)
+{
+    bool publicChanged = newAcl.isPublic() != acl.isPublic();
+    acl = newAcl;
+    if (owner) {
+        acl.setOwner(owner->getUserId());
+    }
+    if (publicChanged) {
+        emit publicAccessChanged(acl.isPublic());
+    }
 }
 
 bool Document::shareWith(const QString& userId, AccessLevel level)
 {
-    qDebug() << "Attempting to share document" << documentId << "with user" << userId 
-             << "at level" << (level == AccessLevel::Edit ? "edit" : "read-only");
-    
-    // Can't share with owner (they already have access)
-    if (owner && owner->getUserId() == userId) {
-        qDebug() << "Cannot share with owner";
+    // The owner's access can't be changed
+    if (acl.isOwner(userId)) {
         return false;
     }
-    
-    sharedUsers[userId] = level;
-    qDebug() << "Successfully shared document with user";
-    return true;
+    if (level == AccessLevel::None) {
+        acl.setUserRole(userId, DocumentAcl::Role::None);
+        return true;
+    }
+    return acl.setUserRole(userId, roleForAccessLevel(level));
 }
 
 bool Document::revokeAccess(const QString& userId)
 {
-    qDebug() << "Attempting to revoke access for user" << userId << "from document" << documentId;
-    
-    // Can't revoke owner's access
-    if (owner && owner->getUserId() == userId) {
-        qDebug() << "Cannot revoke owner's access";
+    if (acl.isOwner(userId)) {
         return false;
     }
-    
-    if (sharedUsers.remove(userId) > 0) {
-        qDebug() << "Successfully revoked access";
-        return true;
-    }
-    
-    qDebug() << "User did not have access to revoke";
-    return false;
+    return acl.setUserRole(userId, DocumentAcl::Role::None);
 }
 
 bool Document::canRead(const QString& userId) const
 {
-    return getAccessLevel(userId) != AccessLevel::None;
+    return acl.permissions(userId) & DocumentAcl::Read;
 }
 
 bool Document::canEdit(const QString& userId) const
 {
-    return getAccessLevel(userId) == AccessLevel::Edit;
-}
\ No newline at end of file
+    return acl.permissions(userId) & DocumentAcl::Edit;
+}
+
+Document::AccessLevel Document::accessLevelForPermissions(quint32 permissions)
+{
+    if (permissions & DocumentAcl::Edit) {
+        return AccessLevel::Edit;
+    }
+    if (permissions & DocumentAcl::Read) {
+        return AccessLevel::ReadOnly;
+    }
+    return AccessLevel::None;
+}
+
+DocumentAcl::Role Document::roleForAccessLevel(AccessLevel level)
+{
+    switch (level) {
+    case AccessLevel::Edit:
+        return DocumentAcl::Role::Editor;
+    case AccessLevel::ReadOnly:
+        return DocumentAcl::Role::Viewer;
+    case AccessLevel::None:
+        break;
+    }
+    return DocumentAcl::Role::None;
+}
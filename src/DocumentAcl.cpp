@@ -0,0 +1,210 @@
+// DocumentAcl.cpp
+#include "DocumentAcl.h"
+
+#include <QReadWriteLock>
+
+namespace {
+
+struct InternTable {
+    QReadWriteLock lock;
+    QHash<QString, int> ids;
+    QVector<QString> names;
+};
+
+InternTable& internTable()
+{
+    static InternTable table;
+    return table;
+}
+
+} // namespace
+
+int DocumentAcl::intern(const QString& name)
+{
+    InternTable& table = internTable();
+    {
+        QReadLocker locker(&table.lock);
+        auto it = table.ids.constFind(name);
+        if (it != table.ids.constEnd()) {
+            return it.value();
+        }
+    }
+
+    QWriteLocker locker(&table.lock);
+    auto it = table.ids.constFind(name);
+    if (it != table.ids.constEnd()) {
+        return it.value();
+    }
+    int id = table.names.size();
+    table.names.append(name);
+    table.ids.insert(name, id);
+    return id;
+}
+
+int DocumentAcl::find(const QString& name)
+{
+    InternTable& table = internTable();
+    QReadLocker locker(&table.lock);
+    return table.ids.value(name, -1);
+}
+
+QString DocumentAcl::nameOf(int id)
+{
+    InternTable& table = internTable();
+    QReadLocker locker(&table.lock);
+    return id >= 0 && id < table.names.size() ? table.names[id] : QString();
+}
+
+quint32 DocumentAcl::permissionsForRole(Role role)
+{
+    switch (role) {
+    case Role::Owner:
+        return AllPermissions;
+    case Role::Editor:
+        return Read | Edit;
+    case Role::Viewer:
+        return Read;
+    case Role::None:
+        break;
+    }
+    return NoPermissions;
+}
+
+void DocumentAcl::setOwner(const QString& userId)
+{
+    owner = userId.isEmpty() ? -1 : intern(userId);
+    users.remove(owner);
+}
+
+QString DocumentAcl::ownerId() const
+{
+    return nameOf(owner);
+}
+
+bool DocumentAcl::isOwner(const QString& userId) const
+{
+    return owner >= 0 && find(userId) == owner;
+}
+
+bool DocumentAcl::setUserRole(const QString& userId, Role role)
+{
+    if (userId.isEmpty() || role == Role::Owner || isOwner(userId)) {
+        return false;
+    }
+
+    if (role == Role::None) {
+        int id = find(userId);
+        return id >= 0 && users.remove(id) > 0;
+    }
+    users.insert(intern(userId), role);
+    return true;
+}
+
+DocumentAcl::Role DocumentAcl::userRole(const QString& userId) const
+{
+    if (isOwner(userId)) {
+        return Role::Owner;
+    }
+    int id = find(userId);
+    return id < 0 ? Role::None : users.value(id, Role::None);
+}
+
+QMap<QString, DocumentAcl::Role> DocumentAcl::userRoles() const
+{
+    QMap<QString, Role> result;
+    for (auto it = users.constBegin(); it != users.constEnd(); ++it) {
+        result.insert(nameOf(it.key()), it.value());
+    }
+    return result;
+}
+
+void DocumentAcl::setGroupRole(const QString& group, Role role)
+{
+    if (group.isEmpty() || role == Role::Owner) {
+        return;
+    }
+    groupsById[intern(group)].role = role;
+}
+
+DocumentAcl::Role DocumentAcl::groupRole(const QString& group) const
+{
+    int id = find(group);
+    auto it = groupsById.constFind(id);
+    return it == groupsById.constEnd() ? Role::None : it->role;
+}
+
+void DocumentAcl::addGroupMember(const QString& group, const QString& userId)
+{
+    if (group.isEmpty() || userId.isEmpty()) {
+        return;
+    }
+
+    int groupId = intern(group);
+    int userIdValue = intern(userId);
+    Group& entry = groupsById[groupId];
+    if (!entry.members.contains(userIdValue)) {
+        entry.members.insert(userIdValue);
+        memberOf[userIdValue].append(groupId);
+    }
+}
+
+void DocumentAcl::removeGroupMember(const QString& group, const QString& userId)
+{
+    int groupId = find(group);
+    int userIdValue = find(userId);
+    auto it = groupsById.find(groupId);
+    if (it == groupsById.end() || !it->members.remove(userIdValue)) {
+        return;
+    }
+
+    QVector<int>& memberships = memberOf[userIdValue];
+    memberships.removeOne(groupId);
+    if (memberships.isEmpty()) {
+        memberOf.remove(userIdValue);
+    }
+}
+
+QStringList DocumentAcl::groups() const
+{
+    QStringList result;
+    for (auto it = groupsById.constBegin(); it != groupsById.constEnd(); ++it) {
+        result.append(nameOf(it.key()));
+    }
+    result.sort();
+    return result;
+}
+
+QStringList DocumentAcl::groupMembers(const QString& group) const
+{
+    QStringList result;
+    auto it = groupsById.constFind(find(group));
+    if (it != groupsById.constEnd()) {
+        for (int member : it->members) {
+            result.append(nameOf(member));
+        }
+        result.sort();
+    }
+    return result;
+}
+
+quint32 DocumentAcl::permissions(const QString& userId) const
+{
+    quint32 bits = publicReadable ? quint32(Read) : quint32(NoPermissions);
+
+    int id = find(userId);
+    if (id < 0) {
+        return bits; // Never seen, so no explicit or group role
+    }
+    if (id == owner) {
+        return AllPermissions;
+    }
+
+    bits |= permissionsForRole(users.value(id, Role::None));
+    auto groupsIt = memberOf.constFind(id);
+    if (groupsIt != memberOf.constEnd()) {
+        for (int groupId : *groupsIt) {
+            bits |= permissionsForRole(groupsById.value(groupId).role);
+        }
+    }
+    return bits;
+}
@@ -0,0 +1,354 @@
+// DocumentCatalog.cpp
+#include "DocumentCatalog.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Fold the journal into the snapshot after this many records
+const int MinJournalRecordsBeforeCompaction = 1000;
+
+} // namespace
+
+QJsonObject CatalogEntry::toJson() const
+{
+    QJsonObject json;
+    json["id"] = id;
+    json["title"] = title;
+    json["ownerId"] = ownerId;
+    json["ownerName"] = ownerName;
+    json["language"] = language;
+    json["isPublic"] = isPublic;
+    json["size"] = size;
+    json["lastModified"] = lastModified.toMSecsSinceEpoch();
+
+    QJsonObject sharedObj;
+    for (auto it = sharedWith.begin(); it != sharedWith.end(); ++it) {
+        sharedObj[it.key()] = it.value();
+    }
+    json["sharedWith"] = sharedObj;
+    return json;
+}
+
+CatalogEntry CatalogEntry::fromJson(const QJsonObject& json)
+{
+    CatalogEntry entry;
+    entry.id = json["id"].toString();
+    entry.title = json["title"].toString();
+    entry.ownerId = json["ownerId"].toString();
+    entry.ownerName = json["ownerName"].toString();
+    entry.language = json["language"].toString();
+    entry.isPublic = json["isPublic"].toBool();
+    entry.size = json["size"].toInteger();
+    entry.lastModified = QDateTime::fromMSecsSinceEpoch(json["lastModified"].toInteger());
+
+    QJsonObject sharedObj = json["sharedWith"].toObject();
+    for (auto it = sharedObj.begin(); it != sharedObj.end(); ++it) {
+        entry.sharedWith[it.key()] = it.value().toInt();
+    }
+    return entry;
+}
+
+DocumentCatalog::DocumentCatalog(const QString& directory)
+    : directory(directory)
+    , journalRecords(0)
+{
+}
+
+bool DocumentCatalog::load()
+{
+    QMutexLocker locker(&mutex);
+
+    entries.clear();
+    byOwner.clear();
+    bySharedUser.clear();
+    publicDocuments.clear();
+    journalRecords = 0;
+
+    bool found = false;
+
+    QFile snapshot(snapshotPath());
+    if (snapshot.open(QIODevice::ReadOnly)) {
+        found = true;
+        QJsonArray entriesArray = QJsonDocument::fromJson(snapshot.readAll()).object()["entries"].toArray();
+        snapshot.close();
+
+        entries.reserve(entriesArray.size());
+        for (const QJsonValue& value : entriesArray) {
+            indexEntry(CatalogEntry::fromJson(value.toObject()));
+        }
+    }
+
+    QFile journal(journalPath());
+    if (journal.open(QIODevice::ReadOnly)) {
+        found = true;
+        while (!journal.atEnd()) {
+            QByteArray line = journal.readLine().trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+            // A torn last line from a crash is skipped, earlier records still apply
+            QJsonDocument record = QJsonDocument::fromJson(line);
+            if (record.isObject()) {
+                applyJournalRecord(record.object());
+                ++journalRecords;
+            }
+        }
+        journal.close();
+    }
+
+    qDebug() << "Loaded document catalog with" << entries.size() << "entries";
+    return found;
+}
+
+void DocumentCatalog::upsert(const CatalogEntry& entry)
+{
+    QMutexLocker locker(&mutex);
+
+    unindexEntry(entry.id);
+    indexEntry(entry);
+
+    QJsonObject record;
+    record["op"] = "put";
+    record["entry"] = entry.toJson();
+    appendToJournal(record);
+}
+
+void DocumentCatalog::remove(const QString& documentId)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!entries.contains(documentId)) {
+        return;
+    }
+    unindexEntry(documentId);
+
+    QJsonObject record;
+    record["op"] = "remove";
+    record["id"] = documentId;
+    appendToJournal(record);
+}
+
+void DocumentCatalog::replaceAll(const QVector<CatalogEntry>& newEntries)
+{
+    QMutexLocker locker(&mutex);
+
+    entries.clear();
+    byOwner.clear();
+    bySharedUser.clear();
+    publicDocuments.clear();
+
+    entries.reserve(newEntries.size());
+    for (const CatalogEntry& entry : newEntries) {
+        indexEntry(entry);
+    }
+    writeSnapshot();
+}
+
+void DocumentCatalog::compact()
+{
+    QMutexLocker locker(&mutex);
+    writeSnapshot();
+}
+
+void DocumentCatalog::writeSnapshot()
+{
+    QJsonArray entriesArray;
+    for (const CatalogEntry& entry : std::as_const(entries)) {
+        entriesArray.append(entry.toJson());
+    }
+    QJsonObject root;
+    root["entries"] = entriesArray;
+
+    QDir().mkpath(directory);
+    QSaveFile snapshot(snapshotPath());
+    if (!snapshot.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write catalog snapshot";
+        return;
+    }
+    snapshot.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!snapshot.commit()) {
+        qDebug() << "Failed to commit catalog snapshot";
+        return;
+    }
+
+    // The snapshot now contains every journaled change
+    QFile::remove(journalPath());
+    journalRecords = 0;
+}
+
+bool DocumentCatalog::contains(const QString& documentId) const
+{
+    QMutexLocker locker(&mutex);
+    return entries.contains(documentId);
+}
+
+bool DocumentCatalog::lookup(const QString& documentId, CatalogEntry* entry) const
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.constFind(documentId);
+    if (it == entries.constEnd()) {
+        return false;
+    }
+    if (entry) {
+        *entry = it.value();
+    }
+    return true;
+}
+
+int DocumentCatalog::size() const
+{
+    QMutexLocker locker(&mutex);
+    return entries.size();
+}
+
+QVector<CatalogEntry> DocumentCatalog::query(const CatalogQuery& query, int* totalMatches) const
+{
+    QMutexLocker locker(&mutex);
+
+    // Start from the smallest secondary index that applies
+    QSet<QString> candidates;
+    bool restricted = false;
+    auto restrictTo = [&](const QSet<QString>& ids) {
+        if (!restricted) {
+            candidates = ids;
+            restricted = true;
+        } else {
+            candidates.intersect(ids);
+        }
+    };
+
+    if (!query.ownerId.isEmpty()) {
+        restrictTo(byOwner.value(query.ownerId));
+    }
+    if (!query.sharedWithUserId.isEmpty()) {
+        restrictTo(bySharedUser.value(query.sharedWithUserId));
+    }
+    if (!query.accessibleTo.isEmpty()) {
+        QSet<QString> accessible = byOwner.value(query.accessibleTo);
+        accessible.unite(bySharedUser.value(query.accessibleTo));
+        accessible.unite(publicDocuments);
+        restrictTo(accessible);
+    }
+
+    QVector<const CatalogEntry*> matches;
+    auto consider = [&](const CatalogEntry& entry) {
+        if (query.titleFilter.isEmpty() || entry.title.contains(query.titleFilter, Qt::CaseInsensitive)) {
+            matches.append(&entry);
+        }
+    };
+
+    if (restricted) {
+        matches.reserve(candidates.size());
+        for (const QString& id : std::as_const(candidates)) {
+            auto it = entries.constFind(id);
+            if (it != entries.constEnd()) {
+                consider(it.value());
+            }
+        }
+    } else {
+        matches.reserve(entries.size());
+        for (const CatalogEntry& entry : entries) {
+            consider(entry);
+        }
+    }
+
+    if (totalMatches) {
+        *totalMatches = matches.size();
+    }
+
+    int offset = qBound(0, query.offset, int(matches.size()));
+    int end = query.limit < 0 ? int(matches.size()) : qMin(int(matches.size()), offset + query.limit);
+
+    // Only the requested page needs to be in order
+    auto newestFirst = [](const CatalogEntry* a, const CatalogEntry* b) {
+        if (a->lastModified != b->lastModified) {
+            return a->lastModified > b->lastModified;
+        }
+        return a->id < b->id;
+    };
+    std::partial_sort(matches.begin(), matches.begin() + end, matches.end(), newestFirst);
+
+    QVector<CatalogEntry> page;
+    page.reserve(end - offset);
+    for (int i = offset; i < end; ++i) {
+        page.append(*matches[i]);
+    }
+    return page;
+}
+
+void DocumentCatalog::indexEntry(const CatalogEntry& entry)
+{
+    entries.insert(entry.id, entry);
+    byOwner[entry.ownerId].insert(entry.id);
+    for (auto it = entry.sharedWith.begin(); it != entry.sharedWith.end(); ++it) {
+        bySharedUser[it.key()].insert(entry.id);
+    }
+    if (entry.isPublic) {
+        publicDocuments.insert(entry.id);
+    }
+}
+
+void DocumentCatalog::unindexEntry(const QString& documentId)
+{
+    auto it = entries.find(documentId);
+    if (it == entries.end()) {
+        return;
+    }
+
+    const CatalogEntry& entry = it.value();
+    auto ownerIt = byOwner.find(entry.ownerId);
+    if (ownerIt != byOwner.end()) {
+        ownerIt->remove(documentId);
+        if (ownerIt->isEmpty()) {
+            byOwner.erase(ownerIt);
+        }
+    }
+    for (auto shared = entry.sharedWith.begin(); shared != entry.sharedWith.end(); ++shared) {
+        auto userIt = bySharedUser.find(shared.key());
+        if (userIt != bySharedUser.end()) {
+            userIt->remove(documentId);
+            if (userIt->isEmpty()) {
+                bySharedUser.erase(userIt);
+            }
+        }
+    }
+    publicDocuments.remove(documentId);
+    entries.erase(it);
+}
+
+void DocumentCatalog::appendToJournal(const QJsonObject& record)
+{
+    QDir().mkpath(directory);
+    QFile journal(journalPath());
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Failed to append to catalog journal";
+        return;
+    }
+    journal.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    journal.close();
+    ++journalRecords;
+
+    if (journalRecords > qMax(MinJournalRecordsBeforeCompaction, int(entries.size()) / 2)) {
+        writeSnapshot();
+    }
+}
+
+void DocumentCatalog::applyJournalRecord(const QJsonObject& record)
+{
+    QString op = record["op"].toString();
+    if (op == "put") {
+        CatalogEntry entry = CatalogEntry::fromJson(record["entry"].toObject());
+        unindexEntry(entry.id);
+        indexEntry(entry);
+    } else if (op == "remove") {
+        unindexEntry(record["id"].toString());
+    }
+}
@@ -1,6 +1,137 @@
 // EditOperation.cpp
 #include "EditOperation.h"
 
+#include <QJsonArray>
+
+namespace {
+
+const char* kindName(EditOperation::Kind kind)
+{
+    switch (kind) {
+    case EditOperation::Kind::MoveRange: return "move";
+    case EditOperation::Kind::Indent: return "indent";
+    case EditOperation::Kind::Outdent: return "outdent";
+    case EditOperation::Kind::ReplaceAll: return "replace_all";
+    case EditOperation::Kind::Replace: break;
+    }
+    return "replace";
+}
+
+EditOperation::Kind kindFromName(const QString& name)
+{
+    if (name == "move") return EditOperation::Kind::MoveRange;
+    if (name == "indent") return EditOperation::Kind::Indent;
+    if (name == "outdent") return EditOperation::Kind::Outdent;
+    if (name == "replace_all") return EditOperation::Kind::ReplaceAll;
+    return EditOperation::Kind::Replace;
+}
+
+EditOperation replaceStep(const EditOperation& source, int position, int deletionLength, const QString& insertion)
+{
+    EditOperation step;
+    step.userId = source.userId;
+    step.documentId = source.documentId;
+    step.position = position;
+    step.deletionLength = deletionLength;
+    step.insertion = insertion;
+    return step;
+}
+
+} // namespace
+
+QVector<EditOperation> EditOperation::expand(const TextReader& textAt, int textLength) const
+{
+    QVector<EditOperation> steps;
+    if (position < 0 || deletionLength < 0 || position + deletionLength > textLength) {
+        return steps;
+    }
+
+    switch (kind) {
+    case Kind::Replace:
+        steps.append(*this);
+        break;
+
+    case Kind::MoveRange: {
+        const int rangeEnd = position + deletionLength;
+        if (deletionLength == 0 || targetPosition < 0 || targetPosition > textLength
+            || (targetPosition > position && targetPosition < rangeEnd)) {
+            break;
+        }
+        // The step further into the text goes first so the other's offset holds
+        const QString moved = textAt(position, deletionLength);
+        if (targetPosition <= position) {
+            steps.append(replaceStep(*this, position, deletionLength, QString()));
+            steps.append(replaceStep(*this, targetPosition, 0, moved));
+        } else {
+            steps.append(replaceStep(*this, targetPosition, 0, moved));
+            steps.append(replaceStep(*this, position, deletionLength, QString()));
+        }
+        break;
+    }
+
+    case Kind::Indent:
+    case Kind::Outdent: {
+        if (insertion.isEmpty()) {
+            break;
+        }
+        // Line starts inside the range, last first so earlier offsets hold
+        const QString lines = textAt(position, deletionLength);
+        QVector<int> lineStarts{0};
+        for (int i = 0; i < lines.length(); ++i) {
+            if (lines[i] == QLatin1Char('\n')) {
+                lineStarts.append(i + 1);
+            }
+        }
+        for (int i = lineStarts.size() - 1; i >= 0; --i) {
+            const int start = lineStarts[i];
+            if (kind == Kind::Indent) {
+                // Blank lines are left alone
+                if (start < lines.length() && lines[start] != QLatin1Char('\n')) {
+                    steps.append(replaceStep(*this, position + start, 0, insertion));
+                }
+                continue;
+            }
+            int width = 0;
+            if (start < lines.length() && lines[start] == QLatin1Char('\t')) {
+                width = 1;
+            } else {
+                while (width < insertion.length() && start + width < lines.length()
+                       && lines[start + width] == QLatin1Char(' ')) {
+                    ++width;
+                }
+            }
+            if (width > 0) {
+                steps.append(replaceStep(*this, position + start, width, QString()));
+            }
+        }
+        break;
+    }
+
+    case Kind::ReplaceAll: {
+        if ((!lengths.isEmpty() && lengths.size() != positions.size())
+            || (!replacements.isEmpty() && replacements.size() != positions.size())) {
+            break;
+        }
+        const auto lengthAt = [this](int i) { return lengths.isEmpty() ? deletionLength : lengths[i]; };
+
+        // Matches must ascend without overlapping
+        int previousEnd = 0;
+        for (int i = 0; i < positions.size(); ++i) {
+            if (positions[i] < previousEnd || lengthAt(i) < 0 || positions[i] + lengthAt(i) > textLength) {
+                return QVector<EditOperation>();
+            }
+            previousEnd = positions[i] + lengthAt(i);
+        }
+        for (int i = positions.size() - 1; i >= 0; --i) {
+            steps.append(replaceStep(*this, positions[i], lengthAt(i),
+                                     replacements.isEmpty() ? insertion : replacements[i]));
+        }
+        break;
+    }
+    }
+    return steps;
+}
+
 QJsonObject EditOperation::toJson() const {
     QJsonObject json;
     json["userId"] = userId;
@@ -8,6 +139,33 @@ QJsonObject EditOperation::toJson() const {
     json["position"] = position;
     json["insertion"] = insertion;
     json["deletionLength"] = deletionLength;
+
+    // Plain replacements keep the original message shape
+    if (kind != Kind::Replace) {
+        json["kind"] = kindName(kind);
+    }
+    if (kind == Kind::MoveRange) {
+        json["target"] = targetPosition;
+    } else if (kind == Kind::ReplaceAll) {
+        QJsonArray matches;
+        for (int match : positions) {
+            matches.append(match);
+        }
+        json["positions"] = matches;
+        if (!lengths.isEmpty()) {
+            QJsonArray matchLengths;
+            for (int length : lengths) {
+                matchLengths.append(length);
+            }
+            json["lengths"] = matchLengths;
+        }
+        if (!replacements.isEmpty()) {
+            json["replacements"] = QJsonArray::fromStringList(replacements);
+        }
+    }
+    if (sequence != 0) {
+        json["sequence"] = sequence;
+    }
     return json;
 }
 
@@ -18,5 +176,17 @@ EditOperation EditOperation::fromJson(const QJsonObject& json) {
     op.position = json["position"].toInt();
     op.insertion = json["insertion"].toString();
     op.deletionLength = json["deletionLength"].toInt();
+    op.kind = kindFromName(json["kind"].toString());
+    op.targetPosition = json["target"].toInt();
+    for (const QJsonValue& match : json["positions"].toArray()) {
+        op.positions.append(match.toInt());
+    }
+    for (const QJsonValue& length : json["lengths"].toArray()) {
+        op.lengths.append(length.toInt());
+    }
+    for (const QJsonValue& replacement : json["replacements"].toArray()) {
+        op.replacements.append(replacement.toString());
+    }
+    op.sequence = json["sequence"].toInt();
     return op;
-}
\ No newline at end of file
+}
@@ -0,0 +1,143 @@
+// FindReplaceBar.cpp
+#include "FindReplaceBar.h"
+#include "CodeEditorWidget.h"
+
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QGridLayout>
+#include <QKeyEvent>
+
+FindReplaceBar::FindReplaceBar(CodeEditorWidget* editor, QWidget* parent)
+    : QWidget(parent)
+    , editor(editor)
+{
+    QGridLayout* layout = new QGridLayout(this);
+    layout->setContentsMargins(0, 2, 0, 2);
+
+    findEdit = new QLineEdit(this);
+    findEdit->setPlaceholderText("Find");
+    layout->addWidget(findEdit, 0, 0);
+
+    QPushButton* previousButton = new QPushButton("Previous", this);
+    layout->addWidget(previousButton, 0, 1);
+    QPushButton* nextButton = new QPushButton("Next", this);
+    layout->addWidget(nextButton, 0, 2);
+
+    caseBox = new QCheckBox("Match case", this);
+    layout->addWidget(caseBox, 0, 3);
+    wordsBox = new QCheckBox("Whole words", this);
+    layout->addWidget(wordsBox, 0, 4);
+    regexBox = new QCheckBox("Regex", this);
+    layout->addWidget(regexBox, 0, 5);
+
+    replaceEdit = new QLineEdit(this);
+    replaceEdit->setPlaceholderText("Replace");
+    layout->addWidget(replaceEdit, 1, 0);
+
+    QPushButton* replaceButton = new QPushButton("Replace", this);
+    layout->addWidget(replaceButton, 1, 1);
+    QPushButton* replaceAllButton = new QPushButton("Replace All", this);
+    layout->addWidget(replaceAllButton, 1, 2);
+
+    countLabel = new QLabel(this);
+    layout->addWidget(countLabel, 1, 3, 1, 2);
+
+    QPushButton* closeButton = new QPushButton("Close", this);
+    layout->addWidget(closeButton, 1, 5);
+    layout->setColumnStretch(0, 1);
+
+    connect(findEdit, &QLineEdit::textChanged, this, &FindReplaceBar::onQueryChanged);
+    connect(findEdit, &QLineEdit::returnPressed, this, &FindReplaceBar::onFindNext);
+    connect(replaceEdit, &QLineEdit::returnPressed, this, &FindReplaceBar::onReplace);
+    connect(caseBox, &QCheckBox::toggled, this, &FindReplaceBar::onQueryChanged);
+    connect(wordsBox, &QCheckBox::toggled, this, &FindReplaceBar::onQueryChanged);
+    connect(regexBox, &QCheckBox::toggled, this, &FindReplaceBar::onQueryChanged);
+    connect(previousButton, &QPushButton::clicked, this, &FindReplaceBar::onFindPrevious);
+    connect(nextButton, &QPushButton::clicked, this, &FindReplaceBar::onFindNext);
+    connect(replaceButton, &QPushButton::clicked, this, &FindReplaceBar::onReplace);
+    connect(replaceAllButton, &QPushButton::clicked, this, &FindReplaceBar::onReplaceAll);
+    connect(closeButton, &QPushButton::clicked, this, &FindReplaceBar::dismiss);
+    connect(editor, &CodeEditorWidget::searchMatchesChanged, this, &FindReplaceBar::onMatchesChanged);
+
+    hide();
+}
+
+void FindReplaceBar::activate()
+{
+    // A selection within one line becomes the search text
+    const QString selected = editor->textCursor().selectedText();
+    if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+        findEdit->setText(selected);
+    }
+    show();
+    findEdit->setFocus();
+    findEdit->selectAll();
+    onQueryChanged();
+}
+
+void FindReplaceBar::dismiss()
+{
+    editor->clearSearch();
+    hide();
+    editor->setFocus();
+}
+
+void FindReplaceBar::keyPressEvent(QKeyEvent* event)
+{
+    if (event->key() == Qt::Key_Escape) {
+        dismiss();
+        event->accept();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+void FindReplaceBar::onQueryChanged()
+{
+    if (!isVisible()) {
+        return;
+    }
+
+    TextSearch::Query query;
+    query.pattern = findEdit->text();
+    query.caseSensitive = caseBox->isChecked();
+    query.wholeWords = wordsBox->isChecked();
+    query.regularExpression = regexBox->isChecked();
+    if (!editor->setSearchQuery(query)) {
+        countLabel->setText("Invalid pattern: " + editor->search().errorString());
+    }
+}
+
+void FindReplaceBar::onMatchesChanged(int count)
+{
+    if (!editor->search().isActive()) {
+        if (editor->search().errorString().isEmpty()) {
+            countLabel->clear();
+        }
+        return;
+    }
+    countLabel->setText(count == 1 ? QString("1 match") : QString("%1 matches").arg(count));
+}
+
+void FindReplaceBar::onFindNext()
+{
+    editor->findNext(false);
+}
+
+void FindReplaceBar::onFindPrevious()
+{
+    editor->findNext(true);
+}
+
+void FindReplaceBar::onReplace()
+{
+    editor->replaceCurrent(replaceEdit->text());
+}
+
+void FindReplaceBar::onReplaceAll()
+{
+    const int replaced = editor->replaceAll(replaceEdit->text());
+    countLabel->setText(QString("Replaced %1").arg(replaced));
+}
@@ -0,0 +1,158 @@
+// HistoryPlaybackDialog.cpp
+#include "HistoryPlaybackDialog.h"
+
+#include <QPlainTextEdit>
+#include <QSlider>
+#include <QPushButton>
+#include <QComboBox>
+#include <QLabel>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QTextCursor>
+#include <QSignalBlocker>
+#include <QFontDatabase>
+
+namespace {
+
+// Playback advances speed revisions per tick
+const int PlaybackTickMs = 33;
+
+// Forward moves up to this many revisions are applied as edits, not reloads
+const int MaxIncrementalStep = 64;
+
+} // namespace
+
+HistoryPlaybackDialog::HistoryPlaybackDialog(const OperationLog& operationLog, const QString& title, QWidget* parent)
+    : QDialog(parent)
+    , log(operationLog)
+    , shownRevision(operationLog.firstRevision())
+{
+    setWindowTitle("History - " + title);
+    resize(800, 600);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+
+    view = new QPlainTextEdit(this);
+    view->setReadOnly(true);
+    view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    view->setLineWrapMode(QPlainTextEdit::NoWrap);
+    view->setUndoRedoEnabled(false);
+    layout->addWidget(view);
+
+    // The slider spans the log; values are revisions relative to its start
+    slider = new QSlider(Qt::Horizontal, this);
+    slider->setRange(0, log.entryCount());
+    layout->addWidget(slider);
+
+    QHBoxLayout* controls = new QHBoxLayout();
+    playButton = new QPushButton("Play", this);
+    controls->addWidget(playButton);
+
+    speedBox = new QComboBox(this);
+    for (int speed : {1, 2, 4, 8, 16, 64}) {
+        speedBox->addItem(QString::number(speed) + "x", speed);
+    }
+    controls->addWidget(speedBox);
+
+    infoLabel = new QLabel(this);
+    controls->addWidget(infoLabel, 1);
+    layout->addLayout(controls);
+
+    playTimer = new QTimer(this);
+    playTimer->setInterval(PlaybackTickMs);
+
+    connect(slider, &QSlider::valueChanged, this, &HistoryPlaybackDialog::onSliderMoved);
+    connect(playButton, &QPushButton::clicked, this, &HistoryPlaybackDialog::onPlayToggled);
+    connect(playTimer, &QTimer::timeout, this, &HistoryPlaybackDialog::onPlaybackTick);
+
+    // Open on the latest revision
+    seekTo(log.lastRevision());
+    QSignalBlocker blocker(slider);
+    slider->setValue(sliderValue(shownRevision));
+}
+
+void HistoryPlaybackDialog::onSliderMoved(int value)
+{
+    const quint64 revision = log.firstRevision() + quint64(qMax(0, value));
+    if (revision > shownRevision && revision - shownRevision <= quint64(MaxIncrementalStep)) {
+        stepForward(revision);
+    } else {
+        seekTo(revision);
+    }
+}
+
+void HistoryPlaybackDialog::onPlayToggled()
+{
+    if (playTimer->isActive()) {
+        playTimer->stop();
+        playButton->setText("Play");
+        return;
+    }
+
+    // Playing from the end starts over
+    if (shownRevision >= log.lastRevision()) {
+        seekTo(log.firstRevision());
+    }
+    playTimer->start();
+    playButton->setText("Pause");
+}
+
+void HistoryPlaybackDialog::onPlaybackTick()
+{
+    const quint64 step = quint64(speedBox->currentData().toInt());
+    const quint64 target = qMin(log.lastRevision(), shownRevision + step);
+    stepForward(target);
+
+    QSignalBlocker blocker(slider);
+    slider->setValue(sliderValue(shownRevision));
+
+    if (shownRevision >= log.lastRevision()) {
+        playTimer->stop();
+        playButton->setText("Play");
+    }
+}
+
+void HistoryPlaybackDialog::seekTo(quint64 revision)
+{
+    TextRope text;
+    if (!log.textAt(revision, &text)) {
+        return;
+    }
+    view->setPlainText(text.toString());
+    shownRevision = revision;
+    updateInfo();
+}
+
+void HistoryPlaybackDialog::stepForward(quint64 revision)
+{
+    // Replays the logged edits on the view, leaving its scroll position alone
+    QTextCursor cursor(view->document());
+    cursor.beginEditBlock();
+    while (shownRevision < revision) {
+        const OperationLog::Entry& entry = log.entryFor(shownRevision + 1);
+        cursor.setPosition(entry.position);
+        cursor.setPosition(entry.position + entry.removedLength, QTextCursor::KeepAnchor);
+        cursor.insertText(entry.insertedText);
+        ++shownRevision;
+    }
+    cursor.endEditBlock();
+    updateInfo();
+}
+
+void HistoryPlaybackDialog::updateInfo()
+{
+    QString info = QString("Revision %1 of %2").arg(shownRevision).arg(log.lastRevision());
+    if (shownRevision > log.firstRevision()) {
+        const OperationLog::Entry& entry = log.entryFor(shownRevision);
+        info += QString(" - %1, %2")
+            .arg(entry.userId.isEmpty() ? QString("unknown") : entry.userId,
+                 entry.timestamp.toString("yyyy-MM-dd hh:mm:ss"));
+    }
+    infoLabel->setText(info);
+}
+
+int HistoryPlaybackDialog::sliderValue(quint64 revision) const
+{
+    return int(revision - log.firstRevision());
+}
@@ -0,0 +1,71 @@
+// IntervalIndex.cpp
+#include "IntervalIndex.h"
+
+#include <algorithm>
+#include <climits>
+
+void IntervalIndex::clear()
+{
+    intervals.clear();
+    maxEnd.clear();
+}
+
+void IntervalIndex::insert(int start, int end, int value)
+{
+    if (end > start) {
+        intervals.append(Interval{start, end, value});
+    }
+}
+
+void IntervalIndex::build()
+{
+    std::sort(intervals.begin(), intervals.end(),
+              [](const Interval& a, const Interval& b) { return a.start < b.start; });
+    maxEnd.resize(intervals.size());
+    buildMaxEnd(0, intervals.size());
+}
+
+int IntervalIndex::buildMaxEnd(int low, int high)
+{
+    // The node of [low, high) is its middle element
+    if (low >= high) {
+        return INT_MIN;
+    }
+    const int middle = low + (high - low) / 2;
+    const int result = std::max({intervals[middle].end,
+                                 buildMaxEnd(low, middle),
+                                 buildMaxEnd(middle + 1, high)});
+    maxEnd[middle] = result;
+    return result;
+}
+
+QVector<int> IntervalIndex::overlapping(int start, int end) const
+{
+    QVector<int> result;
+    if (end > start) {
+        collect(0, intervals.size(), start, end, &result);
+    }
+    return result;
+}
+
+void IntervalIndex::collect(int low, int high, int start, int end, QVector<int>* out) const
+{
+    if (low >= high) {
+        return;
+    }
+    const int middle = low + (high - low) / 2;
+    // Nothing in this subtree reaches the query
+    if (maxEnd[middle] <= start) {
+        return;
+    }
+
+    collect(low, middle, start, end, out);
+    const Interval& interval = intervals[middle];
+    if (interval.start < end) {
+        if (interval.end > start) {
+            out->append(interval.value);
+        }
+        // Everything to the right starts at or after this one
+        collect(middle + 1, high, start, end, out);
+    }
+}
@@ -0,0 +1,301 @@
+// LineIndex.cpp
+#include "LineIndex.h"
+
+LineIndex::LineIndex()
+    : root(-1)
+    , seed(0x2545F491u)
+{
+    reset(QString());
+}
+
+void LineIndex::reset(const QString& text)
+{
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+
+    std::vector<int> lengths;
+    int pending = 0;
+    const QChar* data = text.constData();
+    const int length = text.length();
+    for (int i = 0; i < length; ++i) {
+        ++pending;
+        if (data[i] == QLatin1Char('\n')) {
+            lengths.push_back(pending);
+            pending = 0;
+        }
+    }
+    lengths.push_back(pending);
+
+    nodes.reserve(lengths.size());
+    root = buildFromLengths(lengths);
+}
+
+void LineIndex::applyEdit(int position, int removedLength, const QString& insertedText)
+{
+    if (position < 0 || removedLength < 0 || position + removedLength > textLength()) {
+        return;
+    }
+
+    // The lines touched by the removed range are replaced by the lines of
+    // (untouched prefix + inserted text + untouched suffix)
+    int firstStart = 0;
+    int lastStart = 0;
+    const int first = findLine(position, &firstStart);
+    const int last = findLine(position + removedLength, &lastStart);
+    const int lastLength = lineLengthWithBreak(last, &lastStart);
+    const int prefixLength = position - firstStart;
+    const int suffixLength = lastStart + lastLength - (position + removedLength);
+
+    std::vector<int> lengths;
+    int pending = prefixLength;
+    const QChar* data = insertedText.constData();
+    const int insertedLength = insertedText.length();
+    for (int i = 0; i < insertedLength; ++i) {
+        ++pending;
+        if (data[i] == QLatin1Char('\n')) {
+            lengths.push_back(pending);
+            pending = 0;
+        }
+    }
+    lengths.push_back(pending + suffixLength);
+
+    int left = -1;
+    int middle = -1;
+    int right = -1;
+    split(root, first, &left, &middle);
+    split(middle, last - first + 1, &middle, &right);
+    releaseTree(middle);
+    root = merge(merge(left, buildFromLengths(lengths)), right);
+}
+
+int LineIndex::lineCount() const
+{
+    return count(root);
+}
+
+int LineIndex::textLength() const
+{
+    return sum(root);
+}
+
+int LineIndex::lineAt(int offset) const
+{
+    int start = 0;
+    return findLine(offset, &start);
+}
+
+int LineIndex::lineStart(int line) const
+{
+    int start = 0;
+    lineLengthWithBreak(qBound(0, line, lineCount() - 1), &start);
+    return start;
+}
+
+int LineIndex::lineLength(int line) const
+{
+    line = qBound(0, line, lineCount() - 1);
+    int start = 0;
+    int length = lineLengthWithBreak(line, &start);
+    return line < lineCount() - 1 ? length - 1 : length;
+}
+
+void LineIndex::lineColumnAt(int offset, int* line, int* column) const
+{
+    offset = qBound(0, offset, textLength());
+    int start = 0;
+    int found = findLine(offset, &start);
+    if (line) {
+        *line = found;
+    }
+    if (column) {
+        *column = offset - start;
+    }
+}
+
+int LineIndex::offsetAt(int line, int column) const
+{
+    line = qBound(0, line, lineCount() - 1);
+    return lineStart(line) + qBound(0, column, lineLength(line));
+}
+
+int LineIndex::createNode(int length)
+{
+    // xorshift32 priorities keep the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.priority = seed;
+    node.length = length;
+    node.count = 1;
+    node.sum = length;
+
+    if (!freeNodes.empty()) {
+        int index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = node;
+        return index;
+    }
+    nodes.push_back(node);
+    return int(nodes.size()) - 1;
+}
+
+void LineIndex::releaseTree(int node)
+{
+    std::vector<int> pending;
+    if (node >= 0) {
+        pending.push_back(node);
+    }
+    while (!pending.empty()) {
+        int current = pending.back();
+        pending.pop_back();
+        if (nodes[current].left >= 0) {
+            pending.push_back(nodes[current].left);
+        }
+        if (nodes[current].right >= 0) {
+            pending.push_back(nodes[current].right);
+        }
+        freeNodes.push_back(current);
+    }
+}
+
+void LineIndex::update(int node)
+{
+    Node& n = nodes[node];
+    n.count = 1 + count(n.left) + count(n.right);
+    n.sum = n.length + sum(n.left) + sum(n.right);
+}
+
+void LineIndex::split(int node, int lines, int* left, int* right)
+{
+    if (node < 0) {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+
+    int leftCount = count(nodes[node].left);
+    int l = -1;
+    int r = -1;
+    if (lines <= leftCount) {
+        split(nodes[node].left, lines, &l, &r);
+        nodes[node].left = r;
+        update(node);
+        *left = l;
+        *right = node;
+    } else {
+        split(nodes[node].right, lines - leftCount - 1, &l, &r);
+        nodes[node].right = l;
+        update(node);
+        *left = node;
+        *right = r;
+    }
+}
+
+int LineIndex::merge(int left, int right)
+{
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+
+    if (nodes[left].priority > nodes[right].priority) {
+        int merged = merge(nodes[left].right, right);
+        nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+
+    int merged = merge(left, nodes[right].left);
+    nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+int LineIndex::buildFromLengths(const std::vector<int>& lengths)
+{
+    // Cartesian-tree build: O(k) for k lines instead of k merges
+    std::vector<int> spine;
+    for (int length : lengths) {
+        int node = createNode(length);
+        int lastPopped = -1;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[node].priority) {
+            lastPopped = spine.back();
+            spine.pop_back();
+            update(lastPopped);
+        }
+        nodes[node].left = lastPopped;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = node;
+        }
+        spine.push_back(node);
+    }
+
+    while (spine.size() > 1) {
+        update(spine.back());
+        spine.pop_back();
+    }
+    if (spine.empty()) {
+        return -1;
+    }
+    update(spine.front());
+    return spine.front();
+}
+
+int LineIndex::findLine(int offset, int* lineStartOffset) const
+{
+    int node = root;
+    int line = 0;
+    int base = 0;
+
+    while (node >= 0) {
+        const Node& n = nodes[node];
+        int leftSum = sum(n.left);
+        if (offset < leftSum) {
+            node = n.left;
+        } else if (offset < leftSum + n.length) {
+            *lineStartOffset = base + leftSum;
+            return line + count(n.left);
+        } else {
+            line += count(n.left) + 1;
+            base += leftSum + n.length;
+            offset -= leftSum + n.length;
+            node = n.right;
+        }
+    }
+
+    // The end of the text belongs to the last line
+    int last = lineCount() - 1;
+    lineLengthWithBreak(last, lineStartOffset);
+    return last;
+}
+
+int LineIndex::lineLengthWithBreak(int line, int* lineStartOffset) const
+{
+    int node = root;
+    int base = 0;
+
+    while (node >= 0) {
+        const Node& n = nodes[node];
+        int leftCount = count(n.left);
+        if (line < leftCount) {
+            node = n.left;
+        } else if (line == leftCount) {
+            *lineStartOffset = base + sum(n.left);
+            return n.length;
+        } else {
+            base += sum(n.left) + n.length;
+            line -= leftCount + 1;
+            node = n.right;
+        }
+    }
+
+    *lineStartOffset = base;
+    return 0;
+}
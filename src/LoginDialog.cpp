@@ -128,10 +128,8 @@ void LoginDialog::validateInput()
 
 bool LoginDialog::login(const QString& username, const QString& password)
 {
-    QJsonObject users = UserStorage::readUsersFromFile();
-
-    if (users.contains(username)) {
-        QJsonObject userInfo = users[username].toObject();
+    QJsonObject userInfo;
+    if (UserStorage::findUser(username, &userInfo)) {
         if (userInfo["password"].toString() == password) {
             QString email = userInfo["email"].toString();
             user = std::make_shared<RegisteredUser>(username, username, email);
@@ -145,19 +143,12 @@ bool LoginDialog::login(const QString& username, const QString& password)
 
 bool LoginDialog::registerUser(const QString& username, const QString& email, const QString& password)
 {
-    QJsonObject users = UserStorage::readUsersFromFile();
-
-    if (users.contains(username)) {
-        return false; // User already exists
-    }
-
     QJsonObject newUser;
     newUser["email"] = email;
     newUser["password"] = password;
 
-    users[username] = newUser;
-
-    if (!UserStorage::writeUsersToFile(users)) {
+    // Fails if the user already exists
+    if (!UserStorage::addUser(username, newUser)) {
         return false;
     }
 
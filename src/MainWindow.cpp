@@ -4,6 +4,12 @@
 #include "LoginDialog.h"
 #include "CollaborationClient.h"
 #include "DocumentStorage.h"
+#include "TextFileLoader.h"
+#include "HistoryPlaybackDialog.h"
+#include "MinimapWidget.h"
+#include "FindReplaceBar.h"
+#include "OutlinePanel.h"
+#include "CompletionIndex.h"
 
 #include <QSplitter>
 #include <QTextEdit>
@@ -23,9 +29,13 @@
 #include <QKeyEvent>
 #include <QDialogButtonBox>
 #include <QComboBox>
+#include <QLineEdit>
 #include <QDebug>
 #include <QColor>
 #include <QScrollBar>
+#include <QProgressDialog>
+#include <QFileInfo>
+#include <QThreadPool>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -43,17 +53,28 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    if (saveTimer) {
+        saveCurrentDocument();
+    }
+    // Background saves must finish before the process exits
+    QThreadPool::globalInstance()->waitForDone();
     delete ui;
 }
 
 void MainWindow::setupConnections()
 {
     // Connect code editor signals
-    connect(codeEditor.get(), &CodeEditorWidget::editorContentChanged,
-            this, &MainWindow::onTextChanged);
+    connect(codeEditor.get(), &CodeEditorWidget::localEditApplied,
+            this, &MainWindow::onLocalEdit);
     connect(codeEditor.get(), &CodeEditorWidget::cursorPositionChanged,
             this, &MainWindow::onCursorPositionChanged);
 
+    // Persist edits once typing pauses rather than on every keystroke
+    saveTimer = std::make_unique<QTimer>();
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(1000);
+    connect(saveTimer.get(), &QTimer::timeout, this, &MainWindow::saveCurrentDocument);
+
     // Connect collaboration client signals
     connect(collaborationClient.get(), &CollaborationClient::connected,
             this, [this]() {
@@ -82,10 +103,30 @@ void MainWindow::setupConnections()
                 }
             });
             
+    // A rich operation the server could not expand goes out again as plain steps
+    connect(collaborationClient.get(), &CollaborationClient::editRejected,
+            this, [this](const QString& documentId, int sequence, const QString& reason) {
+                if (currentDocument && currentDocument->getId() == documentId
+                    && codeEditor->resendAsSteps(sequence)) {
+                    return;
+                }
+                QMessageBox::warning(this, "Collaboration Error",
+                                     "An edit could not be shared with collaborators: " + reason);
+            });
+
+    // The server's copy diverged; it is reseeded from this editor's text
+    connect(collaborationClient.get(), &CollaborationClient::contentSyncRequested,
+            this, [this](const QString& documentId) {
+                if (currentDocument && currentDocument->getId() == documentId && codeEditor) {
+                    codeEditor->flushRemoteEdits();
+                    collaborationClient->sendContentSync(documentId, currentDocument->getContent());
+                }
+            });
+
     connect(collaborationClient.get(), &CollaborationClient::cursorPositionReceived,
-            this, [this](const QString& userId, const QString& username, int position) {
+            this, [this](const QString& userId, const QString& username, int position, int anchor) {
                 if (codeEditor) {
-                    codeEditor->updateRemoteCursor(userId, username, position);
+                    codeEditor->updateRemoteCursor(userId, username, position, anchor);
                 }
             });
             
@@ -99,14 +140,36 @@ void MainWindow::setupConnections()
             this, [this](const QString& content) {
                 if (currentDocument && codeEditor) {
                     qDebug() << "Received latest content, length:" << content.length();
-                    codeEditor->setPlainText(content);
-                    currentDocument->setContent(content);
+                    codeEditor->replaceContent(content);
                 }
             });
 
     connect(collaborationClient.get(), &CollaborationClient::chatMessageReceived,
             this, &MainWindow::onChatMessageReceived);
 
+    // Rich operation kinds are only sent while every peer understands them
+    connect(collaborationClient.get(), &CollaborationClient::documentCapabilitiesChanged,
+            this, [this](const QString& documentId, bool richOperations) {
+                if (currentDocument && currentDocument->getId() == documentId) {
+                    codeEditor->setRichOperationsEnabled(richOperations);
+                }
+            });
+
+    // The server pushes new permission bits when the document's ACL changes
+    connect(collaborationClient.get(), &CollaborationClient::permissionsChanged,
+            this, [this](const QString& documentId, quint32 permissions) {
+                if (!currentDocument || currentDocument->getId() != documentId) return;
+                codeEditor->setReadOnly(!(permissions & DocumentAcl::Edit));
+                if (!(permissions & DocumentAcl::Read)) {
+                    statusLabel->setText("Your access to this document was revoked");
+                }
+            });
+
+    connect(collaborationClient.get(), &CollaborationClient::accessChanged,
+            this, [this](const QString& userId, int level) {
+                onDocumentAccessChanged(userId, static_cast<Document::AccessLevel>(level));
+            });
+
     // Connect chat input
     connect(chatInput.get(), &QTextEdit::textChanged, [this]() {
         // Enable/disable send button based on whether there's text
@@ -137,12 +200,39 @@ void MainWindow::setupUI()
     // Create code editor
     codeEditor = std::make_unique<CodeEditorWidget>();
     codeEditor->setCollaborationManager(collaborationManager);
-    mainSplitter->addWidget(codeEditor.get());
-
-    // Create right panel splitter (user list | chat)
+    completionIndex = new CompletionIndex(this);
+    codeEditor->setCompletionIndex(completionIndex);
+
+    // The find bar sits under the editor and stays hidden until asked for
+    QWidget* editorPanel = new QWidget(mainSplitter.get());
+    QVBoxLayout* editorLayout = new QVBoxLayout(editorPanel);
+    editorLayout->setContentsMargins(0, 0, 0, 0);
+    editorLayout->addWidget(codeEditor.get());
+    findBar = new FindReplaceBar(codeEditor.get());
+    editorLayout->addWidget(findBar);
+    mainSplitter->addWidget(editorPanel);
+
+    // Overview of the whole document beside the editor
+    minimap = new MinimapWidget(codeEditor.get());
+    mainSplitter->addWidget(minimap);
+
+    // Create right panel splitter (outline | user list | chat)
     rightSplitter = std::make_unique<QSplitter>(Qt::Vertical);
     mainSplitter->addWidget(rightSplitter.get());
 
+    // Create outline panel
+    QWidget* outlineWidget = new QWidget(rightSplitter.get());
+    QVBoxLayout* outlineLayout = new QVBoxLayout(outlineWidget);
+    outlineLayout->setContentsMargins(0, 0, 0, 0);
+
+    QLabel* outlineLabel = new QLabel("Outline:");
+    outlineLayout->addWidget(outlineLabel);
+
+    outlinePanel = new OutlinePanel(codeEditor.get());
+    outlineLayout->addWidget(outlinePanel);
+
+    rightSplitter->addWidget(outlineWidget);
+
     // Create user list panel
     QWidget* userListPanel = new QWidget(rightSplitter.get());
     QVBoxLayout* userListLayout = new QVBoxLayout(userListPanel);
@@ -179,8 +269,8 @@ void MainWindow::setupUI()
     rightSplitter->addWidget(chatPanel);
 
     // Set up splitter proportions
-    mainSplitter->setSizes({600, 200});
-    rightSplitter->setSizes({200, 400});
+    mainSplitter->setSizes({600, minimap->sizeHint().width(), 200});
+    rightSplitter->setSizes({200, 150, 300});
 
     // Set up status bar
     statusLabel = std::make_unique<QLabel>("Not logged in");
@@ -190,6 +280,17 @@ void MainWindow::setupUI()
     setupFileMenu();
 
     QMenu* editMenu = menuBar()->addMenu("&Edit");
+    QAction* undoAction = new QAction("Undo", this);
+    undoAction->setShortcut(QKeySequence::Undo);
+    connect(undoAction, &QAction::triggered, codeEditor.get(), &CodeEditorWidget::undoLocalEdit);
+    editMenu->addAction(undoAction);
+
+    QAction* redoAction = new QAction("Redo", this);
+    redoAction->setShortcut(QKeySequence::Redo);
+    connect(redoAction, &QAction::triggered, codeEditor.get(), &CodeEditorWidget::redoLocalEdit);
+    editMenu->addAction(redoAction);
+    editMenu->addSeparator();
+
     QAction* cutAction = new QAction("Cut", this);
     cutAction->setShortcut(QKeySequence::Cut);
     connect(cutAction, &QAction::triggered, codeEditor.get(), &QPlainTextEdit::cut);
@@ -204,6 +305,22 @@ void MainWindow::setupUI()
     pasteAction->setShortcut(QKeySequence::Paste);
     connect(pasteAction, &QAction::triggered, codeEditor.get(), &QPlainTextEdit::paste);
     editMenu->addAction(pasteAction);
+    editMenu->addSeparator();
+
+    QAction* findAction = new QAction("Find/Replace...", this);
+    findAction->setShortcut(QKeySequence::Find);
+    connect(findAction, &QAction::triggered, findBar, &FindReplaceBar::activate);
+    editMenu->addAction(findAction);
+
+    QAction* findNextAction = new QAction("Find Next", this);
+    findNextAction->setShortcut(QKeySequence::FindNext);
+    connect(findNextAction, &QAction::triggered, this, [this]() { codeEditor->findNext(false); });
+    editMenu->addAction(findNextAction);
+
+    QAction* findPreviousAction = new QAction("Find Previous", this);
+    findPreviousAction->setShortcut(QKeySequence::FindPrevious);
+    connect(findPreviousAction, &QAction::triggered, this, [this]() { codeEditor->findNext(true); });
+    editMenu->addAction(findPreviousAction);
 
     QMenu* viewMenu = menuBar()->addMenu("&View");
     QAction* zoomInAction = new QAction("Zoom In", this);
@@ -216,6 +333,22 @@ void MainWindow::setupUI()
     connect(zoomOutAction, &QAction::triggered, codeEditor.get(), &QPlainTextEdit::zoomOut);
     viewMenu->addAction(zoomOutAction);
 
+    viewMenu->addSeparator();
+    QAction* authorshipAction = new QAction("Show Authorship", this);
+    authorshipAction->setCheckable(true);
+    connect(authorshipAction, &QAction::toggled, codeEditor.get(), &CodeEditorWidget::setAuthorshipVisible);
+    viewMenu->addAction(authorshipAction);
+
+    QAction* minimapAction = new QAction("Show Minimap", this);
+    minimapAction->setCheckable(true);
+    minimapAction->setChecked(true);
+    connect(minimapAction, &QAction::toggled, minimap, &QWidget::setVisible);
+    viewMenu->addAction(minimapAction);
+
+    QAction* historyAction = new QAction("History Playback...", this);
+    connect(historyAction, &QAction::triggered, this, &MainWindow::onShowHistory);
+    viewMenu->addAction(historyAction);
+
     QMenu* collaborationMenu = menuBar()->addMenu("&Collaboration");
     QAction* shareAction = new QAction("Share Document", this);
     connect(shareAction, &QAction::triggered, this, &MainWindow::onShareDocument);
@@ -284,6 +417,7 @@ void MainWindow::showLoginDialog()
             
             // Set the user in the collaboration client
             collaborationClient->setUser(currentUser);
+            codeEditor->setLocalUserId(currentUser->getUserId());
             
             updateStatusBar();
             updateTitle();
@@ -432,11 +566,17 @@ void MainWindow::onLogout()
         }
     }
 
+    // Flush edits still waiting for the save timer
+    saveCurrentDocument();
+
     // Clear current state
     currentUser = nullptr;
     currentDocument = nullptr;
     connectedUsers.clear();
 
+    // The server binds a connection to one user, so the next login needs a new one
+    collaborationClient->disconnect();
+
     // Clear UI
     codeEditor->setDocument(nullptr);
     codeEditor->setPlainText("");
@@ -501,7 +641,6 @@ void MainWindow::onNewDocument()
 
         // Set up editor
         codeEditor->setDocument(currentDocument);
-        codeEditor->setPlainText(initialContent);
         codeEditor->setLanguage(currentDocument->getLanguage());
 
         // Update UI
@@ -526,12 +665,36 @@ void MainWindow::onOpenDocument()
     QString fileName = QFileDialog::getOpenFileName(this, "Open Document", "",
                                                   "C++ Files (*.cpp *.h);;Python Files (*.py);;JavaScript Files (*.js);;Java Files (*.java);;All Files (*)");
     if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&file);
-            QString content = in.readAll();
-            file.close();
+        // Show progress only for files large enough to take noticeable time
+        const qint64 progressThreshold = 16 * 1024 * 1024;
+        std::unique_ptr<QProgressDialog> progressDialog;
+        if (TextFileLoader::fileSize(fileName) > progressThreshold) {
+            progressDialog = std::make_unique<QProgressDialog>(
+                "Opening " + QFileInfo(fileName).fileName() + "...", "Cancel", 0, 100, this);
+            progressDialog->setWindowModality(Qt::WindowModal);
+            progressDialog->setMinimumDuration(0);
+        }
 
+        QString content;
+        QString errorMessage;
+        bool cancelled = false;
+        bool loaded = TextFileLoader::load(fileName, &content,
+            [&](qint64 bytesDone, qint64 bytesTotal) {
+                if (!progressDialog) {
+                    return true;
+                }
+                progressDialog->setValue(int(bytesDone * 100 / bytesTotal));
+                cancelled = progressDialog->wasCanceled();
+                return !cancelled;
+            }, &errorMessage);
+        progressDialog.reset();
+
+        if (loaded && currentDocument && openedFilePath == fileName
+            && openedFileDocument.lock() == currentDocument) {
+            // Reopening the file behind the current document reloads it in
+            // place as a diff, so the caret and undo history are kept
+            codeEditor->replaceContent(content, true);
+        } else if (loaded) {
             // Create document
             QFileInfo fileInfo(fileName);
             currentDocument = std::make_shared<Document>(
@@ -539,9 +702,6 @@ void MainWindow::onOpenDocument()
                 fileInfo.fileName(),
                 currentUser);
 
-            // Set content
-            currentDocument->setContent(content);
-
             // Determine language based on file extension
             QString extension = fileInfo.suffix().toLower();
             if (extension == "cpp" || extension == "h") {
@@ -556,10 +716,12 @@ void MainWindow::onOpenDocument()
                 currentDocument->setLanguage("Plain");
             }
 
-            // Set up editor
+            // The document shares the decoded buffer; the editor is filled once
+            currentDocument->setContent(content);
+            content.clear();
             codeEditor->setDocument(currentDocument);
-            codeEditor->setPlainText(content);
-            codeEditor->setLanguage(currentDocument->getLanguage());
+            openedFilePath = fileName;
+            openedFileDocument = currentDocument;
 
             // Update UI
             updateTitle();
@@ -568,8 +730,8 @@ void MainWindow::onOpenDocument()
             // Clear chat
             chatBox->clear();
             chatInput->clear();
-        } else {
-            QMessageBox::critical(this, "Error", "Could not open file: " + fileName);
+        } else if (!cancelled) {
+            QMessageBox::critical(this, "Error", "Could not open file: " + fileName + "\n" + errorMessage);
         }
     }
 }
@@ -598,6 +760,17 @@ void MainWindow::onSaveDocument()
     }
 }
 
+void MainWindow::onShowHistory()
+{
+    if (!currentDocument) {
+        QMessageBox::warning(this, "No Document", "No document is currently open.");
+        return;
+    }
+
+    HistoryPlaybackDialog dialog(currentDocument->getOperationLog(), currentDocument->getTitle(), this);
+    dialog.exec();
+}
+
 void MainWindow::onShareDocument()
 {
     if (!currentUser || !currentDocument) {
@@ -645,6 +818,10 @@ void MainWindow::onShareDocument()
             // Save the document after sharing
             if (DocumentStorage::getInstance().saveDocument(currentDocument)) {
                 qDebug() << "Successfully shared document with user";
+                // Live sessions pick up the change without rejoining
+                if (collaborationClient && collaborationClient->isConnected()) {
+                    collaborationClient->sendAclUpdate(userId, static_cast<int>(level));
+                }
                 QMessageBox::information(this, "Document Shared",
                     "Document shared successfully with " + userId);
             } else {
@@ -667,11 +844,9 @@ void MainWindow::onOpenSharedDocument()
         return;
     }
 
-    bool ok;
-    QString documentId = QInputDialog::getText(this, "Open Shared Document",
-        "Enter Document ID:", QLineEdit::Normal, "", &ok);
-    
-    if (ok && !documentId.isEmpty()) {
+    QString documentId = chooseDocumentFromCatalog();
+
+    if (!documentId.isEmpty()) {
         qDebug() << "Attempting to open shared document:"
                  << "\n  Document ID:" << documentId
                  << "\n  User:" << currentUser->getUsername()
@@ -698,8 +873,7 @@ void MainWindow::onOpenSharedDocument()
         qDebug() << "Found document in storage:"
                  << "\n  Title:" << doc->getTitle()
                  << "\n  Owner:" << (doc->getOwner() ? doc->getOwner()->getUsername() : "Unknown")
-                 << "\n  Content length:" << doc->getContent().length()
-                 << "\n  Content:" << doc->getContent();
+                 << "\n  Content length:" << doc->length();
         
         // Check access level
         Document::AccessLevel accessLevel = doc->getAccessLevel(currentUser->getUserId());
@@ -725,11 +899,8 @@ void MainWindow::onOpenSharedDocument()
         codeEditor->setReadOnly(isReadOnly);
         codeEditor->setLanguage(doc->getLanguage());
         
-        // Get the content from the document
-        QString content = doc->getContent();
-        qDebug() << "Setting editor content, length:" << content.length();
-        codeEditor->setPlainText(content);
-        
+        int contentLength = doc->length();
+
         // Then set up the collaboration client
         if (collaborationClient) {
             collaborationClient->setDocument(doc);
@@ -757,8 +928,148 @@ void MainWindow::onOpenSharedDocument()
                  << "\n  Document ID:" << documentId
                  << "\n  Access Level:" << accessText
                  << "\n  Owner:" << (doc->getOwner() ? doc->getOwner()->getUsername() : "Unknown")
-                 << "\n  Content length:" << content.length();
+                 << "\n  Content length:" << contentLength;
+    }
+}
+
+QString MainWindow::chooseDocumentFromCatalog()
+{
+    // Browse the document catalog instead of typing an ID
+    QDialog dialog(this);
+    dialog.setWindowTitle("Open Shared Document");
+    dialog.resize(520, 420);
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+
+    // Add filters
+    QHBoxLayout* filterLayout = new QHBoxLayout();
+    QLineEdit* titleFilter = new QLineEdit();
+    titleFilter->setPlaceholderText("Filter by title");
+    filterLayout->addWidget(titleFilter);
+
+    QComboBox* scope = new QComboBox();
+    scope->addItem("All accessible");
+    scope->addItem("Shared with me");
+    scope->addItem("Owned by me");
+    filterLayout->addWidget(scope);
+    layout->addLayout(filterLayout);
+
+    // Add document list; further pages load as it scrolls
+    QListWidget* documentList = new QListWidget();
+    layout->addWidget(documentList);
+
+    QLabel* countLabel = new QLabel();
+    layout->addWidget(countLabel);
+
+    // Still allow opening by ID
+    QLineEdit* idInput = new QLineEdit();
+    idInput->setPlaceholderText("Or enter a document ID");
+    layout->addWidget(idInput);
+
+    // Add buttons
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(
+        QDialogButtonBox::Open | QDialogButtonBox::Cancel);
+    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttonBox);
+
+    // The server's catalog when connected, this machine's otherwise
+    const bool remote = collaborationClient->isConnected();
+    const int pageSize = 100;
+    int total = 0;
+    int requestId = 0; // Replies to earlier requests are ignored
+    bool waiting = false;
+
+    const auto addEntry = [&](const CatalogEntry& entry) {
+        QListWidgetItem* item = new QListWidgetItem(
+            QString("%1  (%2, %3)").arg(entry.title, entry.ownerName,
+                                        entry.lastModified.toString("yyyy-MM-dd hh:mm")));
+        item->setData(Qt::UserRole, entry.id);
+        item->setToolTip(entry.id);
+        documentList->addItem(item);
+    };
+    const auto showCount = [&]() {
+        countLabel->setText(QString("Showing %1 of %2").arg(documentList->count()).arg(total));
+    };
+
+    auto loadPage = [&](bool reset) {
+        if (reset) {
+            documentList->clear();
+            total = 0;
+        }
+
+        QString ownerId;
+        QString sharedWithUserId;
+        if (scope->currentIndex() == 1) {
+            sharedWithUserId = currentUser->getUserId();
+        } else if (scope->currentIndex() == 2) {
+            ownerId = currentUser->getUserId();
+        }
+        const QString title = titleFilter->text().trimmed();
+
+        if (remote) {
+            if (reset) {
+                countLabel->setText("Loading...");
+            }
+            waiting = true;
+            collaborationClient->requestCatalog(ownerId, sharedWithUserId, title,
+                                                documentList->count(), pageSize, ++requestId);
+            return;
+        }
+
+        CatalogQuery query;
+        query.accessibleTo = currentUser->getUserId();
+        query.ownerId = ownerId;
+        query.sharedWithUserId = sharedWithUserId;
+        query.titleFilter = title;
+        query.offset = documentList->count();
+        query.limit = pageSize;
+        for (const CatalogEntry& entry : DocumentStorage::getInstance().queryCatalog(query, &total)) {
+            addEntry(entry);
+        }
+        showCount();
+    };
+
+    // Near the bottom of the list, or while it is too short to scroll; the
+    // geometry means nothing until the dialog is shown
+    const auto loadMoreIfNeeded = [&]() {
+        QScrollBar* bar = documentList->verticalScrollBar();
+        if (documentList->isVisible() && !waiting && documentList->count() < total
+            && bar->value() >= bar->maximum() - bar->pageStep() / 2) {
+            loadPage(false);
+        }
+    };
+
+    connect(collaborationClient.get(), &CollaborationClient::catalogReceived, &dialog,
+        [&](const QJsonArray& entries, int matches, int offset, int reply) {
+            if (reply != requestId || offset != documentList->count()) {
+                return;
+            }
+            waiting = false;
+            total = matches;
+            for (const QJsonValue& value : entries) {
+                addEntry(CatalogEntry::fromJson(value.toObject()));
+            }
+            showCount();
+            loadMoreIfNeeded();
+        });
+    connect(titleFilter, &QLineEdit::textChanged, &dialog, [&]() { loadPage(true); });
+    connect(scope, QOverload<int>::of(&QComboBox::currentIndexChanged), &dialog, [&]() { loadPage(true); });
+    connect(documentList->verticalScrollBar(), &QScrollBar::valueChanged, &dialog, [&]() { loadMoreIfNeeded(); });
+    connect(documentList->verticalScrollBar(), &QScrollBar::rangeChanged, &dialog, [&]() { loadMoreIfNeeded(); });
+    connect(documentList, &QListWidget::itemDoubleClicked, &dialog, &QDialog::accept);
+    loadPage(true);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return QString();
     }
+
+    QString manualId = idInput->text().trimmed();
+    if (!manualId.isEmpty()) {
+        return manualId;
+    }
+
+    QListWidgetItem* selected = documentList->currentItem();
+    return selected ? selected->data(Qt::UserRole).toString() : QString();
 }
 
 void MainWindow::onUserConnected(const QString& userId, const QString& username)
@@ -793,66 +1104,55 @@ void MainWindow::onCursorPositionChanged()
     // Get current position
     int position = codeEditor->textCursor().position();
 
-    // Update status bar with position information
-    int line = codeEditor->textCursor().blockNumber() + 1;
-    int column = codeEditor->textCursor().columnNumber() + 1;
-    statusLabel->setText(QString("Line: %1 Column: %2 | %3").arg(line).arg(column).arg(currentUser->getUsername()));
+    // Update status bar with position information from the document's line index
+    int line = 0;
+    int column = 0;
+    currentDocument->lineColumnAt(position, &line, &column);
+    statusLabel->setText(QString("Line: %1 Column: %2 | %3").arg(line + 1).arg(column + 1).arg(currentUser->getUsername()));
 
-    // Send cursor position to other users
-    if (collaborationClient && collaborationClient->isConnected()) {
-        qDebug() << "Sending cursor position:" << position << "for user" << currentUser->getUsername();
-        collaborationClient->sendCursorPosition(position);
+    // Send cursor position to other users, unless they already derive it from an edit
+    if (collaborationClient && collaborationClient->isConnected() && !codeEditor->cursorMovedByEdit()) {
+        collaborationClient->sendCursorPosition(position, codeEditor->textCursor().anchor());
     }
 }
 
-void MainWindow::onTextChanged()
+void MainWindow::onLocalEdit(const EditOperation& operation)
 {
     if (!currentUser || !currentDocument) return;
 
-    // Update document content
-    QString newContent = codeEditor->toPlainText();
-    QString oldContent = currentDocument->getContent();
-    
-    if (newContent != oldContent) {
-        qDebug() << "Document content changed:"
-                 << "\n  Document ID:" << currentDocument->getId()
-                 << "\n  User:" << currentUser->getUsername()
-                 << "\n  Old content length:" << oldContent.length()
-                 << "\n  New content length:" << newContent.length();
-        
-        currentDocument->setContent(newContent);
+    // Schedule saving changes to storage, flushing any other document first
+    if (pendingSaveDocument && pendingSaveDocument != currentDocument) {
+        saveCurrentDocument();
+    }
+    pendingSaveDocument = currentDocument;
+    saveTimer->start();
 
-        // Save changes to storage
-        if (!DocumentStorage::getInstance().saveDocument(currentDocument)) {
+    // Send only the changed range through the collaboration client
+    if (collaborationClient && collaborationClient->isConnected()) {
+        EditOperation op = operation;
+        op.userId = currentUser->getUserId();
+        op.documentId = currentDocument->getId();
+        collaborationClient->sendEdit(op);
+    }
+
+    // Mark the document as modified
+    setWindowModified(true);
+}
+
+void MainWindow::saveCurrentDocument()
+{
+    saveTimer->stop();
+    std::shared_ptr<Document> document = std::move(pendingSaveDocument);
+    pendingSaveDocument.reset();
+    if (!document) return;
+
+    // Written from a snapshot on the thread pool so typing is never blocked
+    DocumentStorage::getInstance().saveDocumentAsync(document, this, [this](bool saved) {
+        if (!saved) {
             qDebug() << "Failed to save document changes";
             QMessageBox::warning(this, "Save Error", "Failed to save document changes.");
         }
-
-        // Send changes through collaboration client
-        if (collaborationClient && collaborationClient->isConnected()) {
-            EditOperation op;
-            op.userId = currentUser->getUserId();
-            op.documentId = currentDocument->getId();
-            
-            // Calculate the difference between old and new content
-            if (newContent.length() < oldContent.length()) {
-                // This is a deletion
-                op.position = 0;
-                op.deletionLength = oldContent.length();
-                op.insertion = newContent;
-            } else {
-                // This is an insertion or replacement
-                op.position = 0;
-                op.deletionLength = oldContent.length();
-                op.insertion = newContent;
-            }
-            
-            collaborationClient->sendEdit(op);
-        }
-
-        // Mark the document as modified
-        setWindowModified(true);
-    }
+    });
 }
 
 void MainWindow::onSendChatMessage()
@@ -925,8 +1225,7 @@ void MainWindow::addDocument(std::shared_ptr<Document> document)
     
     currentDocument = document;
     codeEditor->setDocument(document);
-    codeEditor->setPlainText(document->getContent());
-    
+
     // Set up collaboration
     if (collaborationClient) {
         // Set the document in the collaboration client
@@ -949,6 +1248,7 @@ void MainWindow::onUserLoggedIn(std::shared_ptr<User> user)
 {
     if (user) {
         currentUser = user;
+        codeEditor->setLocalUserId(currentUser->getUserId());
         updateStatusBar();
         updateTitle();
     }
@@ -959,7 +1259,6 @@ void MainWindow::onDocumentOpened(std::shared_ptr<Document> document)
     if (document) {
         currentDocument = document;
         codeEditor->setDocument(document);
-        codeEditor->setPlainText(document->getContent());
         codeEditor->setLanguage(document->getLanguage());
         updateTitle();
         updateUserList();
@@ -986,7 +1285,11 @@ void MainWindow::onPublicAccessChanged(bool isPublic)
 void MainWindow::onDocumentAccessChanged(const QString& userId, Document::AccessLevel level)
 {
     if (currentDocument) {
-        currentDocument->shareWith(userId, level);
+        if (level == Document::AccessLevel::None) {
+            currentDocument->revokeAccess(userId);
+        } else {
+            currentDocument->shareWith(userId, level);
+        }
         updateUserList();
     }
 }
\ No newline at end of file
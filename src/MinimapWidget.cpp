@@ -0,0 +1,315 @@
+// MinimapWidget.cpp
+#include "MinimapWidget.h"
+#include "CodeEditorWidget.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QDateTime>
+#include <QTimer>
+
+namespace {
+
+const int MinimapWidth = 100;
+const int TileHeight = 32;      // Rows per cached tile
+const int TabColumns = 4;
+const int StaleRefreshMs = 300; // Idle time before moved tiles are redrawn
+const int RecentEditLifetimeMs = 10000;
+const int MaxRecentEdits = 32;
+
+} // namespace
+
+MinimapWidget::MinimapWidget(CodeEditorWidget* editor, QWidget* parent)
+    : QWidget(parent)
+    , editor(editor)
+    , scaleShift(-1)
+    , lastBlockCount(editor->document()->blockCount())
+    , refreshTimer(new QTimer(this))
+    , expireTimer(new QTimer(this))
+{
+    setFixedWidth(MinimapWidth);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+
+    refreshTimer->setSingleShot(true);
+    refreshTimer->setInterval(StaleRefreshMs);
+    connect(refreshTimer, &QTimer::timeout, this, &MinimapWidget::refreshStaleTiles);
+    expireTimer->setInterval(1000);
+    connect(expireTimer, &QTimer::timeout, this, &MinimapWidget::expireRecentEdits);
+
+    connect(editor, &CodeEditorWidget::contentsChange, this, &MinimapWidget::onContentsChange);
+    connect(editor, &CodeEditorWidget::documentModelChanged, this, &MinimapWidget::onDocumentModelChanged);
+    connect(editor, &CodeEditorWidget::remoteEditApplied, this, &MinimapWidget::onRemoteEditApplied);
+    connect(editor, &CodeEditorWidget::remoteCursorsChanged, this, QOverload<>::of(&QWidget::update));
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, QOverload<>::of(&QWidget::update));
+}
+
+QSize MinimapWidget::sizeHint() const
+{
+    return QSize(MinimapWidth, 0);
+}
+
+int MinimapWidget::lineToY(int line) const
+{
+    return scaleShift < 0 ? line * 2 : line >> scaleShift;
+}
+
+int MinimapWidget::yToLine(int y) const
+{
+    return scaleShift < 0 ? y / 2 : y << scaleShift;
+}
+
+bool MinimapWidget::updateScale()
+{
+    // The smallest power-of-two scale that fits every line in the widget
+    const int lines = editor->document()->blockCount();
+    const int previous = scaleShift;
+    scaleShift = -1;
+    while (scaleShift < 30 && lineToY(lines) > height()) {
+        ++scaleShift;
+    }
+    return scaleShift != previous;
+}
+
+void MinimapWidget::resetTiles()
+{
+    tiles.fill(QImage());
+    staleTiles.fill(false);
+    refreshTimer->stop();
+}
+
+void MinimapWidget::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    const int tileCount = (height() + TileHeight - 1) / TileHeight;
+    tiles.resize(tileCount);
+    staleTiles.resize(tileCount);
+    updateScale();
+    resetTiles();
+}
+
+void MinimapWidget::onDocumentModelChanged()
+{
+    // Another text is on show, possibly one kept from earlier with no
+    // change reported for it
+    lastBlockCount = editor->document()->blockCount();
+    updateScale();
+    resetTiles();
+    clearRecentEdits();
+    update();
+}
+
+void MinimapWidget::clearRecentEdits()
+{
+    // The ranges belong to the text that was on show
+    for (const RecentEdit& edit : std::as_const(recentEdits)) {
+        editor->releaseAnchor(edit.startAnchor);
+        editor->releaseAnchor(edit.endAnchor);
+    }
+    recentEdits.clear();
+    expireTimer->stop();
+}
+
+void MinimapWidget::onContentsChange(int position, int /* charsRemoved */, int charsAdded)
+{
+    const QTextDocument* document = editor->document();
+    const int firstLine = document->findBlock(position).blockNumber();
+    const int lastLine = qMax(firstLine, document->findBlock(position + charsAdded).blockNumber());
+
+    const int blockCount = document->blockCount();
+    if (blockCount != lastBlockCount) {
+        lastBlockCount = blockCount;
+        if (updateScale() || charsAdded >= document->characterCount() - 1) {
+            // New scale or new text: nothing cached still applies
+            resetTiles();
+            update();
+            return;
+        }
+
+        // Lines below the edit moved; their tiles stay up until typing pauses
+        for (int tile = lineToY(lastLine) / TileHeight + 1; tile < tiles.size(); ++tile) {
+            staleTiles[tile] = !tiles[tile].isNull();
+        }
+        refreshTimer->start();
+    }
+    invalidateLines(firstLine, lastLine);
+}
+
+void MinimapWidget::invalidateLines(int firstLine, int lastLine)
+{
+    const int firstTile = lineToY(firstLine) / TileHeight;
+    const int lastTile = qMin(int(tiles.size()) - 1, lineToY(lastLine) / TileHeight);
+    if (firstTile > lastTile) {
+        return;
+    }
+    for (int tile = firstTile; tile <= lastTile; ++tile) {
+        tiles[tile] = QImage();
+        staleTiles[tile] = false;
+    }
+    update(0, firstTile * TileHeight, width(), (lastTile - firstTile + 1) * TileHeight);
+}
+
+void MinimapWidget::refreshStaleTiles()
+{
+    for (int tile = 0; tile < tiles.size(); ++tile) {
+        if (staleTiles[tile]) {
+            tiles[tile] = QImage();
+            staleTiles[tile] = false;
+        }
+    }
+    update();
+}
+
+QImage MinimapWidget::renderTile(int tile) const
+{
+    QImage image(width(), TileHeight, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    // Large files only get the overlays; drawing them would read every line
+    const QTextDocument* document = editor->document();
+    const int firstLine = yToLine(tile * TileHeight);
+    const int endLine = qMin(document->blockCount(), yToLine((tile + 1) * TileHeight));
+    if (editor->isLargeFileMode() || firstLine >= endLine) {
+        return image;
+    }
+
+    // Count the non-blank characters landing on each pixel, one column per character
+    const int columns = image.width();
+    QVector<quint16> coverage(columns * TileHeight, 0);
+    QTextBlock block = document->findBlockByNumber(firstLine);
+    for (int line = firstLine; line < endLine && block.isValid(); ++line, block = block.next()) {
+        quint16* row = coverage.data() + (lineToY(line) - tile * TileHeight) * columns;
+        const QString text = block.text();
+        int column = 0;
+        for (int i = 0; i < text.length() && column < columns; ++i) {
+            const QChar c = text.at(i);
+            if (c == u'\t') {
+                column += TabColumns;
+                continue;
+            }
+            if (!c.isSpace()) {
+                ++row[column];
+            }
+            ++column;
+        }
+    }
+
+    // Denser pixels are drawn more opaque
+    const QColor ink = palette().color(QPalette::Text);
+    const int linesPerRow = scaleShift < 0 ? 1 : 1 << scaleShift;
+    for (int y = 0; y < TileHeight; ++y) {
+        QRgb* pixels = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const quint16* row = coverage.constData() + y * columns;
+        for (int x = 0; x < columns; ++x) {
+            if (row[x]) {
+                const int alpha = qMin(255, 96 + 160 * row[x] / linesPerRow);
+                pixels[x] = qPremultiply(qRgba(ink.red(), ink.green(), ink.blue(), alpha));
+            }
+        }
+    }
+    return image;
+}
+
+void MinimapWidget::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().color(QPalette::Base));
+
+    // Cached text tiles; only the ones an edit dropped are drawn again
+    const int firstTile = qMax(0, event->rect().top() / TileHeight);
+    const int lastTile = qMin(int(tiles.size()) - 1, event->rect().bottom() / TileHeight);
+    for (int tile = firstTile; tile <= lastTile; ++tile) {
+        if (tiles[tile].isNull()) {
+            tiles[tile] = renderTile(tile);
+        }
+        painter.drawImage(0, tile * TileHeight, tiles[tile]);
+    }
+
+    // The editor's viewport
+    const QTextDocument* document = editor->document();
+    const int firstVisible = editor->verticalScrollBar()->value();
+    const int visibleLines = editor->verticalScrollBar()->pageStep();
+    const int top = lineToY(firstVisible);
+    painter.fillRect(QRect(0, top, width(), qMax(2, lineToY(firstVisible + visibleLines) - top)),
+                     QColor(128, 128, 128, 50));
+
+    // Recent remote edits as bars at the left edge
+    for (const RecentEdit& edit : std::as_const(recentEdits)) {
+        const int start = editor->anchorPosition(edit.startAnchor);
+        const int end = editor->anchorPosition(edit.endAnchor);
+        if (start < 0 || end < 0) {
+            continue;
+        }
+        const int y = lineToY(document->findBlock(start).blockNumber());
+        const int bottom = lineToY(document->findBlock(end).blockNumber() + 1);
+        painter.fillRect(QRect(0, y, 3, qMax(2, bottom - y)), edit.color);
+    }
+
+    // Remote cursors as full-width lines
+    for (const auto& cursor : editor->remoteCursorPositions()) {
+        const int y = lineToY(document->findBlock(cursor.first).blockNumber());
+        painter.fillRect(QRect(0, y, width(), 2), cursor.second);
+    }
+}
+
+void MinimapWidget::onRemoteEditApplied(const QString& userId, int position, int length)
+{
+    // A peer typing on extends the last range: its end anchor follows the insertions
+    if (!recentEdits.isEmpty()) {
+        RecentEdit& last = recentEdits.last();
+        if (last.userId == userId && editor->anchorPosition(last.endAnchor) == position + length) {
+            last.time = QDateTime::currentMSecsSinceEpoch();
+            update();
+            return;
+        }
+    }
+
+    if (recentEdits.size() >= MaxRecentEdits) {
+        editor->releaseAnchor(recentEdits.first().startAnchor);
+        editor->releaseAnchor(recentEdits.first().endAnchor);
+        recentEdits.removeFirst();
+    }
+    recentEdits.append(RecentEdit{userId, editor->createAnchor(position), editor->createAnchor(position + length),
+                                  CodeEditorWidget::colorForUser(userId), QDateTime::currentMSecsSinceEpoch()});
+    if (!expireTimer->isActive()) {
+        expireTimer->start();
+    }
+    update();
+}
+
+void MinimapWidget::expireRecentEdits()
+{
+    const qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - RecentEditLifetimeMs;
+    for (int i = recentEdits.size() - 1; i >= 0; --i) {
+        if (recentEdits[i].time < cutoff) {
+            editor->releaseAnchor(recentEdits[i].startAnchor);
+            editor->releaseAnchor(recentEdits[i].endAnchor);
+            recentEdits.remove(i);
+        }
+    }
+    if (recentEdits.isEmpty()) {
+        expireTimer->stop();
+    }
+    update();
+}
+
+void MinimapWidget::scrollEditorTo(int y)
+{
+    // Centre the editor on the line under the pointer
+    const int line = yToLine(qMax(0, y));
+    editor->verticalScrollBar()->setValue(line - editor->verticalScrollBar()->pageStep() / 2);
+}
+
+void MinimapWidget::mousePressEvent(QMouseEvent* event)
+{
+    scrollEditorTo(event->position().toPoint().y());
+}
+
+void MinimapWidget::mouseMoveEvent(QMouseEvent* event)
+{
+    if (event->buttons() & Qt::LeftButton) {
+        scrollEditorTo(event->position().toPoint().y());
+    }
+}
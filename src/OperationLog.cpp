@@ -0,0 +1,123 @@
+// OperationLog.cpp
+#include "OperationLog.h"
+#include "BlobStore.h"
+
+#include <QDebug>
+#include <algorithm>
+
+OperationLog::OperationLog(int checkpointInterval, int maxEntries)
+    : checkpointInterval(qMax(1, checkpointInterval))
+    , maxEntries(qMax(2 * this->checkpointInterval, maxEntries))
+    , baseRevision(0)
+{
+    checkpoints.append(Checkpoint{0, TextRope(), QStringList()});
+}
+
+void OperationLog::reset(const TextRope& text, quint64 revision)
+{
+    baseRevision = revision;
+    entries.clear();
+    checkpoints.clear();
+    checkpoints.append(Checkpoint{revision, text, QStringList()});
+}
+
+bool OperationLog::append(quint64 revision, const Entry& entry, const TextRope& textAfter)
+{
+    if (revision != lastRevision() + 1) {
+        qDebug() << "Operation log gap: expected revision" << lastRevision() + 1 << "got" << revision;
+        reset(textAfter, revision);
+        return false;
+    }
+
+    entries.append(entry);
+    if (revision - checkpoints.last().revision >= quint64(checkpointInterval)) {
+        checkpoints.append(Checkpoint{revision, textAfter, QStringList()});
+        if (entries.size() > maxEntries) {
+            compact();
+        }
+    }
+    return true;
+}
+
+void OperationLog::compact()
+{
+    // Keep about half the cap so dropping is amortised over many appends;
+    // the log has to start on a checkpoint to stay seekable
+    const quint64 keepFrom = lastRevision() - quint64(maxEntries / 2);
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), keepFrom,
+        [](quint64 value, const Checkpoint& checkpoint) { return value < checkpoint.revision; });
+    if (it - checkpoints.begin() <= 1) {
+        return;
+    }
+    --it;
+
+    entries.remove(0, int(it->revision - baseRevision));
+    baseRevision = it->revision;
+    checkpoints.erase(checkpoints.begin(), it);
+}
+
+const OperationLog::Entry& OperationLog::entryFor(quint64 revision) const
+{
+    static const Entry empty{0, 0, QString(), QString(), QDateTime()};
+    if (revision <= baseRevision || revision > lastRevision()) {
+        return empty;
+    }
+    return entries[int(revision - baseRevision - 1)];
+}
+
+bool OperationLog::textAt(quint64 revision, TextRope* text) const
+{
+    if (revision < baseRevision || revision > lastRevision()) {
+        return false;
+    }
+
+    // Last checkpoint at or before the revision, then replay forward from it
+    auto it = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), revision,
+        [](quint64 value, const Checkpoint& checkpoint) { return value < checkpoint.revision; });
+    const Checkpoint& checkpoint = *(it - 1);
+
+    *text = checkpoint.text;
+    if (text->isEmpty() && !checkpoint.chunks.isEmpty()) {
+        bool loaded = false;
+        *text = TextRope(BlobStore::getInstance().loadContent(checkpoint.chunks, &loaded));
+        if (!loaded) {
+            return false;
+        }
+    }
+    for (quint64 r = checkpoint.revision + 1; r <= revision; ++r) {
+        const Entry& entry = entries[int(r - baseRevision - 1)];
+        if (!text->replace(entry.position, entry.removedLength, entry.insertedText)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OperationLog::setCheckpointChunks(quint64 revision, const QStringList& chunkRefs)
+{
+    auto it = std::lower_bound(checkpoints.begin(), checkpoints.end(), revision,
+        [](const Checkpoint& checkpoint, quint64 value) { return checkpoint.revision < value; });
+    if (it != checkpoints.end() && it->revision == revision && it->chunks.isEmpty()) {
+        it->chunks = chunkRefs;
+    }
+}
+
+bool OperationLog::restore(const QVector<Checkpoint>& storedCheckpoints, const QVector<Entry>& storedEntries)
+{
+    if (storedCheckpoints.isEmpty()) {
+        return false;
+    }
+    const quint64 first = storedCheckpoints.first().revision;
+    const quint64 last = first + quint64(storedEntries.size());
+    for (int i = 0; i < storedCheckpoints.size(); ++i) {
+        const quint64 revision = storedCheckpoints[i].revision;
+        if ((i > 0 && revision <= storedCheckpoints[i - 1].revision) || revision > last) {
+            return false;
+        }
+    }
+
+    baseRevision = first;
+    entries = storedEntries;
+    checkpoints = storedCheckpoints;
+    return true;
+}
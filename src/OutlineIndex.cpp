@@ -0,0 +1,264 @@
+// OutlineIndex.cpp
+#include "OutlineIndex.h"
+#include "Document.h"
+
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+// Edits are parsed once typing pauses for this long
+const int ParseDelayMs = 300;
+const int TabColumns = 4;
+
+struct OutlineRule {
+    QRegularExpression pattern; // Captures the symbol as "name"
+    OutlineIndex::Symbol::Kind kind;
+};
+
+// Statements that look like declarations in front of a parenthesis
+const QString NotDeclaration =
+    QStringLiteral("(?!(?:if|else|for|while|switch|return|case|do|new|delete|throw|catch|try|sizeof)\\b)");
+
+QVector<OutlineRule> makeRules(const QString& language)
+{
+    using Kind = OutlineIndex::Symbol::Kind;
+    QVector<OutlineRule> rules;
+    const auto add = [&rules](const QString& pattern, Kind kind) {
+        rules.append({QRegularExpression(pattern), kind});
+    };
+
+    // Patterns see the line without its indentation; lines ending in ';'
+    // are declarations or statements and are left out
+    if (language == "C++") {
+        add("^namespace\\s+(?<name>[A-Za-z_][\\w:]*)", Kind::Namespace);
+        add("^(?:template\\s*<.*>\\s*)?(?:class|struct|union|enum(?:\\s+class)?)\\s+(?<name>[A-Za-z_]\\w*)"
+            "\\s*(?:final\\s*)?(?:[:{].*)?$", Kind::Class);
+        add("^" + NotDeclaration + "(?:[\\w:<>,]+[\\s\\*&]+)+(?<name>~?[A-Za-z_][\\w:~]*)\\s*\\([^;]*$",
+            Kind::Function);
+        add("^(?<name>[A-Za-z_]\\w*::~?[A-Za-z_]\\w*)\\s*\\([^;]*$", Kind::Function);
+    } else if (language == "Java") {
+        const QString modifiers =
+            QStringLiteral("(?:(?:public|protected|private|abstract|static|final|synchronized|native|default|strictfp)\\s+)");
+        add("^" + modifiers + "*(?:class|interface|enum|record|@interface)\\s+(?<name>[A-Za-z_]\\w*)", Kind::Class);
+        add("^" + NotDeclaration + modifiers + "*(?:<[^>]*>\\s*)?[\\w\\[\\]<>?,.]+\\s+(?<name>[A-Za-z_]\\w*)\\s*\\([^;]*$",
+            Kind::Function);
+        add("^" + modifiers + "+(?<name>[A-Za-z_]\\w*)\\s*\\([^;]*$", Kind::Function);
+    } else if (language == "JavaScript") {
+        add("^(?:export\\s+)?(?:default\\s+)?class\\s+(?<name>[A-Za-z_$][\\w$]*)", Kind::Class);
+        add("^(?:export\\s+)?(?:default\\s+)?(?:async\\s+)?function\\s*\\*?\\s*(?<name>[A-Za-z_$][\\w$]*)",
+            Kind::Function);
+        add("^(?:export\\s+)?(?:const|let|var)\\s+(?<name>[A-Za-z_$][\\w$]*)\\s*=\\s*(?:async\\s+)?"
+            "(?:function\\b|(?:\\([^)]*\\)|[A-Za-z_$][\\w$]*)\\s*=>)", Kind::Function);
+        add("^(?!(?:if|for|while|switch|catch|function|return|else|do|with)\\b)(?:static\\s+)?(?:async\\s+)?"
+            "(?:get\\s+|set\\s+)?\\*?(?<name>[A-Za-z_$][\\w$]*)\\s*\\([^)]*\\)\\s*\\{\\s*$", Kind::Function);
+    } else if (language == "Python") {
+        add("^class\\s+(?<name>[A-Za-z_]\\w*)", Kind::Class);
+        add("^(?:async\\s+)?def\\s+(?<name>[A-Za-z_]\\w*)", Kind::Function);
+    }
+    return rules;
+}
+
+const QVector<OutlineRule>& rulesFor(const QString& language)
+{
+    // Built once; matching a const QRegularExpression is thread-safe
+    static const QVector<OutlineRule> cpp = makeRules("C++");
+    static const QVector<OutlineRule> java = makeRules("Java");
+    static const QVector<OutlineRule> javaScript = makeRules("JavaScript");
+    static const QVector<OutlineRule> python = makeRules("Python");
+    static const QVector<OutlineRule> none;
+    if (language == "C++") {
+        return cpp;
+    } else if (language == "Java") {
+        return java;
+    } else if (language == "JavaScript") {
+        return javaScript;
+    } else if (language == "Python") {
+        return python;
+    }
+    return none;
+}
+
+} // namespace
+
+OutlineIndex::OutlineIndex(QObject* parent)
+    : QObject(parent)
+    , lineCount(0)
+    , dirtyFirst(-1)
+    , dirtyLast(-1)
+    , parsing(false)
+    , generation(0)
+    , parseTimer(new QTimer(this))
+{
+    parseTimer->setSingleShot(true);
+    parseTimer->setInterval(ParseDelayMs);
+    connect(parseTimer, &QTimer::timeout, this, &OutlineIndex::startParse);
+}
+
+void OutlineIndex::setDocument(std::shared_ptr<Document> doc)
+{
+    if (document) {
+        disconnect(document.get(), nullptr, this, nullptr);
+    }
+    document = doc;
+
+    // A parse still running for the previous document is ignored when it ends
+    ++generation;
+    parsing = false;
+    editsDuringParse.clear();
+    current.clear();
+    emit symbolsChanged();
+
+    if (document) {
+        connect(document.get(), &Document::languageChanged, this, &OutlineIndex::reparseAll);
+        reparseAll();
+    }
+}
+
+void OutlineIndex::reparseAll()
+{
+    lineCount = document ? document->lineCount() : 0;
+    dirtyFirst = 0;
+    dirtyLast = lineCount - 1;
+    parseTimer->stop();
+    startParse();
+}
+
+void OutlineIndex::applyEdit(int position, int /* charsRemoved */, int charsAdded)
+{
+    if (!document) {
+        return;
+    }
+
+    int firstLine = 0;
+    int lastLine = 0;
+    document->lineColumnAt(position, &firstLine, nullptr);
+    document->lineColumnAt(position + charsAdded, &lastLine, nullptr);
+    const int delta = document->lineCount() - lineCount;
+    lineCount = document->lineCount();
+    const LineEdit edit{firstLine, qMax(firstLine, lastLine - delta), lastLine};
+
+    // Symbols after the edit follow it; the ones inside wait for the parse
+    auto it = std::lower_bound(current.begin(), current.end(), firstLine,
+        [](const Symbol& symbol, int line) { return symbol.line < line; });
+    for (; it != current.end(); ++it) {
+        it->line = mapLine(it->line, edit);
+    }
+
+    if (dirtyFirst < 0) {
+        dirtyFirst = firstLine;
+        dirtyLast = lastLine;
+    } else {
+        dirtyFirst = qMin(mapLine(dirtyFirst, edit), firstLine);
+        dirtyLast = qMax(mapLine(dirtyLast, edit), lastLine);
+    }
+    if (parsing) {
+        editsDuringParse.append(edit);
+    }
+    parseTimer->start();
+}
+
+int OutlineIndex::mapLine(int line, const LineEdit& edit)
+{
+    if (line < edit.firstLine) {
+        return line;
+    }
+    if (line > edit.oldLastLine) {
+        return line + edit.newLastLine - edit.oldLastLine;
+    }
+    return qMin(line, edit.newLastLine);
+}
+
+void OutlineIndex::startParse()
+{
+    if (!document || parsing || dirtyFirst < 0) {
+        return;
+    }
+
+    const int first = qBound(0, dirtyFirst, qMax(0, lineCount - 1));
+    const int last = qBound(first, dirtyLast, qMax(0, lineCount - 1));
+    dirtyFirst = -1;
+    dirtyLast = -1;
+    const int start = document->lineStart(first);
+    const int end = last + 1 < lineCount ? document->lineStart(last + 1) : document->length();
+
+    parsing = true;
+    const TextRope text = document->textSnapshot();
+    const QString language = document->getLanguage();
+    const quint64 ticket = generation;
+    QThreadPool::globalInstance()->start([this, text, start, end, first, last, language, ticket]() {
+        QVector<Symbol> symbols = parse(text.mid(start, end - start), first, language);
+        QMetaObject::invokeMethod(this, [this, symbols, first, last, ticket]() {
+            onParsed(symbols, first, last, ticket);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void OutlineIndex::onParsed(QVector<Symbol> symbols, int firstLine, int lastLine, quint64 ticket)
+{
+    if (ticket != generation) {
+        return;
+    }
+    parsing = false;
+
+    // Replay the edits made meanwhile; symbols on lines they touched are
+    // dropped, since those lines are queued for the next parse
+    for (const LineEdit& edit : std::as_const(editsDuringParse)) {
+        symbols.erase(std::remove_if(symbols.begin(), symbols.end(), [&edit](const Symbol& symbol) {
+            return symbol.line >= edit.firstLine && symbol.line <= edit.oldLastLine;
+        }), symbols.end());
+        for (Symbol& symbol : symbols) {
+            symbol.line = mapLine(symbol.line, edit);
+        }
+        firstLine = mapLine(firstLine, edit);
+        lastLine = mapLine(lastLine, edit);
+    }
+    editsDuringParse.clear();
+
+    const auto lineLess = [](const Symbol& symbol, int line) { return symbol.line < line; };
+    const auto first = std::lower_bound(current.begin(), current.end(), firstLine, lineLess);
+    const auto last = std::lower_bound(first, current.end(), lastLine + 1, lineLess);
+    const int index = int(first - current.begin());
+    current.erase(first, last);
+    current.insert(index, symbols.size(), Symbol());
+    std::copy(symbols.cbegin(), symbols.cend(), current.begin() + index);
+    emit symbolsChanged();
+
+    if (dirtyFirst >= 0 && !parseTimer->isActive()) {
+        parseTimer->start();
+    }
+}
+
+QVector<OutlineIndex::Symbol> OutlineIndex::parse(const QString& text, int firstLine, const QString& language)
+{
+    QVector<Symbol> symbols;
+    const QVector<OutlineRule>& rules = rulesFor(language);
+    if (rules.isEmpty()) {
+        return symbols;
+    }
+
+    int line = firstLine;
+    for (QStringView row : QStringView(text).split(u'\n')) {
+        int indent = 0;
+        int column = 0;
+        for (; column < row.length() && (row[column] == u' ' || row[column] == u'\t'); ++column) {
+            indent += row[column] == u'\t' ? TabColumns : 1;
+        }
+        const QString code = row.mid(column).toString();
+
+        // Comments and preprocessor lines
+        if (!code.isEmpty() && code[0] != u'/' && code[0] != u'*' && code[0] != u'#') {
+            for (const OutlineRule& rule : rules) {
+                const QRegularExpressionMatch match = rule.pattern.match(code);
+                if (match.hasMatch()) {
+                    symbols.append(Symbol{rule.kind, match.captured("name"), line, indent});
+                    break;
+                }
+            }
+        }
+        ++line;
+    }
+    return symbols;
+}
@@ -0,0 +1,84 @@
+// OutlinePanel.cpp
+#include "OutlinePanel.h"
+#include "OutlineIndex.h"
+#include "CodeEditorWidget.h"
+
+#include <QTextBlock>
+#include <QTextDocument>
+
+OutlinePanel::OutlinePanel(CodeEditorWidget* editor, QWidget* parent)
+    : QTreeWidget(parent)
+    , editor(editor)
+    , index(new OutlineIndex(this))
+{
+    setHeaderHidden(true);
+    setUniformRowHeights(true);
+
+    // The editor updates its document model first, then the index reads it
+    connect(editor, &CodeEditorWidget::contentsChange, index, &OutlineIndex::applyEdit);
+    connect(editor, &CodeEditorWidget::documentModelChanged, this, [this]() {
+        index->setDocument(this->editor->documentModel());
+    });
+    connect(index, &OutlineIndex::symbolsChanged, this, &OutlinePanel::rebuild);
+    connect(this, &QTreeWidget::itemActivated, this, &OutlinePanel::jumpToSymbol);
+    connect(this, &QTreeWidget::itemClicked, this, &OutlinePanel::jumpToSymbol);
+}
+
+void OutlinePanel::rebuild()
+{
+    setUpdatesEnabled(false);
+    clear();
+
+    // Each symbol goes under the nearest one above it with less indentation
+    const QVector<OutlineIndex::Symbol>& symbols = index->symbols();
+    QVector<QPair<int, QTreeWidgetItem*>> parents;
+    QList<QTreeWidgetItem*> topLevel;
+    for (int i = 0; i < symbols.size(); ++i) {
+        const OutlineIndex::Symbol& symbol = symbols[i];
+        while (!parents.isEmpty() && parents.last().first >= symbol.indent) {
+            parents.removeLast();
+        }
+
+        QString label = symbol.name;
+        if (symbol.kind == OutlineIndex::Symbol::Namespace) {
+            label = "namespace " + symbol.name;
+        } else if (symbol.kind == OutlineIndex::Symbol::Class) {
+            label = "class " + symbol.name;
+        } else {
+            label += "()";
+        }
+
+        QTreeWidgetItem* item = parents.isEmpty() ? new QTreeWidgetItem() : new QTreeWidgetItem(parents.last().second);
+        item->setText(0, label);
+        item->setData(0, Qt::UserRole, i);
+        if (parents.isEmpty()) {
+            topLevel.append(item);
+        }
+        parents.append(qMakePair(symbol.indent, item));
+    }
+    addTopLevelItems(topLevel);
+    expandAll();
+    setUpdatesEnabled(true);
+}
+
+void OutlinePanel::jumpToSymbol(QTreeWidgetItem* item)
+{
+    // Symbol lines are kept current through edits, so the index is enough
+    const int symbolIndex = item->data(0, Qt::UserRole).toInt();
+    if (symbolIndex < 0 || symbolIndex >= index->symbols().size()) {
+        return;
+    }
+    const OutlineIndex::Symbol& symbol = index->symbols()[symbolIndex];
+    const QTextBlock block = editor->document()->findBlockByNumber(symbol.line);
+    if (!block.isValid()) {
+        return;
+    }
+
+    // The caret goes on the name itself, without any class qualifier
+    const int column = qMax(0, int(block.text().indexOf(symbol.name.section("::", -1))));
+    QTextCursor cursor(block);
+    cursor.setPosition(block.position() + column);
+    editor->setTextCursor(cursor);
+    editor->centerCursor();
+    editor->setFocus();
+}
@@ -5,7 +5,7 @@
 #include <QDebug>
 #include <algorithm>
 SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent)
+    : QSyntaxHighlighter(static_cast<QObject*>(parent))
     , currentLanguage("Plain")
 {
     // Initialize formats
@@ -28,6 +28,28 @@ SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
     numberFormat.setForeground(Qt::darkCyan);
     
     preprocessorFormat.setForeground(Qt::darkBlue);
+
+    quotationFormat.setProperty(NonCodeProperty, true);
+    singleLineCommentFormat.setProperty(NonCodeProperty, true);
+    multiLineCommentFormat.setProperty(NonCodeProperty, true);
+
+    // The document is attached between two handlers of our own, so the
+    // blocks QSyntaxHighlighter reformats for an edit (the edited ones and
+    // any after them whose comment state changed) are the ones recorded
+    if (parent) {
+        connect(parent, &QTextDocument::contentsChange, this, [this]() {
+            recordingFormatted = true;
+        });
+        setDocument(parent);
+        connect(parent, &QTextDocument::contentsChange, this, [this]() {
+            recordingFormatted = false;
+            if (formattedFirst >= 0) {
+                emit blocksFormatted(formattedFirst, formattedLast);
+                formattedFirst = -1;
+                formattedLast = -1;
+            }
+        });
+    }
 }
 
 void SyntaxHighlighter::setLanguage(const QString& language)
@@ -61,25 +83,53 @@ void SyntaxHighlighter::clearRules()
     commentEndExpression = QRegularExpression();
 }
 
+QStringList SyntaxHighlighter::keywords(const QString& language)
+{
+    if (language == "C++") {
+        return {
+            "char", "class", "const", "double", "enum", "explicit", "friend", "inline",
+            "int", "long", "namespace", "operator", "private", "protected", "public",
+            "short", "signals", "signed", "slots", "static", "struct", "template",
+            "typedef", "typename", "union", "unsigned", "virtual", "void", "volatile",
+            "bool", "return", "if", "else", "for", "while", "do", "switch", "case",
+            "break", "continue", "goto"
+        };
+    } else if (language == "Python") {
+        return {
+            "False", "None", "True", "and", "as", "assert", "break", "class",
+            "continue", "def", "del", "elif", "else", "except", "finally", "for",
+            "from", "global", "if", "import", "in", "is", "lambda", "nonlocal", "not",
+            "or", "pass", "raise", "return", "try", "while", "with", "yield"
+        };
+    } else if (language == "JavaScript") {
+        return {
+            "break", "case", "catch", "class", "const", "continue", "debugger",
+            "default", "delete", "do", "else", "enum", "export", "extends", "false",
+            "finally", "for", "function", "if", "import", "in", "instanceof", "new",
+            "null", "return", "super", "switch", "this", "throw", "true", "try",
+            "typeof", "var", "void", "while", "with", "yield", "let", "const", "await",
+            "async"
+        };
+    } else if (language == "Java") {
+        return {
+            "abstract", "assert", "boolean", "break", "byte", "case", "catch", "char",
+            "class", "const", "continue", "default", "do", "double", "else", "enum",
+            "extends", "final", "finally", "float", "for", "goto", "if", "implements",
+            "import", "instanceof", "int", "interface", "long", "native", "new",
+            "package", "private", "protected", "public", "return", "short", "static",
+            "strictfp", "super", "switch", "synchronized", "this", "throw", "throws",
+            "transient", "try", "void", "volatile", "while"
+        };
+    }
+    return QStringList();
+}
+
 void SyntaxHighlighter::setupCppRules()
 {
     // Keywords
-    QStringList keywordPatterns = {
-        "\\bchar\\b", "\\bclass\\b", "\\bconst\\b", "\\bdouble\\b",
-        "\\benum\\b", "\\bexplicit\\b", "\\bfriend\\b", "\\binline\\b",
-        "\\bint\\b", "\\blong\\b", "\\bnamespace\\b", "\\boperator\\b",
-        "\\bprivate\\b", "\\bprotected\\b", "\\bpublic\\b", "\\bshort\\b",
-        "\\bsignals\\b", "\\bsigned\\b", "\\bslots\\b", "\\bstatic\\b",
-        "\\bstruct\\b", "\\btemplate\\b", "\\btypedef\\b", "\\btypename\\b",
-        "\\bunion\\b", "\\bunsigned\\b", "\\bvirtual\\b", "\\bvoid\\b",
-        "\\bvolatile\\b", "\\bbool\\b", "\\breturn\\b", "\\bif\\b",
-        "\\belse\\b", "\\bfor\\b", "\\bwhile\\b", "\\bdo\\b", "\\bswitch\\b",
-        "\\bcase\\b", "\\bbreak\\b", "\\bcontinue\\b", "\\bgoto\\b"
-    };
-    
-    for (const QString &pattern : keywordPatterns) {
+    for (const QString &keyword : keywords("C++")) {
         HighlightingRule rule;
-        rule.pattern = QRegularExpression(pattern);
+        rule.pattern = QRegularExpression("\\b" + keyword + "\\b");
         rule.format = keywordFormat;
         highlightingRules.append(rule);
     }
@@ -123,21 +173,9 @@ void SyntaxHighlighter::setupCppRules()
 void SyntaxHighlighter::setupPythonRules()
 {
     // Keywords
-    QStringList keywordPatterns = {
-        "\\bFalse\\b", "\\bNone\\b", "\\bTrue\\b", "\\band\\b",
-        "\\bas\\b", "\\bassert\\b", "\\bbreak\\b", "\\bclass\\b",
-        "\\bcontinue\\b", "\\bdef\\b", "\\bdel\\b", "\\belif\\b",
-        "\\belse\\b", "\\bexcept\\b", "\\bfinally\\b", "\\bfor\\b",
-        "\\bfrom\\b", "\\bglobal\\b", "\\bif\\b", "\\bimport\\b",
-        "\\bin\\b", "\\bis\\b", "\\blambda\\b", "\\bnonlocal\\b",
-        "\\bnot\\b", "\\bor\\b", "\\bpass\\b", "\\braise\\b",
-        "\\breturn\\b", "\\btry\\b", "\\bwhile\\b", "\\bwith\\b",
-        "\\byield\\b"
-    };
-    
-    for (const QString &pattern : keywordPatterns) {
+    for (const QString &keyword : keywords("Python")) {
         HighlightingRule rule;
-        rule.pattern = QRegularExpression(pattern);
+        rule.pattern = QRegularExpression("\\b" + keyword + "\\b");
         rule.format = keywordFormat;
         highlightingRules.append(rule);
     }
@@ -186,23 +224,9 @@ void SyntaxHighlighter::setupPythonRules()
 void SyntaxHighlighter::setupJavaScriptRules()
 {
     // Keywords
-    QStringList keywordPatterns = {
-        "\\bbreak\\b", "\\bcase\\b", "\\bcatch\\b", "\\bclass\\b",
-        "\\bconst\\b", "\\bcontinue\\b", "\\bdebugger\\b", "\\bdefault\\b",
-        "\\bdelete\\b", "\\bdo\\b", "\\belse\\b", "\\benum\\b",
-        "\\bexport\\b", "\\bextends\\b", "\\bfalse\\b", "\\bfinally\\b",
-        "\\bfor\\b", "\\bfunction\\b", "\\bif\\b", "\\bimport\\b",
-        "\\bin\\b", "\\binstanceof\\b", "\\bnew\\b", "\\bnull\\b",
-        "\\breturn\\b", "\\bsuper\\b", "\\bswitch\\b", "\\bthis\\b",
-        "\\bthrow\\b", "\\btrue\\b", "\\btry\\b", "\\btypeof\\b",
-        "\\bvar\\b", "\\bvoid\\b", "\\bwhile\\b", "\\bwith\\b",
-        "\\byield\\b", "\\blet\\b", "\\bconst\\b", "\\bawait\\b",
-        "\\basync\\b"
-    };
-    
-    for (const QString &pattern : keywordPatterns) {
+    for (const QString &keyword : keywords("JavaScript")) {
         HighlightingRule rule;
-        rule.pattern = QRegularExpression(pattern);
+        rule.pattern = QRegularExpression("\\b" + keyword + "\\b");
         rule.format = keywordFormat;
         highlightingRules.append(rule);
     }
@@ -246,25 +270,9 @@ void SyntaxHighlighter::setupJavaScriptRules()
 void SyntaxHighlighter::setupJavaRules()
 {
     // Keywords
-    QStringList keywordPatterns = {
-        "\\babstract\\b", "\\bassert\\b", "\\bboolean\\b", "\\bbreak\\b",
-        "\\bbyte\\b", "\\bcase\\b", "\\bcatch\\b", "\\bchar\\b",
-        "\\bclass\\b", "\\bconst\\b", "\\bcontinue\\b", "\\bdefault\\b",
-        "\\bdo\\b", "\\bdouble\\b", "\\belse\\b", "\\benum\\b",
-        "\\bextends\\b", "\\bfinal\\b", "\\bfinally\\b", "\\bfloat\\b",
-        "\\bfor\\b", "\\bgoto\\b", "\\bif\\b", "\\bimplements\\b",
-        "\\bimport\\b", "\\binstanceof\\b", "\\bint\\b", "\\binterface\\b",
-        "\\blong\\b", "\\bnative\\b", "\\bnew\\b", "\\bpackage\\b",
-        "\\bprivate\\b", "\\bprotected\\b", "\\bpublic\\b", "\\breturn\\b",
-        "\\bshort\\b", "\\bstatic\\b", "\\bstrictfp\\b", "\\bsuper\\b",
-        "\\bswitch\\b", "\\bsynchronized\\b", "\\bthis\\b", "\\bthrow\\b",
-        "\\bthrows\\b", "\\btransient\\b", "\\btry\\b", "\\bvoid\\b",
-        "\\bvolatile\\b", "\\bwhile\\b"
-    };
-    
-    for (const QString &pattern : keywordPatterns) {
+    for (const QString &keyword : keywords("Java")) {
         HighlightingRule rule;
-        rule.pattern = QRegularExpression(pattern);
+        rule.pattern = QRegularExpression("\\b" + keyword + "\\b");
         rule.format = keywordFormat;
         highlightingRules.append(rule);
     }
@@ -307,22 +315,44 @@ void SyntaxHighlighter::setupJavaRules()
 
 void SyntaxHighlighter::highlightBlock(const QString &text)
 {
+    if (recordingFormatted) {
+        const int number = currentBlock().blockNumber();
+        formattedFirst = formattedFirst < 0 ? number : qMin(formattedFirst, number);
+        formattedLast = qMax(formattedLast, number);
+    }
+
+    int state = -1;
+    const QVector<QTextLayout::FormatRange> ranges = formatRanges(text, previousBlockState(), &state);
+    for (const QTextLayout::FormatRange& range : ranges) {
+        setFormat(range.start, range.length, range.format);
+    }
+    if (state >= 0) {
+        setCurrentBlockState(state);
+    }
+}
+
+QVector<QTextLayout::FormatRange> SyntaxHighlighter::formatRanges(const QString& text, int previousState,
+                                                                  int* state) const
+{
+    QVector<QTextLayout::FormatRange> ranges;
+    *state = -1;
+
     // Apply regular expression highlighting rules
     // Replace qAsConst with std::as_const
     for (const HighlightingRule &rule : std::as_const(highlightingRules)) {
         QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
         while (matchIterator.hasNext()) {
             QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+            ranges.append({int(match.capturedStart()), int(match.capturedLength()), rule.format});
         }
     }
 
     // Handle multi-line comments if applicable
     if (!commentStartExpression.pattern().isEmpty() && !commentEndExpression.pattern().isEmpty()) {
-        setCurrentBlockState(0);
+        *state = 0;
 
         int startIndex = 0;
-        if (previousBlockState() != 1) {
+        if (previousState != 1) {
             startIndex = text.indexOf(commentStartExpression);
         }
 
@@ -332,14 +362,15 @@ void SyntaxHighlighter::highlightBlock(const QString &text)
             int commentLength = 0;
 
             if (endIndex == -1) {
-                setCurrentBlockState(1);
+                *state = 1;
                 commentLength = text.length() - startIndex;
             } else {
                 commentLength = endIndex - startIndex + match.capturedLength();
             }
 
-            setFormat(startIndex, commentLength, multiLineCommentFormat);
+            ranges.append({startIndex, commentLength, multiLineCommentFormat});
             startIndex = text.indexOf(commentStartExpression, startIndex + commentLength);
         }
     }
-}
\ No newline at end of file
+    return ranges;
+}
@@ -0,0 +1,237 @@
+// TextDiff.cpp
+#include "TextDiff.h"
+
+#include <QHash>
+#include <QStringView>
+#include <QtAlgorithms>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTDIFF_SSE2
+#endif
+
+namespace {
+
+// A run of changed lines: [oldStart, oldEnd) became [newStart, newEnd)
+struct Hunk {
+    int oldStart;
+    int oldEnd;
+    int newStart;
+    int newEnd;
+};
+
+// Offsets of the lines in text[begin, end), each keeping its '\n', plus end
+QVector<int> lineOffsets(const QString& text, int begin, int end)
+{
+    QVector<int> offsets;
+    offsets.append(begin);
+    const QStringView view(text);
+    int position = begin;
+    while (position < end) {
+        qsizetype newline = view.indexOf(u'\n', position);
+        position = (newline < 0 || newline >= end) ? end : int(newline) + 1;
+        offsets.append(position);
+    }
+    return offsets;
+}
+
+// Maps each line to a small integer so equal lines compare as equal ids
+QVector<int> internLines(const QString& text, const QVector<int>& offsets, QHash<QStringView, int>* ids)
+{
+    QVector<int> lines;
+    lines.reserve(offsets.size() - 1);
+    const QStringView view(text);
+    for (int i = 0; i + 1 < offsets.size(); ++i) {
+        QStringView line = view.mid(offsets[i], offsets[i + 1] - offsets[i]);
+        auto it = ids->constFind(line);
+        if (it == ids->constEnd()) {
+            it = ids->insert(line, ids->size());
+        }
+        lines.append(it.value());
+    }
+    return lines;
+}
+
+// Myers' O(ND) shortest edit script over line ids. Returns false once more
+// than maxCost lines would change; the V array of every round is kept for
+// the backtrack, so memory grows with the square of the distance.
+bool diffLines(const QVector<int>& a, const QVector<int>& b, int maxCost, QVector<Hunk>* hunks)
+{
+    const int n = a.size();
+    const int m = b.size();
+    const int offset = maxCost + 1;
+    std::vector<int> v(2 * maxCost + 3, 0);
+    std::vector<int> trace; // Round d holds v[-d..d] from before the round, at index d * d
+
+    int distance = -1;
+    for (int d = 0; d <= maxCost && distance < 0; ++d) {
+        trace.insert(trace.end(), v.begin() + offset - d, v.begin() + offset + d + 1);
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                distance = d;
+                break;
+            }
+        }
+    }
+    if (distance < 0) {
+        return false;
+    }
+
+    // Walk back from the end, one inserted or deleted line per round
+    QVector<Hunk> reversed;
+    int x = n;
+    int y = m;
+    for (int d = distance; d > 0; --d) {
+        const int* round = trace.data() + d * d + d; // round[k] for k in [-d, d]
+        const int k = x - y;
+        const bool down = k == -d || (k != d && round[k - 1] < round[k + 1]);
+        const int previousK = down ? k + 1 : k - 1;
+        const int previousX = round[previousK];
+        const int previousY = previousX - previousK;
+        const int stepX = down ? previousX : previousX + 1;
+        const int stepY = stepX - k;
+
+        if (!reversed.isEmpty() && reversed.last().oldStart == stepX && reversed.last().newStart == stepY) {
+            reversed.last().oldStart = previousX;
+            reversed.last().newStart = previousY;
+        } else {
+            reversed.append(Hunk{previousX, stepX, previousY, stepY});
+        }
+        x = previousX;
+        y = previousY;
+    }
+
+    hunks->clear();
+    hunks->reserve(reversed.size());
+    for (int i = reversed.size() - 1; i >= 0; --i) {
+        hunks->append(reversed[i]);
+    }
+    return true;
+}
+
+} // namespace
+
+int TextDiff::commonPrefixLength(const QChar* a, const QChar* b, int length)
+{
+    int i = 0;
+#ifdef TEXTDIFF_SSE2
+    // Eight UTF-16 units per compare; the first clear mask bit is the mismatch
+    for (; i + 8 <= length; i += 8) {
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        quint32 mismatch = ~quint32(_mm_movemask_epi8(_mm_cmpeq_epi16(left, right))) & 0xFFFFu;
+        if (mismatch) {
+            return i + int(qCountTrailingZeroBits(mismatch)) / 2;
+        }
+    }
+#endif
+    while (i < length && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+int TextDiff::commonSuffixLength(const QChar* aEnd, const QChar* bEnd, int length)
+{
+    int i = 0;
+#ifdef TEXTDIFF_SSE2
+    // Same as the prefix scan, walking backwards; the last clear bit is the mismatch
+    for (; i + 8 <= length; i += 8) {
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aEnd - i - 8));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bEnd - i - 8));
+        quint16 mismatch = quint16(~_mm_movemask_epi8(_mm_cmpeq_epi16(left, right)));
+        if (mismatch) {
+            return i + int(qCountLeadingZeroBits(mismatch)) / 2;
+        }
+    }
+#endif
+    while (i < length && aEnd[-1 - i] == bEnd[-1 - i]) {
+        ++i;
+    }
+    return i;
+}
+
+QVector<TextDiff::Edit> TextDiff::diff(const QString& oldText, const QString& newText, int maxEditCost)
+{
+    QVector<Edit> edits;
+    const int oldLength = oldText.length();
+    const int newLength = newText.length();
+    const QChar* oldData = oldText.constData();
+    const QChar* newData = newText.constData();
+
+    const int shorter = qMin(oldLength, newLength);
+    int prefix = commonPrefixLength(oldData, newData, shorter);
+    if (prefix == oldLength && prefix == newLength) {
+        return edits;
+    }
+    int suffix = commonSuffixLength(oldData + oldLength, newData + newLength, shorter - prefix);
+
+    // Widen the middle to whole lines so the line diff sees aligned lines
+    while (prefix > 0 && oldData[prefix - 1] != u'\n') {
+        --prefix;
+    }
+    while (suffix > 0) {
+        const int oldSplit = oldLength - suffix;
+        const int newSplit = newLength - suffix;
+        if (oldSplit > 0 && newSplit > 0 && oldData[oldSplit - 1] == u'\n' && newData[newSplit - 1] == u'\n') {
+            break;
+        }
+        --suffix;
+    }
+
+    const int oldEnd = oldLength - suffix;
+    const int newEnd = newLength - suffix;
+    const QVector<int> oldLines = lineOffsets(oldText, prefix, oldEnd);
+    const QVector<int> newLines = lineOffsets(newText, prefix, newEnd);
+
+    QVector<Hunk> hunks;
+    bool diffed = false;
+    if (oldLines.size() > 1 && newLines.size() > 1) {
+        QHash<QStringView, int> ids;
+        const QVector<int> a = internLines(oldText, oldLines, &ids);
+        const QVector<int> b = internLines(newText, newLines, &ids);
+        diffed = diffLines(a, b, maxEditCost, &hunks);
+    }
+    if (!diffed) {
+        hunks = {Hunk{0, int(oldLines.size()) - 1, 0, int(newLines.size()) - 1}};
+    }
+
+    // Trim each hunk to the characters that differ and rebase it on the edits before it
+    int delta = 0;
+    for (const Hunk& hunk : hunks) {
+        const int oldStart = oldLines[hunk.oldStart];
+        const int oldStop = oldLines[hunk.oldEnd];
+        const int newStart = newLines[hunk.newStart];
+        const int newStop = newLines[hunk.newEnd];
+        const int limit = qMin(oldStop - oldStart, newStop - newStart);
+        // Neither end may cut a surrogate pair, or a lone half would be sent
+        int head = commonPrefixLength(oldData + oldStart, newData + newStart, limit);
+        if (head > 0 && oldData[oldStart + head - 1].isHighSurrogate()) {
+            --head;
+        }
+        int tail = commonSuffixLength(oldData + oldStop, newData + newStop, limit - head);
+        if (tail > 0 && oldData[oldStop - tail].isLowSurrogate()) {
+            --tail;
+        }
+
+        Edit edit;
+        edit.position = oldStart + head + delta;
+        edit.removedLength = oldStop - oldStart - head - tail;
+        edit.insertedText = newText.mid(newStart + head, newStop - newStart - head - tail);
+        if (edit.removedLength == 0 && edit.insertedText.isEmpty()) {
+            continue;
+        }
+        delta += edit.insertedText.length() - edit.removedLength;
+        edits.append(edit);
+    }
+    return edits;
+}
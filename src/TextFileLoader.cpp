@@ -0,0 +1,142 @@
+// TextFileLoader.cpp
+#include "TextFileLoader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QStringDecoder>
+#include <QDebug>
+
+namespace {
+
+// Bytes decoded between progress callbacks
+const qint64 SliceSize = 4 * 1024 * 1024;
+
+// Drops the CR of each CRLF pair while moving the slice down to the end of
+// the already accepted text. A CR at the very end of a slice is held back
+// until the next slice shows whether an LF follows.
+qsizetype normaliseLineEndings(QChar* buffer, qsizetype written,
+                               const QChar* sliceStart, const QChar* sliceEnd,
+                               bool* pendingCarriageReturn)
+{
+    QChar* out = buffer + written;
+    const QChar* in = sliceStart;
+
+    if (*pendingCarriageReturn && in < sliceEnd) {
+        if (*in != u'\n') {
+            *out++ = u'\r';
+        }
+        *pendingCarriageReturn = false;
+    }
+
+    while (in < sliceEnd) {
+        QChar c = *in++;
+        if (c == u'\r') {
+            if (in == sliceEnd) {
+                *pendingCarriageReturn = true;
+                break;
+            }
+            if (*in == u'\n') {
+                continue;
+            }
+        }
+        *out++ = c;
+    }
+
+    return out - buffer;
+}
+
+} // namespace
+
+qint64 TextFileLoader::fileSize(const QString& fileName)
+{
+    return QFileInfo(fileName).size();
+}
+
+bool TextFileLoader::load(const QString& fileName, QString* content,
+                          const ProgressCallback& progress, QString* errorMessage)
+{
+    content->clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = file.errorString();
+        }
+        return false;
+    }
+
+    const qint64 total = file.size();
+    if (total == 0) {
+        return true;
+    }
+
+    // Fall back to buffered reads for files that cannot be mapped (pipes, some network mounts)
+    uchar* mapped = file.map(0, total);
+    QByteArray readSlice;
+
+    QByteArray head = mapped
+        ? QByteArray(reinterpret_cast<const char*>(mapped), qMin<qint64>(total, 4))
+        : file.peek(4);
+    QStringConverter::Encoding encoding =
+        QStringConverter::encodingForData(head).value_or(QStringConverter::Utf8);
+    QStringDecoder decoder(encoding);
+
+    // Size the string once for the worst case so every slice decodes in place;
+    // the spare slot covers a carriage return held back between slices
+    content->resize(decoder.requiredSpace(total) + 1);
+    QChar* buffer = content->data();
+    qsizetype written = 0;
+    bool pendingCarriageReturn = false;
+
+    qint64 offset = 0;
+    while (offset < total) {
+        qint64 sliceLength = qMin(SliceSize, total - offset);
+
+        QByteArrayView slice;
+        if (mapped) {
+            slice = QByteArrayView(reinterpret_cast<const char*>(mapped + offset), sliceLength);
+        } else {
+            readSlice = file.read(sliceLength);
+            if (readSlice.size() != sliceLength) {
+                if (errorMessage) {
+                    *errorMessage = file.errorString();
+                }
+                content->clear();
+                return false;
+            }
+            slice = readSlice;
+        }
+
+        QChar* sliceStart = buffer + written + (pendingCarriageReturn ? 1 : 0);
+        QChar* sliceEnd = decoder.appendToBuffer(sliceStart, slice);
+        written = normaliseLineEndings(buffer, written, sliceStart, sliceEnd, &pendingCarriageReturn);
+        offset += sliceLength;
+
+        if (progress && !progress(offset, total)) {
+            content->clear();
+            if (errorMessage) {
+                *errorMessage = "Loading was cancelled";
+            }
+            return false;
+        }
+    }
+
+    if (pendingCarriageReturn) {
+        buffer[written++] = u'\r';
+    }
+
+    if (mapped) {
+        file.unmap(mapped);
+    }
+    file.close();
+
+    if (decoder.hasError()) {
+        qDebug() << "File" << fileName << "contained invalid sequences, replaced while decoding";
+    }
+
+    // Shrinking keeps the allocation, so no second copy is made
+    content->truncate(written);
+    return true;
+}
@@ -0,0 +1,177 @@
+// TextRope.cpp
+#include "TextRope.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+const int TargetChunkLength = 4096;
+const int MinChunkLength = TargetChunkLength / 4;
+const int MaxChunkLength = TargetChunkLength * 2;
+
+} // namespace
+
+TextRope::TextRope()
+    : totalLength(0)
+{
+}
+
+TextRope::TextRope(const QString& text)
+    : totalLength(text.length())
+{
+    splitInto(text, &pieces);
+    updateStarts(0);
+}
+
+QString TextRope::toString() const
+{
+    if (pieces.size() == 1) {
+        return pieces.first();
+    }
+
+    QString result;
+    result.reserve(totalLength);
+    for (const QString& piece : pieces) {
+        result.append(piece);
+    }
+    return result;
+}
+
+QString TextRope::mid(int position, int length) const
+{
+    position = qBound(0, position, totalLength);
+    length = qBound(0, length, totalLength - position);
+    if (length == 0) {
+        return QString();
+    }
+
+    int chunkStart = 0;
+    int index = findChunk(position, &chunkStart);
+    int offset = position - chunkStart;
+
+    QString result;
+    result.reserve(length);
+    while (length > 0 && index < pieces.size()) {
+        int take = qMin(length, int(pieces[index].length()) - offset);
+        result.append(QStringView(pieces[index]).mid(offset, take));
+        length -= take;
+        offset = 0;
+        ++index;
+    }
+    return result;
+}
+
+bool TextRope::replace(int position, int removedLength, const QString& text)
+{
+    if (position < 0 || removedLength < 0 || position + removedLength > totalLength) {
+        return false;
+    }
+    if (removedLength == 0 && text.isEmpty()) {
+        return true;
+    }
+    if (pieces.isEmpty()) {
+        *this = TextRope(text);
+        return true;
+    }
+
+    int first = 0;
+    int last = 0;
+    int firstStart = 0;
+    int lastStart = 0;
+    first = findChunk(position, &firstStart);
+    last = findChunk(position + removedLength, &lastStart);
+    if (last > first && lastStart == position + removedLength) {
+        // The range ends exactly at a chunk boundary
+        --last;
+    }
+
+    // Moving the chunk out leaves it unshared unless a copy still holds it,
+    // in which case only this chunk is copied
+    QString merged = std::move(pieces[first]);
+    for (int i = first + 1; i <= last; ++i) {
+        merged.append(pieces[i]);
+    }
+    merged.replace(position - firstStart, removedLength, text);
+
+    // Fold small results into a neighbour so chunks don't fragment
+    if (merged.length() < MinChunkLength) {
+        if (last + 1 < pieces.size()) {
+            ++last;
+            merged.append(pieces[last]);
+        } else if (first > 0) {
+            --first;
+            merged.prepend(pieces[first]);
+        }
+    }
+
+    QVector<QString> replacement;
+    if (merged.length() > MaxChunkLength) {
+        splitInto(merged, &replacement);
+    } else if (!merged.isEmpty()) {
+        replacement.append(std::move(merged));
+    }
+
+    const int oldCount = last - first + 1;
+    const int common = qMin(oldCount, int(replacement.size()));
+    for (int i = 0; i < common; ++i) {
+        pieces[first + i] = std::move(replacement[i]);
+    }
+    if (oldCount > common) {
+        pieces.remove(first + common, oldCount - common);
+    } else {
+        for (int i = common; i < replacement.size(); ++i) {
+            pieces.insert(first + i, std::move(replacement[i]));
+        }
+    }
+
+    totalLength += text.length() - removedLength;
+    updateStarts(first);
+    return true;
+}
+
+int TextRope::findChunk(int position, int* chunkStart) const
+{
+    if (pieces.isEmpty()) {
+        *chunkStart = 0;
+        return 0;
+    }
+
+    // Last chunk starting at or before position; chunks are never empty
+    auto it = std::upper_bound(starts.constBegin(), starts.constEnd(), position);
+    int index = qMax(0, int(it - starts.constBegin()) - 1);
+    *chunkStart = starts[index];
+    return index;
+}
+
+void TextRope::updateStarts(int fromChunk)
+{
+    const int count = pieces.size();
+    starts.resize(count);
+    int start = fromChunk > 0 ? starts[fromChunk - 1] + pieces[fromChunk - 1].length() : 0;
+    for (int i = fromChunk; i < count; ++i) {
+        starts[i] = start;
+        start += pieces[i].length();
+    }
+}
+
+void TextRope::splitInto(const QString& text, QVector<QString>* out)
+{
+    const int length = text.length();
+    if (length == 0) {
+        return;
+    }
+    if (length <= MaxChunkLength) {
+        // Shares the caller's buffer
+        out->append(text);
+        return;
+    }
+
+    // Even split so the last chunk isn't a tiny remainder
+    const int count = (length + TargetChunkLength - 1) / TargetChunkLength;
+    const int chunkLength = (length + count - 1) / count;
+    out->reserve(out->size() + count);
+    for (int offset = 0; offset < length; offset += chunkLength) {
+        out->append(text.mid(offset, chunkLength));
+    }
+}
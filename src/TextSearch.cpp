@@ -0,0 +1,227 @@
+// TextSearch.cpp
+#include "TextSearch.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTSEARCH_SSE2
+#endif
+
+namespace {
+
+bool isWordCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == u'_';
+}
+
+// The same test the vector filter makes: c is the needle character or,
+// ignoring case, its lower or upper case form
+bool sameCharacter(QChar c, QChar needleChar, Qt::CaseSensitivity cs)
+{
+    return c == needleChar
+        || (cs == Qt::CaseInsensitive && (c == needleChar.toLower() || c == needleChar.toUpper()));
+}
+
+// Whether the needle starts at text
+bool matchesAt(const QChar* text, const QChar* needle, int needleLength, Qt::CaseSensitivity cs)
+{
+    if (cs == Qt::CaseSensitive) {
+        return std::equal(needle, needle + needleLength, text);
+    }
+    return QStringView(text, needleLength).compare(QStringView(needle, needleLength), Qt::CaseInsensitive) == 0;
+}
+
+} // namespace
+
+bool TextSearch::setQuery(const Query& query)
+{
+    currentQuery = query;
+    found.clear();
+    error.clear();
+    expression = QRegularExpression();
+    active = !query.pattern.isEmpty();
+    if (!active || !query.regularExpression) {
+        return true;
+    }
+
+    QString pattern = query.pattern;
+    if (query.wholeWords) {
+        pattern = QStringLiteral("\\b(?:%1)\\b").arg(pattern);
+    }
+    QRegularExpression::PatternOptions options = QRegularExpression::MultilineOption;
+    if (!query.caseSensitive) {
+        options |= QRegularExpression::CaseInsensitiveOption;
+    }
+    expression = QRegularExpression(pattern, options);
+    if (!expression.isValid()) {
+        error = expression.errorString();
+        active = false;
+        return false;
+    }
+    return true;
+}
+
+void TextSearch::clear()
+{
+    currentQuery = Query();
+    expression = QRegularExpression();
+    active = false;
+    error.clear();
+    found.clear();
+}
+
+void TextSearch::searchAll(const QString& text)
+{
+    found = active ? find(text, 0) : QVector<Match>();
+}
+
+void TextSearch::applyEdit(int position, int removedLength, int addedLength,
+                           int windowStart, int windowEnd, const TextReader& textAt)
+{
+    if (!active) {
+        return;
+    }
+
+    // Matches in the window, in the old text; ends ascend like the starts
+    const int delta = addedLength - removedLength;
+    int oldWindowEnd = qMax(windowEnd - delta, position + removedLength);
+    auto first = std::lower_bound(found.begin(), found.end(), windowStart,
+        [](const Match& match, int start) { return match.position + match.length <= start; });
+    auto last = first;
+    while (last != found.end() && last->position < oldWindowEnd) {
+        ++last;
+    }
+
+    // A match cut by the window is searched again as a whole
+    if (first != last) {
+        windowStart = qMin(windowStart, first->position);
+        oldWindowEnd = qMax(oldWindowEnd, (last - 1)->position + (last - 1)->length);
+    }
+    windowEnd = oldWindowEnd + delta;
+
+    for (auto it = last; it != found.end(); ++it) {
+        it->position += delta;
+    }
+    const QVector<Match> fresh = find(textAt(windowStart, windowEnd - windowStart), windowStart);
+
+    const int firstIndex = int(first - found.begin());
+    found.remove(firstIndex, int(last - first));
+    found.insert(firstIndex, fresh.size(), Match{0, 0});
+    std::copy(fresh.cbegin(), fresh.cend(), found.begin() + firstIndex);
+}
+
+QVector<TextSearch::Match> TextSearch::find(const QString& text, int offset) const
+{
+    QVector<Match> matches;
+    if (currentQuery.regularExpression) {
+        QRegularExpressionMatchIterator it = expression.globalMatch(text);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            if (match.capturedLength() > 0) {
+                matches.append(Match{offset + int(match.capturedStart()), int(match.capturedLength())});
+            }
+        }
+        return matches;
+    }
+
+    const QString& needle = currentQuery.pattern;
+    const Qt::CaseSensitivity cs = currentQuery.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    const int length = text.length();
+    int from = 0;
+    while (from < length) {
+        const int index = indexOf(text.constData(), length, needle.constData(), needle.length(), from, cs);
+        if (index < 0) {
+            break;
+        }
+        const int end = index + needle.length();
+        if (currentQuery.wholeWords
+            && ((index > 0 && isWordCharacter(text.at(index - 1)))
+                || (end < length && isWordCharacter(text.at(end))))) {
+            from = index + 1;
+            continue;
+        }
+        matches.append(Match{offset + index, int(needle.length())});
+        from = end;
+    }
+    return matches;
+}
+
+QString TextSearch::replacementFor(const QString& text, const Match& target, const QString& replacement) const
+{
+    if (!currentQuery.regularExpression) {
+        return replacement;
+    }
+
+    // Matched again in the whole text so lookarounds and anchors see the
+    // same context as the search did
+    const QRegularExpressionMatch match = expression.match(text, target.position, QRegularExpression::NormalMatch,
+                                                           QRegularExpression::AnchorAtOffsetMatchOption);
+    QString result;
+    result.reserve(replacement.length());
+    for (int i = 0; i < replacement.length(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c != u'\\' || i + 1 == replacement.length()) {
+            result += c;
+            continue;
+        }
+        const QChar next = replacement.at(++i);
+        if (next.isDigit()) {
+            result += match.captured(next.digitValue());
+        } else if (next == u'n') {
+            result += u'\n';
+        } else if (next == u't') {
+            result += u'\t';
+        } else {
+            result += next;
+        }
+    }
+    return result;
+}
+
+int TextSearch::indexOf(const QChar* text, int length, const QChar* needle, int needleLength,
+                        int from, Qt::CaseSensitivity cs)
+{
+    if (needleLength <= 0 || from < 0 || length - from < needleLength) {
+        return -1;
+    }
+
+    const QChar firstChar = needle[0];
+    const QChar lastChar = needle[needleLength - 1];
+    const int lastStart = length - needleLength; // Last position a match can start at
+    int i = from;
+
+#ifdef TEXTSEARCH_SSE2
+    // Compare eight candidate starts at once against the needle's first and
+    // last characters (both cases when ignoring case); only starts where both
+    // agree are checked in full
+    const auto broadcast = [](QChar c) { return _mm_set1_epi16(short(c.unicode())); };
+    const bool foldCase = cs == Qt::CaseInsensitive;
+    const __m128i firstLower = broadcast(foldCase ? firstChar.toLower() : firstChar);
+    const __m128i firstUpper = broadcast(foldCase ? firstChar.toUpper() : firstChar);
+    const __m128i lastLower = broadcast(foldCase ? lastChar.toLower() : lastChar);
+    const __m128i lastUpper = broadcast(foldCase ? lastChar.toUpper() : lastChar);
+    for (; i + 8 <= lastStart + 1; i += 8) {
+        const __m128i heads = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        const __m128i tails = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + needleLength - 1));
+        const __m128i headHits = _mm_or_si128(_mm_cmpeq_epi16(heads, firstLower), _mm_cmpeq_epi16(heads, firstUpper));
+        const __m128i tailHits = _mm_or_si128(_mm_cmpeq_epi16(tails, lastLower), _mm_cmpeq_epi16(tails, lastUpper));
+        quint32 candidates = quint32(_mm_movemask_epi8(_mm_and_si128(headHits, tailHits))) & 0x5555u;
+        while (candidates) {
+            const int start = i + int(qCountTrailingZeroBits(candidates)) / 2;
+            if (matchesAt(text + start, needle, needleLength, cs)) {
+                return start;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    for (; i <= lastStart; ++i) {
+        if (sameCharacter(text[i], firstChar, cs) && sameCharacter(text[i + needleLength - 1], lastChar, cs)
+            && matchesAt(text + i, needle, needleLength, cs)) {
+            return i;
+        }
+    }
+    return -1;
+}
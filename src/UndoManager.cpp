@@ -0,0 +1,177 @@
+// UndoManager.cpp
+#include "UndoManager.h"
+
+#include <QDateTime>
+
+namespace {
+
+// Edits further apart than this start a new undo step
+const qint64 MergeWindowMs = 1000;
+
+} // namespace
+
+UndoManager::UndoManager(int maxEntries, int maxCharacters)
+    : maxEntries(qMax(1, maxEntries))
+    , maxCharacters(qMax(1, maxCharacters))
+    , storedCharacters(0)
+    , runOpen(false)
+    , nextStep(0)
+    , compoundStep(-1)
+{
+}
+
+void UndoManager::recordLocal(int position, const QString& removedText, const QString& insertedText)
+{
+    if (removedText.isEmpty() && insertedText.isEmpty()) {
+        return;
+    }
+
+    for (const Entry& entry : redoStack) {
+        storedCharacters -= entrySize(entry);
+    }
+    redoStack.clear();
+
+    Entry entry{position, removedText, insertedText, QDateTime::currentMSecsSinceEpoch(),
+                compoundStep >= 0 ? compoundStep : nextStep++};
+    if (compoundStep < 0 && runOpen && !undoStack.isEmpty() && mergeInto(&undoStack.last(), entry)) {
+        storedCharacters += entrySize(entry);
+    } else {
+        undoStack.append(entry);
+        storedCharacters += entrySize(entry);
+    }
+    runOpen = compoundStep < 0;
+    enforceBudget();
+}
+
+void UndoManager::beginCompound()
+{
+    compoundStep = nextStep++;
+    runOpen = false;
+}
+
+void UndoManager::endCompound()
+{
+    compoundStep = -1;
+}
+
+bool UndoManager::mergeInto(Entry* last, const Entry& entry) const
+{
+    if (entry.timestamp - last->timestamp > MergeWindowMs || entry.insertedText.contains(QLatin1Char('\n'))) {
+        return false;
+    }
+
+    if (entry.removedText.isEmpty() && !last->insertedText.isEmpty()
+        && entry.position == last->position + last->insertedText.length()) {
+        // Typing on from the end of the previous step
+        last->insertedText += entry.insertedText;
+    } else if (entry.insertedText.isEmpty() && last->insertedText.isEmpty()
+               && entry.position + entry.removedText.length() == last->position) {
+        // Backspace run
+        last->removedText.prepend(entry.removedText);
+        last->position = entry.position;
+    } else if (entry.insertedText.isEmpty() && last->insertedText.isEmpty()
+               && entry.position == last->position) {
+        // Delete run
+        last->removedText += entry.removedText;
+    } else {
+        return false;
+    }
+    last->timestamp = entry.timestamp;
+    return true;
+}
+
+void UndoManager::transform(int position, int removedLength, int insertedLength)
+{
+    runOpen = false;
+    transformStack(&undoStack, true, position, removedLength, insertedLength);
+    transformStack(&redoStack, false, position, removedLength, insertedLength);
+}
+
+void UndoManager::transformStack(QVector<Entry>* stack, bool undoSide, int position, int removedLength, int insertedLength)
+{
+    // The top entry is relative to the current text and each one below it to
+    // the text with the entries above reverted, so the remote edit is carried
+    // down the stack and rebased past every entry it crosses
+    for (int i = stack->size() - 1; i >= 0; --i) {
+        Entry& entry = (*stack)[i];
+        const int present = undoSide ? entry.insertedText.length() : entry.removedText.length();
+        const int absent = undoSide ? entry.removedText.length() : entry.insertedText.length();
+
+        if (position + removedLength <= entry.position) {
+            // Before the entry, including inserts right at its start
+            entry.position += insertedLength - removedLength;
+        } else if (position >= entry.position + present) {
+            position += absent - present;
+        } else {
+            // A peer changed text this step would revert; the steps below
+            // depend on it, so they go too, and so does the rest of its step
+            while (i + 1 < stack->size() && (*stack)[i + 1].step == (*stack)[i].step) {
+                ++i;
+            }
+            for (int j = 0; j <= i; ++j) {
+                storedCharacters -= entrySize((*stack)[j]);
+            }
+            stack->remove(0, i + 1);
+            return;
+        }
+    }
+}
+
+bool UndoManager::undo(QVector<Edit>* edits)
+{
+    runOpen = false;
+    edits->clear();
+    if (undoStack.isEmpty()) {
+        return false;
+    }
+
+    // Newest entry first; redo then replays them oldest first
+    const int step = undoStack.last().step;
+    while (!undoStack.isEmpty() && undoStack.last().step == step) {
+        Entry entry = undoStack.takeLast();
+        edits->append(Edit{entry.position, int(entry.insertedText.length()), entry.removedText});
+        redoStack.append(entry);
+    }
+    return true;
+}
+
+bool UndoManager::redo(QVector<Edit>* edits)
+{
+    runOpen = false;
+    edits->clear();
+    if (redoStack.isEmpty()) {
+        return false;
+    }
+
+    const int step = redoStack.last().step;
+    while (!redoStack.isEmpty() && redoStack.last().step == step) {
+        Entry entry = redoStack.takeLast();
+        edits->append(Edit{entry.position, int(entry.removedText.length()), entry.insertedText});
+        undoStack.append(entry);
+    }
+    return true;
+}
+
+void UndoManager::clear()
+{
+    undoStack.clear();
+    redoStack.clear();
+    storedCharacters = 0;
+    runOpen = false;
+}
+
+void UndoManager::enforceBudget()
+{
+    // Oldest steps go first, whole; the newest step is always kept
+    const int newestStep = undoStack.isEmpty() ? -1 : undoStack.last().step;
+    int drop = 0;
+    while (drop < undoStack.size() && undoStack[drop].step != newestStep
+           && (undoStack.size() - drop > maxEntries || storedCharacters > maxCharacters
+               || (drop > 0 && undoStack[drop].step == undoStack[drop - 1].step))) {
+        storedCharacters -= entrySize(undoStack[drop]);
+        ++drop;
+    }
+    if (drop > 0) {
+        undoStack.remove(0, drop);
+    }
+}
@@ -1,37 +1,252 @@
 #include "UserStorage.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QLockFile>
 #include <QJsonDocument>
 #include <QDir>
+#include <QHash>
+#include <QDateTime>
+#include <QReadWriteLock>
+#include <QDebug>
 
-QString UserStorage::getUserFilePath() {
-    return QDir::currentPath() + "/users.json";
+namespace {
+
+// Fold the journal into users.json after this many records
+const int MinJournalRecordsBeforeCompaction = 256;
+const int LockFileTimeoutMs = 5000;
+
+struct UserIndex {
+    QReadWriteLock lock;
+    QHash<QString, QJsonObject> users; // username -> user info
+    bool loaded = false;
+    QDateTime snapshotModified;
+    qint64 journalOffset = 0;
+    int journalRecords = 0;
+};
+
+UserIndex& userIndex()
+{
+    static UserIndex index;
+    return index;
 }
 
-QJsonObject UserStorage::readUsersFromFile() {
-    QFile file(getUserFilePath());
-    QJsonObject users;
+QString getLockFilePath()
+{
+    return UserStorage::getUserFilePath() + ".lock";
+}
 
+// Applies journal records appended since the last read. Caller holds the write lock.
+void readJournalTail(UserIndex& index)
+{
+    QFile journal(UserStorage::getJournalFilePath());
+    if (!journal.open(QIODevice::ReadOnly)) {
+        index.journalOffset = 0;
+        return;
+    }
+
+    journal.seek(index.journalOffset);
+    while (!journal.atEnd()) {
+        QByteArray line = journal.readLine();
+        if (!line.endsWith('\n')) {
+            break; // Record still being written by another process
+        }
+        index.journalOffset += line.size();
+
+        QJsonDocument record = QJsonDocument::fromJson(line);
+        if (record.isObject()) {
+            QJsonObject obj = record.object();
+            index.users.insert(obj["username"].toString(), obj["user"].toObject());
+            ++index.journalRecords;
+        }
+    }
+    journal.close();
+}
+
+void loadAll(UserIndex& index)
+{
+    index.users.clear();
+    index.journalOffset = 0;
+    index.journalRecords = 0;
+
+    QFile file(UserStorage::getUserFilePath());
     if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QByteArray data = file.readAll();
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
         file.close();
 
-        QJsonDocument doc = QJsonDocument::fromJson(data);
         if (doc.isObject()) {
-            users = doc.object();
+            QJsonObject users = doc.object();
+            index.users.reserve(users.size());
+            for (auto it = users.begin(); it != users.end(); ++it) {
+                index.users.insert(it.key(), it.value().toObject());
+            }
         }
     }
 
+    index.snapshotModified = QFileInfo(UserStorage::getUserFilePath()).lastModified();
+    readJournalTail(index);
+    index.loaded = true;
+}
+
+// Picks up registrations and compactions made by other processes.
+// Caller holds the write lock.
+void refresh(UserIndex& index)
+{
+    if (!index.loaded) {
+        loadAll(index);
+        return;
+    }
+
+    QFileInfo snapshot(UserStorage::getUserFilePath());
+    QFileInfo journal(UserStorage::getJournalFilePath());
+    if (snapshot.lastModified() != index.snapshotModified || journal.size() < index.journalOffset) {
+        loadAll(index);
+    } else if (journal.size() > index.journalOffset) {
+        readJournalTail(index);
+    }
+}
+
+// Rewrites users.json from the index and drops the journal. Caller holds
+// the write lock and the lock file.
+bool writeSnapshot(UserIndex& index)
+{
+    QJsonObject users;
+    for (auto it = index.users.constBegin(); it != index.users.constEnd(); ++it) {
+        users[it.key()] = it.value();
+    }
+
+    QSaveFile file(UserStorage::getUserFilePath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+    file.write(QJsonDocument(users).toJson());
+    if (!file.commit()) {
+        return false;
+    }
+
+    QFile::remove(UserStorage::getJournalFilePath());
+    index.journalOffset = 0;
+    index.journalRecords = 0;
+    index.snapshotModified = QFileInfo(UserStorage::getUserFilePath()).lastModified();
+    return true;
+}
+
+} // namespace
+
+QString UserStorage::getUserFilePath() {
+    return QDir::currentPath() + "/users.json";
+}
+
+QString UserStorage::getJournalFilePath() {
+    return QDir::currentPath() + "/users.journal";
+}
+
+QJsonObject UserStorage::readUsersFromFile() {
+    UserIndex& index = userIndex();
+    QWriteLocker locker(&index.lock);
+    refresh(index);
+
+    QJsonObject users;
+    for (auto it = index.users.constBegin(); it != index.users.constEnd(); ++it) {
+        users[it.key()] = it.value();
+    }
     return users;
 }
 
 bool UserStorage::writeUsersToFile(const QJsonObject& users) {
-    QFile file(getUserFilePath());
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    QLockFile fileLock(getLockFilePath());
+    if (!fileLock.tryLock(LockFileTimeoutMs)) {
         return false;
     }
 
-    QJsonDocument doc(users);
-    file.write(doc.toJson());
-    file.close();
+    UserIndex& index = userIndex();
+    QWriteLocker locker(&index.lock);
+
+    index.users.clear();
+    for (auto it = users.begin(); it != users.end(); ++it) {
+        index.users.insert(it.key(), it.value().toObject());
+    }
+    index.loaded = true;
+    return writeSnapshot(index);
+}
+
+bool UserStorage::findUser(const QString& username, QJsonObject* userInfo) {
+    UserIndex& index = userIndex();
+
+    {
+        QReadLocker locker(&index.lock);
+        if (index.loaded) {
+            auto it = index.users.constFind(username);
+            if (it != index.users.constEnd()) {
+                if (userInfo) {
+                    *userInfo = it.value();
+                }
+                return true;
+            }
+        }
+    }
+
+    // Not known yet: load on first use, or catch up with other processes
+    QWriteLocker locker(&index.lock);
+    refresh(index);
+    auto it = index.users.constFind(username);
+    if (it == index.users.constEnd()) {
+        return false;
+    }
+    if (userInfo) {
+        *userInfo = it.value();
+    }
     return true;
 }
+
+bool UserStorage::addUser(const QString& username, const QJsonObject& userInfo) {
+    QLockFile fileLock(getLockFilePath());
+    if (!fileLock.tryLock(LockFileTimeoutMs)) {
+        qDebug() << "Timed out waiting for user store lock";
+        return false;
+    }
+
+    UserIndex& index = userIndex();
+    QWriteLocker locker(&index.lock);
+    refresh(index);
+
+    if (index.users.contains(username)) {
+        return false;
+    }
+
+    QJsonObject record;
+    record["username"] = username;
+    record["user"] = userInfo;
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+
+    QFile journal(getJournalFilePath());
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    if (journal.write(line) != line.size()) {
+        journal.close();
+        return false;
+    }
+    journal.close();
+
+    index.users.insert(username, userInfo);
+    index.journalOffset += line.size();
+    ++index.journalRecords;
+
+    if (index.journalRecords > qMax(MinJournalRecordsBeforeCompaction, int(index.users.size()) / 4)) {
+        writeSnapshot(index);
+    }
+    return true;
+}
+
+bool UserStorage::compact() {
+    QLockFile fileLock(getLockFilePath());
+    if (!fileLock.tryLock(LockFileTimeoutMs)) {
+        return false;
+    }
+
+    UserIndex& index = userIndex();
+    QWriteLocker locker(&index.lock);
+    refresh(index);
+    return writeSnapshot(index);
+}
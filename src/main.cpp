@@ -8,6 +8,7 @@
 #include "CollaborationServer.h"
 #include "CollaborationClient.h"
 #include "Document.h"
+#include "DocumentStorage.h"
 #include "User.h"
 
 int main(int argc, char *argv[])
@@ -29,9 +30,23 @@ int main(int argc, char *argv[])
     QCommandLineOption serverOption(QStringList() << "s" << "server",
                                    "Run in server-only mode");
     parser.addOption(serverOption);
+
+    QCommandLineOption migrateStorageOption(QStringList() << "migrate-storage",
+                                            "Move documents from the flat documents/ layout into sharded directories and exit");
+    parser.addOption(migrateStorageOption);
     
     parser.process(app);
     
+    if (parser.isSet(migrateStorageOption)) {
+        int migrated = DocumentStorage::getInstance().migrateFlatLayout();
+        if (migrated < 0) {
+            qDebug() << "Storage migration finished with errors";
+            return 1;
+        }
+        qDebug() << "Storage migration complete:" << migrated << "documents moved";
+        return 0;
+    }
+
     // Apply fusion style for a modern look
     QApplication::setStyle(QStyleFactory::create("Fusion"));
     
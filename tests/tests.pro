@@ -0,0 +1,17 @@
+QT       += testlib
+QT       -= gui
+
+TARGET = codecolab_tests
+TEMPLATE = app
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+SOURCES += \
+    tst_datastructures.cpp \
+    ../src/AnchorIndex.cpp \
+    ../src/BracketIndex.cpp \
+    ../src/EditOperation.cpp \
+    ../src/TextDiff.cpp
+
+INCLUDEPATH += ../include
@@ -0,0 +1,363 @@
+// tst_datastructures.cpp
+#include <QtTest>
+
+#include <QRandomGenerator>
+#include <vector>
+
+#include "AnchorIndex.h"
+#include "BracketIndex.h"
+#include "EditOperation.h"
+#include "TextDiff.h"
+
+// Checks the editor's index structures against brute-force models
+class DataStructureTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void anchorsFollowOverlappingDeletes();
+    void anchorsMatchBruteForce();
+    void bracketSearchMatchesDepthScan();
+    void diffRoundTrips_data();
+    void diffRoundTrips();
+    void diffKeepsSurrogatePairs();
+    void expandReplace();
+    void expandMoveRange();
+    void expandIndentOutdent();
+    void expandReplaceAll();
+};
+
+namespace {
+
+// QTextCursor semantics: at the edit or inside the removed range ends after the insertion
+int shiftedPosition(int anchor, int position, int removedLength, int insertedLength)
+{
+    if (anchor < position) {
+        return anchor;
+    }
+    if (anchor < position + removedLength) {
+        return position + insertedLength;
+    }
+    return anchor + insertedLength - removedLength;
+}
+
+QString applyDiff(QString text, const QVector<TextDiff::Edit>& edits)
+{
+    for (const TextDiff::Edit& edit : edits) {
+        text.replace(edit.position, edit.removedLength, edit.insertedText);
+    }
+    return text;
+}
+
+QString applySteps(QString text, const QVector<EditOperation>& steps)
+{
+    for (const EditOperation& step : steps) {
+        text.replace(step.position, step.deletionLength, step.insertion);
+    }
+    return text;
+}
+
+QVector<EditOperation> expandOn(const EditOperation& op, const QString& text)
+{
+    return op.expand([&text](int position, int length) { return text.mid(position, length); },
+                     text.length());
+}
+
+EditOperation makeOperation(EditOperation::Kind kind, int position, int deletionLength,
+                            const QString& insertion = QString())
+{
+    EditOperation op;
+    op.kind = kind;
+    op.position = position;
+    op.deletionLength = deletionLength;
+    op.insertion = insertion;
+    return op;
+}
+
+} // namespace
+
+void DataStructureTests::anchorsFollowOverlappingDeletes()
+{
+    AnchorIndex anchors;
+    QVector<int> handles;
+    for (int position = 0; position <= 20; ++position) {
+        handles.append(anchors.create(position));
+    }
+
+    // [5, 10) then [3, 8), which overlaps where the first one collapsed
+    anchors.applyEdit(5, 5, 0);
+    anchors.applyEdit(3, 5, 2);
+    for (int position = 0; position <= 20; ++position) {
+        const int expected = shiftedPosition(shiftedPosition(position, 5, 5, 0), 3, 5, 2);
+        QCOMPARE(anchors.position(handles[position]), expected);
+    }
+
+    // Deleting everything collapses every anchor onto the insertion's end
+    anchors.applyEdit(0, 12, 4);
+    for (int handle : handles) {
+        QCOMPARE(anchors.position(handle), 4);
+    }
+    QCOMPARE(anchors.count(), int(handles.size()));
+}
+
+void DataStructureTests::anchorsMatchBruteForce()
+{
+    QRandomGenerator random(36);
+    AnchorIndex anchors;
+    QVector<int> handles;
+    QVector<int> expected;
+    int textLength = 1000;
+
+    for (int round = 0; round < 2000; ++round) {
+        const int action = random.bounded(10);
+        if (action < 2) {
+            const int position = random.bounded(textLength + 1);
+            handles.append(anchors.create(position));
+            expected.append(position);
+        } else if (action < 3 && !handles.isEmpty()) {
+            const int i = random.bounded(int(handles.size()));
+            anchors.remove(handles[i]);
+            QVERIFY(!anchors.isValid(handles[i]));
+            handles.remove(i);
+            expected.remove(i);
+        } else {
+            const int position = random.bounded(textLength + 1);
+            const int removedLength = random.bounded(qMin(50, textLength - position) + 1);
+            const int insertedLength = random.bounded(30);
+            anchors.applyEdit(position, removedLength, insertedLength);
+            for (int& anchor : expected) {
+                anchor = shiftedPosition(anchor, position, removedLength, insertedLength);
+            }
+            textLength += insertedLength - removedLength;
+        }
+    }
+
+    QCOMPARE(anchors.count(), int(handles.size()));
+    for (int i = 0; i < handles.size(); ++i) {
+        QCOMPARE(anchors.position(handles[i]), expected[i]);
+    }
+}
+
+void DataStructureTests::bracketSearchMatchesDepthScan()
+{
+    QRandomGenerator random(47);
+    BracketIndex index;
+    std::vector<BracketIndex::LineSummary> lines;
+
+    const auto randomLine = [&random]() {
+        BracketIndex::LineSummary summary;
+        summary.minDepth = -random.bounded(3);
+        summary.delta = summary.minDepth + random.bounded(5);
+        return summary;
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        // Replace a random block, sometimes with nothing or with more lines
+        const int first = random.bounded(int(lines.size()) + 1);
+        const int removed = random.bounded(qMin(10, int(lines.size()) - first) + 1);
+        std::vector<BracketIndex::LineSummary> inserted(random.bounded(12));
+        for (BracketIndex::LineSummary& summary : inserted) {
+            summary = randomLine();
+        }
+        index.replaceLines(first, removed, inserted);
+        lines.erase(lines.begin() + first, lines.begin() + first + removed);
+        lines.insert(lines.begin() + first, inserted.begin(), inserted.end());
+        if (!lines.empty() && random.bounded(2)) {
+            const int line = random.bounded(int(lines.size()));
+            lines[line] = randomLine();
+            index.setLine(line, lines[line]);
+        }
+        QCOMPARE(index.lineCount(), int(lines.size()));
+
+        // Lowest depth each line reaches, by a straight scan
+        std::vector<int> lowest(lines.size());
+        int depth = 0;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            QCOMPARE(index.depthBefore(int(i)), depth);
+            lowest[i] = depth + lines[i].minDepth;
+            depth += lines[i].delta;
+        }
+
+        const int count = int(lines.size());
+        for (int query = 0; query < 20; ++query) {
+            const int line = random.bounded(count + 1);
+            const int target = random.bounded(-5, 20);
+
+            int forward = -1;
+            for (int i = line; i < count && forward < 0; ++i) {
+                if (lowest[i] <= target) {
+                    forward = i;
+                }
+            }
+            int backward = -1;
+            for (int i = qMin(line, count - 1); i >= 0 && backward < 0; --i) {
+                if (lowest[i] <= target) {
+                    backward = i;
+                }
+            }
+            QCOMPARE(index.findForward(line, target), forward);
+            QCOMPARE(index.findBackward(line, target), backward);
+        }
+    }
+}
+
+void DataStructureTests::diffRoundTrips_data()
+{
+    QTest::addColumn<QString>("oldText");
+    QTest::addColumn<QString>("newText");
+
+    QTest::newRow("equal") << QStringLiteral("a\nb\n") << QStringLiteral("a\nb\n");
+    QTest::newRow("from empty") << QString() << QStringLiteral("one\ntwo");
+    QTest::newRow("to empty") << QStringLiteral("one\ntwo") << QString();
+    QTest::newRow("inside a line") << QStringLiteral("int x = 1;\n") << QStringLiteral("int y = 12;\n");
+    QTest::newRow("lines moved") << QStringLiteral("a\nb\nc\nd\ne\n") << QStringLiteral("b\nc\na\ne\nd\nf");
+    QTest::newRow("no final newline") << QStringLiteral("x\ny") << QStringLiteral("x\ny\n");
+    QTest::newRow("long prefix") << QString(100, u'x') + QStringLiteral("a") + QString(100, u'y')
+                                 << QString(100, u'x') + QStringLiteral("b") + QString(100, u'y');
+    QTest::newRow("surrogates")
+        << QStringLiteral("\U0001F600 smile\n\U0001F4A9\nend") << QStringLiteral("\U0001F601 smile\nend\U0001F600");
+}
+
+void DataStructureTests::diffRoundTrips()
+{
+    QFETCH(QString, oldText);
+    QFETCH(QString, newText);
+
+    const QVector<TextDiff::Edit> edits = TextDiff::diff(oldText, newText);
+    QCOMPARE(applyDiff(oldText, edits), newText);
+    // The same when the line search gives up at once
+    QCOMPARE(applyDiff(oldText, TextDiff::diff(oldText, newText, 0)), newText);
+}
+
+void DataStructureTests::diffKeepsSurrogatePairs()
+{
+    // Emoji differing only in the low half; no edit may split a pair
+    QRandomGenerator random(37);
+    const QStringList symbols{QStringLiteral("a"), QStringLiteral("\n"), QStringLiteral("\U0001F600"),
+                              QStringLiteral("\U0001F601"), QStringLiteral("\U0001F4A9")};
+
+    for (int round = 0; round < 500; ++round) {
+        QString oldText;
+        QString newText;
+        for (int i = random.bounded(30); i > 0; --i) {
+            oldText += symbols[random.bounded(int(symbols.size()))];
+        }
+        newText = oldText;
+        for (int i = random.bounded(1, 4); i > 0; --i) {
+            // Change whole symbols only, so both texts stay well formed
+            int position = random.bounded(int(newText.length()) + 1);
+            if (position > 0 && position < newText.length() && newText[position].isLowSurrogate()) {
+                --position;
+            }
+            const int removed = position < newText.length() && newText[position].isHighSurrogate() ? 2 : 0;
+            newText.replace(position, removed, symbols[random.bounded(int(symbols.size()))]);
+        }
+
+        const QVector<TextDiff::Edit> edits = TextDiff::diff(oldText, newText);
+        QString text = oldText;
+        for (const TextDiff::Edit& edit : edits) {
+            const int end = edit.position + edit.removedLength;
+            QVERIFY(edit.position >= text.length() || !text[edit.position].isLowSurrogate());
+            QVERIFY(end >= text.length() || !text[end].isLowSurrogate());
+            QVERIFY(edit.insertedText.isEmpty() || !edit.insertedText.front().isLowSurrogate());
+            QVERIFY(edit.insertedText.isEmpty() || !edit.insertedText.back().isHighSurrogate());
+            text.replace(edit.position, edit.removedLength, edit.insertedText);
+        }
+        QCOMPARE(text, newText);
+    }
+}
+
+void DataStructureTests::expandReplace()
+{
+    const QString text = QStringLiteral("hello");
+
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Replace, 0, 0, "> "), text)),
+             QStringLiteral("> hello"));
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Replace, 5, 0, "!"), text)),
+             QStringLiteral("hello!"));
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Replace, 0, 5), text)),
+             QString());
+
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Replace, 6, 0, "!"), text).isEmpty());
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Replace, 3, 3), text).isEmpty());
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Replace, -1, 1), text).isEmpty());
+}
+
+void DataStructureTests::expandMoveRange()
+{
+    const QString text = QStringLiteral("abcdef");
+
+    EditOperation toEnd = makeOperation(EditOperation::Kind::MoveRange, 0, 2);
+    toEnd.targetPosition = 6;
+    QCOMPARE(applySteps(text, expandOn(toEnd, text)), QStringLiteral("cdefab"));
+
+    EditOperation toStart = makeOperation(EditOperation::Kind::MoveRange, 4, 2);
+    toStart.targetPosition = 0;
+    QCOMPARE(applySteps(text, expandOn(toStart, text)), QStringLiteral("efabcd"));
+
+    // Onto either end of itself is a no-op
+    EditOperation inPlace = makeOperation(EditOperation::Kind::MoveRange, 2, 2);
+    inPlace.targetPosition = 4;
+    QCOMPARE(applySteps(text, expandOn(inPlace, text)), text);
+    inPlace.targetPosition = 2;
+    QCOMPARE(applySteps(text, expandOn(inPlace, text)), text);
+
+    EditOperation inside = makeOperation(EditOperation::Kind::MoveRange, 1, 4);
+    inside.targetPosition = 3;
+    QVERIFY(expandOn(inside, text).isEmpty());
+    EditOperation pastEnd = makeOperation(EditOperation::Kind::MoveRange, 0, 2);
+    pastEnd.targetPosition = 7;
+    QVERIFY(expandOn(pastEnd, text).isEmpty());
+    EditOperation empty = makeOperation(EditOperation::Kind::MoveRange, 0, 0);
+    empty.targetPosition = 6;
+    QVERIFY(expandOn(empty, text).isEmpty());
+}
+
+void DataStructureTests::expandIndentOutdent()
+{
+    const QString text = QStringLiteral("a\n\n  b\n\tc\n    d");
+    const int length = text.length();
+
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Indent, 0, length, "  "), text)),
+             QStringLiteral("  a\n\n    b\n  \tc\n      d"));
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Outdent, 0, length, "  "), text)),
+             QStringLiteral("a\n\nb\nc\n  d"));
+
+    // Just the last line, and an empty range at the very end
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Indent, 10, length - 10, "\t"), text)),
+             QStringLiteral("a\n\n  b\n\tc\n\t    d"));
+    QCOMPARE(applySteps(text, expandOn(makeOperation(EditOperation::Kind::Outdent, 10, length - 10, "  "), text)),
+             QStringLiteral("a\n\n  b\n\tc\n  d"));
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Indent, length, 0, "\t"), text).isEmpty());
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Outdent, length, 0, "  "), text).isEmpty());
+
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Indent, 0, length + 1, "  "), text).isEmpty());
+    QVERIFY(expandOn(makeOperation(EditOperation::Kind::Outdent, 0, length, QString()), text).isEmpty());
+}
+
+void DataStructureTests::expandReplaceAll()
+{
+    const QString text = QStringLiteral("foo bar foo");
+
+    EditOperation same = makeOperation(EditOperation::Kind::ReplaceAll, 0, 3, "baz");
+    same.positions = {0, 8};
+    QCOMPARE(applySteps(text, expandOn(same, text)), QStringLiteral("baz bar baz"));
+
+    EditOperation perMatch = makeOperation(EditOperation::Kind::ReplaceAll, 0, 0);
+    perMatch.positions = {0, 4, 11};
+    perMatch.lengths = {3, 3, 0};
+    perMatch.replacements = {"x", QString(), "!"};
+    QCOMPARE(applySteps(text, expandOn(perMatch, text)), QStringLiteral("x  foo!"));
+
+    EditOperation pastEnd = same;
+    pastEnd.positions = {0, 9};
+    QVERIFY(expandOn(pastEnd, text).isEmpty());
+    EditOperation overlapping = same;
+    overlapping.positions = {0, 2};
+    QVERIFY(expandOn(overlapping, text).isEmpty());
+    EditOperation mismatched = perMatch;
+    mismatched.lengths = {3, 3};
+    QVERIFY(expandOn(mismatched, text).isEmpty());
+}
+
+QTEST_APPLESS_MAIN(DataStructureTests)
+#include "tst_datastructures.moc"